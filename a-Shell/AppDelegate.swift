@@ -24,58 +24,492 @@ var appDependentPath: String = "" // part of the path that depends on the App lo
 let __known_browsers = ["internalbrowser", "googlechrome", "firefox", "safari", "yandexbrowser", "brave", "opera"]
 var localServerApp = Router()
 
-func startLocalWebServer() {
-    localServerApp.get("/*") { request, response, next in
-        // NSLog("Kitura request received: \(request.matchedPath)")
+// Module resolution for require.js in the wasm WebView: GET /__resolve?pwd=directory&id=module
+// answers with the path of the module file on the first line, followed by its content (or an
+// empty first line if there is no such module). That's one request instead of one for each
+// candidate file. The candidates are the same, in the same order, as in requireEngine (require.js),
+// and each one is looked up in ~/Library first, then in the App bundle, like the other files served.
+// Results are kept with the modification dates of the ~/Library directories that were looked at,
+// and used again as long as these directories are unchanged (no file added or removed).
+// They are stored in Library/Caches, so they survive restarts, and reset with each new build.
+class ModuleResolver {
+    static let shared = ModuleResolver()
+    private struct Entry: Codable {
+        let path: String? // nil if the module was not found
+        let directories: [String]
+        let dates: [Double] // -1 if the directory doesn't exist
+    }
+    private struct Cache: Codable {
+        let build: String
+        var entries: [String: Entry]
+    }
+    private static let suffixes = ["", "/browser.js", "-browserify/index.js", "/package.json", ".js", "/index.js"]
+    private let build = (Bundle.main.infoDictionary?["CFBundleVersion"] as? String) ?? ""
+    private var entries: [String: Entry] = [:]
+    private var loaded = false
+    private var saveScheduled = false
+    private let libraryPath: String
+    private let resourcePath = Bundle.main.resourcePath!
+    private let cacheURL: URL?
+    // All access to the cache goes through this queue:
+    private let queue = DispatchQueue(label: "AsheKube.a-Shell.moduleResolver", qos: .userInitiated)
+
+    private init() {
+        libraryPath = try! FileManager().url(for: .libraryDirectory, in: .userDomainMask, appropriateFor: nil, create: true).path
+        cacheURL = try? FileManager().url(for: .cachesDirectory, in: .userDomainMask, appropriateFor: nil, create: true).appendingPathComponent("moduleResolution.json")
+    }
+
+    private func modificationDate(_ path: String) -> Double {
+        var info = stat()
+        if (stat(path, &info) != 0) { return -1 }
+        return Double(info.st_mtimespec.tv_sec) + Double(info.st_mtimespec.tv_nsec) / 1e9
+    }
+
+    private func isFile(_ path: String) -> Bool {
+        var info = stat()
+        return (stat(path, &info) == 0) && ((info.st_mode & S_IFMT) == S_IFREG)
+    }
+
+    // must be called on queue:
+    private func loadIfNeeded() {
+        if (loaded) { return }
+        loaded = true
+        if let url = cacheURL, let data = try? Data(contentsOf: url),
+           let cache = try? JSONDecoder().decode(Cache.self, from: data), (cache.build == build) {
+            entries = cache.entries
+        }
+    }
+
+    // must be called on queue:
+    private func scheduleSave() {
+        if (saveScheduled) { return }
+        saveScheduled = true
+        // Modules are usually loaded in bursts, save once at the end:
+        queue.asyncAfter(deadline: .now() + 2) {
+            self.saveScheduled = false
+            if let url = self.cacheURL, let data = try? JSONEncoder().encode(Cache(build: self.build, entries: self.entries)) {
+                try? data.write(to: url, options: .atomic)
+            }
+        }
+    }
+
+    // The path of the file for module id, required from directory (both as in URLs), nil if not found.
+    func resolve(directory: String, id: String) -> String? {
+        return queue.sync {
+            loadIfNeeded()
+            let key = directory + "\n" + id
+            if let entry = entries[key], zip(entry.directories, entry.dates).allSatisfy({ modificationDate($0) == $1 }) {
+                return entry.path
+            }
+            var result: String? = nil
+            var directories: [String] = []
+            if let base = URL(string: "https://localhost" + directory) {
+                for suffix in ModuleResolver.suffixes + ["/" + id + ".js"] {
+                    guard let url = URL(string: id + suffix, relativeTo: base)?.standardized else { continue }
+                    let path = url.path
+                    let libraryFile = libraryPath + path
+                    let libraryDirectory = (libraryFile as NSString).deletingLastPathComponent
+                    if (!directories.contains(libraryDirectory)) {
+                        directories.append(libraryDirectory)
+                    }
+                    if isFile(libraryFile) || isFile(resourcePath + path) {
+                        result = path
+                        break
+                    }
+                }
+            }
+            entries[key] = Entry(path: result, directories: directories, dates: directories.map { modificationDate($0) })
+            scheduleSave()
+            return result
+        }
+    }
+}
+
+// node_modules/tarp_bundle.js holds the modules loaded each time the wasm WebView starts
+// (see createRequireBundle.js). If the user installed their own version of one of them in
+// ~/Library/node_modules, we send an empty bundle so theirs gets loaded instead.
+func requireBundleOverridden(bundlePath: String, libraryPath: String) -> Bool {
+    guard let file = fopen(bundlePath, "r") else { return true }
+    defer { fclose(file) }
+    var line: UnsafeMutablePointer<CChar>? = nil
+    var capacity = 0
+    defer { free(line) }
+    if (getline(&line, &capacity, file) <= 0) { return true }
+    let firstLine = String(cString: line!).trimmingCharacters(in: .whitespacesAndNewlines)
+    guard firstLine.hasPrefix("// packages: ") else { return true }
+    for package in firstLine.dropFirst("// packages: ".count).split(separator: " ") {
+        if (FileManager().fileExists(atPath: libraryPath + "/node_modules/" + package)) {
+            return true
+        }
+    }
+    return false
+}
+
+// Files opened by jsc.openFile() in the WebViews (see the "jsc" prompts in SceneDelegate).
+// Their content goes through /__fd on the local server as raw bytes, instead of base64
+// strings in prompt(). Only these descriptors are accessible, with the token of this launch.
+class WebViewFiles {
+    static let shared = WebViewFiles()
+    let token = UUID().uuidString
+    private let queue = DispatchQueue(label: "webViewFiles")
+    private var descriptors = Set<Int32>()
+
+    func insert(_ fd: Int32) {
+        queue.sync { _ = descriptors.insert(fd) }
+    }
+
+    func contains(_ fd: Int32) -> Bool {
+        return queue.sync { descriptors.contains(fd) }
+    }
+
+    func remove(_ fd: Int32) -> Bool {
+        return queue.sync { descriptors.remove(fd) != nil }
+    }
+
+    // The file descriptor for a request, if it has the right token and the descriptor was opened by jsc:
+    func descriptor(_ request: RouterRequest) -> Int32? {
+        guard (request.queryParameters["token"] == token), let fd = Int32(request.queryParameters["fd"] ?? "") else {
+            return nil
+        }
+        return queue.sync { descriptors.contains(fd) ? fd : nil }
+    }
+}
+
+// Files served by the local server ("/*"). A file in ~/Library replaces the file with the same
+// path in the App bundle, so ~/Library is checked (one stat) on each request. The bundle doesn't
+// change while the App runs: its lookups are kept, and its small files stay in memory.
+// Precompressed variants (file.br, file.gz next to the file) are sent to clients that accept them.
+class LocalAssets {
+    static let shared = LocalAssets()
+
+    struct Asset {
+        let path: String
+        let size: Int64
+        let modified: Date
+        let etag: String
+        let inBundle: Bool
+        // Precompressed variants, in order of preference:
+        let encodings: [(name: String, path: String, size: Int64)]
+    }
+
+    private let queue = DispatchQueue(label: "localAssets")
+    private var bundleAssets: [String: Asset?] = [:]
+    private var contents: [String: Data] = [:]
+    private var contentsSize = 0
+    let maximumFileSize = 4 << 20
+    let maximumCacheSize = 32 << 20
+    let libraryPath: String
+    let resourcePath = Bundle.main.resourcePath!
+
+    static let httpDateFormatter: DateFormatter = {
+        let formatter = DateFormatter()
+        formatter.locale = Locale(identifier: "en_US_POSIX")
+        formatter.timeZone = TimeZone(identifier: "GMT")
+        formatter.dateFormat = "EEE, dd MMM yyyy HH:mm:ss 'GMT'"
+        return formatter
+    }()
+
+    static let contentTypes = ["html": "text/html", "js": "application/javascript", "mjs": "application/javascript",
+                               "wasm": "application/wasm", "json": "application/json", "css": "text/css",
+                               "svg": "image/svg+xml", "png": "image/png", "txt": "text/plain", "map": "application/json"]
+
+    init() {
+        libraryPath = try! FileManager().url(for: .libraryDirectory, in: .userDomainMask, appropriateFor: nil, create: true).path
+    }
+
+    // size and modification date, for regular files only:
+    private func fileInfo(_ path: String) -> (size: Int64, modified: Date)? {
+        var info = stat()
+        if (stat(path, &info) != 0) || ((info.st_mode & S_IFMT) != S_IFREG) {
+            return nil
+        }
+        let modified = Double(info.st_mtimespec.tv_sec) + Double(info.st_mtimespec.tv_nsec) / 1e9
+        return (size: Int64(info.st_size), modified: Date(timeIntervalSince1970: modified))
+    }
+
+    private func makeAsset(path: String, inBundle: Bool) -> Asset? {
+        guard let info = fileInfo(path) else { return nil }
+        var encodings: [(name: String, path: String, size: Int64)] = []
+        for (name, suffix) in [("br", ".br"), ("gzip", ".gz")] {
+            // A variant older than the file is out of date:
+            if let variant = fileInfo(path + suffix), (variant.modified >= info.modified) {
+                encodings.append((name: name, path: path + suffix, size: variant.size))
+            }
+        }
+        let etag = "\"" + String(info.size, radix: 16) + "-" + String(Int64(info.modified.timeIntervalSince1970 * 1e6), radix: 16) + "\""
+        return Asset(path: path, size: info.size, modified: info.modified, etag: etag, inBundle: inBundle, encodings: encodings)
+    }
+
+    func asset(for urlPath: String) -> Asset? {
+        if (urlPath.contains("/../")) || (urlPath.hasSuffix("/..")) {
+            return nil
+        }
         // Load ~/Library/node_modules first if it exists:
         // This also loads ~/Library/wasm.html and ~/Library/require.js if the user really wants to.
-        let libraryURL = try! FileManager().url(for: .libraryDirectory,
-                                                in: .userDomainMask,
-                                                appropriateFor: nil,
-                                                create: true)
-        let localFilePath = libraryURL.path + request.matchedPath
-        let rootFilePath = Bundle.main.resourcePath! + request.matchedPath
-        var fileName: String? = nil
-        // NSLog("file requested: \(urlPath). Trying \(localFilePath)  and \(rootFilePath)")
-        if (FileManager().fileExists(atPath: localFilePath) && !URL(fileURLWithPath: localFilePath).isDirectory) {
-            fileName = localFilePath
-        } else if (FileManager().fileExists(atPath: rootFilePath) && !URL(fileURLWithPath: rootFilePath).isDirectory) {
-            fileName = rootFilePath
-        }
-        if let filePath = fileName {
-            if (request.matchedPath.hasSuffix(".html")) {
-                response.headers["Content-Type"] = "text/html"
-            } else if (request.matchedPath.hasSuffix(".js")) {
-                response.headers["Content-Type"] = "application/javascript"
-            } else if (request.matchedPath.hasSuffix(".wasm")) {
-                response.headers["Content-Type"] = "application/wasm"
+        if let asset = makeAsset(path: libraryPath + urlPath, inBundle: false) {
+            return asset
+        }
+        return queue.sync {
+            if let asset = bundleAssets[urlPath] {
+                return asset
             }
-            // These headers get us a "crossOriginIsolated == true;" on OSX Safari
-            response.headers["Cross-Origin-Embedder-Policy"] = "require-corp"
-            response.headers["Cross-Origin-Opener-Policy"] = "same-origin"
-            response.headers["Cross-Origin-Resource-Policy"] =  "same-origin"
-            do {
-                // NSLog("Kitura file found: \(filePath)")
-                try response.send(fileName: filePath)
+            let asset = makeAsset(path: resourcePath + urlPath, inBundle: true)
+            bundleAssets[urlPath] = asset
+            return asset
+        }
+    }
+
+    // The content of a file (or of one of its variants). Small bundle files are kept in memory.
+    func data(path: String, size: Int64, inBundle: Bool) -> Data? {
+        let cacheable = inBundle && (size <= maximumFileSize)
+        if (cacheable), let data = queue.sync(execute: { contents[path] }) {
+            return data
+        }
+        guard let data = FileManager().contents(atPath: path) else { return nil }
+        if (cacheable) {
+            queue.sync {
+                if (contents[path] == nil) && (contentsSize + data.count <= maximumCacheSize) {
+                    contents[path] = data
+                    contentsSize += data.count
+                }
             }
-            catch {
-                response.statusCode = .forbidden
-                response.send("Loading \(filePath) failed")
+        }
+        return data
+    }
+
+    // length bytes at offset, without reading the rest of the file:
+    func data(path: String, offset: Int64, length: Int64) -> Data? {
+        guard let file = FileHandle(forReadingAtPath: path) else { return nil }
+        defer { file.closeFile() }
+        file.seek(toFileOffset: UInt64(offset))
+        return file.readData(ofLength: Int(length))
+    }
+
+    static func contentType(_ urlPath: String) -> String? {
+        return contentTypes[(urlPath as NSString).pathExtension.lowercased()]
+    }
+
+    // Each encoding is a different representation of the file, with its own entity tag
+    // ("size-mtime-br"), so that a tag never validates a body in another encoding:
+    static func etag(_ asset: Asset, encoding: String?) -> String {
+        guard let encoding = encoding else { return asset.etag }
+        return String(asset.etag.dropLast()) + "-" + encoding + "\""
+    }
+
+    // If-None-Match, or If-Modified-Since if there is no If-None-Match:
+    static func notModified(_ request: RouterRequest, _ asset: Asset, etag: String) -> Bool {
+        if let tags = request.headers["If-None-Match"] {
+            return tags.split(separator: ",").contains { tag in
+                var tag = tag.trimmingCharacters(in: .whitespaces)
+                if (tag.hasPrefix("W/")) {
+                    tag.removeFirst(2)
+                }
+                return (tag == "*") || (tag == etag)
+            }
+        }
+        if let since = request.headers["If-Modified-Since"], let date = httpDateFormatter.date(from: since) {
+            return floor(asset.modified.timeIntervalSince1970) <= date.timeIntervalSince1970
+        }
+        return false
+    }
+
+    // A single byte range ("bytes=a-b", "bytes=a-", "bytes=-n"). nil if there is no usable Range header,
+    // an empty range if it can't be satisfied. Several ranges are answered with the whole file.
+    static func byteRange(_ request: RouterRequest, _ asset: Asset) -> Range<Int64>? {
+        guard let header = request.headers["Range"], header.hasPrefix("bytes="), !header.contains(",") else {
+            return nil
+        }
+        if let condition = request.headers["If-Range"], (condition != asset.etag) {
+            return nil
+        }
+        let bounds = header.dropFirst("bytes=".count).split(separator: "-", omittingEmptySubsequences: false)
+        if (bounds.count != 2) {
+            return nil
+        }
+        let first = Int64(bounds[0].trimmingCharacters(in: .whitespaces))
+        let last = Int64(bounds[1].trimmingCharacters(in: .whitespaces))
+        if (first == nil) {
+            guard let suffix = last, (suffix > 0) else { return 0..<0 }
+            return max(asset.size - suffix, 0)..<asset.size
+        }
+        if (first! >= asset.size) || ((last != nil) && (last! < first!)) {
+            return 0..<0
+        }
+        return first!..<min((last ?? asset.size - 1) + 1, asset.size)
+    }
+}
+
+// The local server can run on plain HTTP on the loopback interface (setting "local_server_http").
+// http://localhost is a secure context, so cross-origin isolation still works, without the TLS cost.
+var localServerURL = ""
+
+func startLocalWebServer() {
+    localServerApp.get("/__resolve") { request, response, next in
+        let directory = request.queryParameters["pwd"] ?? "/"
+        let id = request.queryParameters["id"] ?? ""
+        var body = "\n"
+        if let path = ModuleResolver.shared.resolve(directory: directory, id: id) {
+            let libraryURL = try! FileManager().url(for: .libraryDirectory,
+                                                    in: .userDomainMask,
+                                                    appropriateFor: nil,
+                                                    create: true)
+            var filePath = libraryURL.path + path
+            if (!FileManager().fileExists(atPath: filePath)) {
+                filePath = Bundle.main.resourcePath! + path
+            }
+            if let data = FileManager().contents(atPath: filePath) {
+                body = path + "\n" + String(decoding: data, as: UTF8.self)
             }
+        }
+        response.headers["Content-Type"] = "text/plain; charset=utf-8"
+        response.headers["Cross-Origin-Resource-Policy"] =  "same-origin"
+        response.send(body)
+        try? response.end()
+    }
+    // jsc.openFile() in the WebView: read length bytes (by default, until the end of the file)
+    // at position (by default, the current position). Bytes are sent as x-user-defined text, since
+    // synchronous XMLHttpRequests can't return an ArrayBuffer.
+    localServerApp.get("/__fd") { request, response, next in
+        response.headers["Cross-Origin-Resource-Policy"] =  "same-origin"
+        guard let fd = WebViewFiles.shared.descriptor(request) else {
+            response.statusCode = .forbidden
+            response.send(String(cString: strerror(EBADF)))
+            try? response.end()
+            return
+        }
+        let position = Int64(request.queryParameters["position"] ?? "") ?? -1
+        var length = Int(request.queryParameters["length"] ?? "") ?? -1
+        if (length < 0) {
+            var info = stat()
+            fstat(fd, &info)
+            let start = (position >= 0) ? position : Int64(lseek(fd, 0, SEEK_CUR))
+            length = Int(max(Int64(info.st_size) - start, 0))
+        }
+        var data = Data(count: length)
+        let count = data.withUnsafeMutableBytes { JSCBootstrap.readFully(fd, $0, position: position) }
+        if (count < 0) {
+            response.statusCode = .badRequest
+            response.send(String(cString: strerror(errno)))
+            errno = 0
+        } else {
+            data.count = count
+            response.headers["Content-Type"] = "text/plain; charset=x-user-defined"
+            response.send(data: data)
+        }
+        try? response.end()
+    }
+    // Writes the request body at position (by default, the current position), returns the number of bytes written.
+    localServerApp.put("/__fd") { request, response, next in
+        response.headers["Cross-Origin-Resource-Policy"] =  "same-origin"
+        response.headers["Content-Type"] = "text/plain"
+        guard let fd = WebViewFiles.shared.descriptor(request) else {
+            response.statusCode = .forbidden
+            response.send(String(cString: strerror(EBADF)))
+            try? response.end()
+            return
+        }
+        let position = Int64(request.queryParameters["position"] ?? "") ?? -1
+        var data = Data()
+        _ = try? request.read(into: &data)
+        let count = data.withUnsafeMutableBytes { JSCBootstrap.writeFully(fd, $0, position: position) }
+        if (count < 0) {
+            response.statusCode = .badRequest
+            response.send(String(cString: strerror(errno)))
+            errno = 0
         } else {
+            response.send("\(count)")
+        }
+        try? response.end()
+    }
+    localServerApp.get("/*") { request, response, next in
+        // NSLog("Kitura request received: \(request.matchedPath)")
+        let urlPath = request.matchedPath
+        guard let asset = LocalAssets.shared.asset(for: urlPath) else {
             // NSLog("Kitura file not found: \(request.matchedPath)")
             response.statusCode = .notFound
             response.send("")
+            next()
+            return
+        }
+        // These headers get us a "crossOriginIsolated == true;" on OSX Safari
+        response.headers["Cross-Origin-Embedder-Policy"] = "require-corp"
+        response.headers["Cross-Origin-Opener-Policy"] = "same-origin"
+        response.headers["Cross-Origin-Resource-Policy"] =  "same-origin"
+        if let contentType = LocalAssets.contentType(urlPath) {
+            response.headers["Content-Type"] = contentType
+        }
+        if (urlPath == "/node_modules/tarp_bundle.js") && (asset.inBundle) &&
+            requireBundleOverridden(bundlePath: asset.path, libraryPath: LocalAssets.shared.libraryPath) {
+            // Depends on ~/Library/node_modules, not on the file itself:
+            response.headers["Cache-Control"] = "no-store"
+            response.send("")
+            next()
+            return
+        }
+        // Files can be replaced at any time (~/Library): cached, but always revalidated.
+        response.headers["Cache-Control"] = "no-cache"
+        // Ranges are served from the file itself, full responses from a precompressed variant
+        // if the client accepts one:
+        let range = LocalAssets.byteRange(request, asset)
+        var variant: (name: String, path: String, size: Int64)? = nil
+        if (range == nil) {
+            let accepted = (request.headers["Accept-Encoding"] ?? "").lowercased()
+            variant = asset.encodings.first(where: { accepted.contains($0.name) })
+        }
+        let etag = LocalAssets.etag(asset, encoding: variant?.name)
+        response.headers["ETag"] = etag
+        response.headers["Last-Modified"] = LocalAssets.httpDateFormatter.string(from: asset.modified)
+        response.headers["Accept-Ranges"] = "bytes"
+        if (!asset.encodings.isEmpty) {
+            response.headers["Vary"] = "Accept-Encoding"
+        }
+        if LocalAssets.notModified(request, asset, etag: etag) {
+            response.statusCode = .notModified
+            next()
+            return
+        }
+        if let range = range {
+            if (range.isEmpty) {
+                response.statusCode = .requestedRangeNotSatisfiable
+                response.headers["Content-Range"] = "bytes */\(asset.size)"
+            } else if let data = LocalAssets.shared.data(path: asset.path, offset: range.lowerBound, length: Int64(range.count)) {
+                response.statusCode = .partialContent
+                response.headers["Content-Range"] = "bytes \(range.lowerBound)-\(range.upperBound - 1)/\(asset.size)"
+                response.send(data: data)
+            } else {
+                response.statusCode = .forbidden
+                response.send("Loading \(asset.path) failed")
+            }
+            next()
+            return
+        }
+        var file = (path: asset.path, size: asset.size)
+        if let variant = variant {
+            response.headers["Content-Encoding"] = variant.name
+            file = (path: variant.path, size: variant.size)
+        }
+        if let data = LocalAssets.shared.data(path: file.path, size: file.size, inBundle: asset.inBundle) {
+            // NSLog("Kitura file found: \(file.path)")
+            response.send(data: data)
+        } else {
+            response.headers["Content-Encoding"] = nil
+            response.headers["ETag"] = nil
+            response.statusCode = .forbidden
+            response.send("Loading \(file.path) failed")
         }
         next()
     }
     let sslConfig =  SSLConfig(withChainFilePath: Bundle.main.resourcePath! + "/localCertificate.pfx",
                                withPassword: "password",
                                usingSelfSignedCerts: true)
-    if (appVersion != "a-Shell-mini") {
-        Kitura.addHTTPServer(onPort: 8443, with: localServerApp, withSSL: sslConfig)
+    let port = (appVersion != "a-Shell-mini") ? 8443 : 8334
+    if (UserDefaults.standard.bool(forKey: "local_server_http")) {
+        // Loopback only: nothing else can reach a server without TLS.
+        Kitura.addHTTPServer(onPort: port, onAddress: "127.0.0.1", with: localServerApp)
+        localServerURL = "http://localhost:\(port)"
     } else {
-        Kitura.addHTTPServer(onPort: 8334, with: localServerApp, withSSL: sslConfig)
+        Kitura.addHTTPServer(onPort: port, with: localServerApp, withSSL: sslConfig)
+        localServerURL = "https://localhost:\(port)"
     }
     localServerQueue.async{
         Kitura.run()
@@ -220,6 +654,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
         replaceCommand("z", "z_command", true) // change directory based on frequencys
         replaceCommand("rehash", "rehash", true) // update list of commands for auto-complete
         replaceCommand("repeatCommand", "repeatCommand", true)
+        replaceCommand("watch", "watch_command", true) // repeat a command, full screen
         replaceCommand("downloadFile", "downloadFile", true)
         replaceCommand("downloadFolder", "downloadFolder", true)
         replaceCommand("hideKeyboard", "hideKeyboard", true)
@@ -373,7 +808,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
         // Switch installed Python packages from 3.9 to 3.13:
         if (FileManager().fileExists(atPath: libraryURL.path + "/lib/python3.9/site-packages/")) {
             installQueue.async{
-                ios_switchSession("filesCleanup")
+                switchToSession(named: "filesCleanup")
                 // Move all site-packages to $HOME/Library/lib/python3.11/site-packages/
                 executeCommandAndWait(command: "mkdir -p " + libraryURL.path + "/lib/python3.13/site-packages/")
                 executeCommandAndWait(command: "mv " + libraryURL.path + "/lib/python3.9/site-packages/* " + libraryURL.path + "/lib/python3.11/site-packages/")
@@ -384,7 +819,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
         // Switch installed Python packages from 3.11 to 3.13:
         if (FileManager().fileExists(atPath: libraryURL.path + "/lib/python3.11/site-packages/")) {
             installQueue.async{
-                ios_switchSession("filesCleanup")
+                switchToSession(named: "filesCleanup")
                 // Move all site-packages to $HOME/Library/lib/python3.11/site-packages/
                 executeCommandAndWait(command: "mkdir -p " + libraryURL.path + "/lib/python3.13/site-packages/")
                 executeCommandAndWait(command: "mv " + libraryURL.path + "/lib/python3.11/site-packages/* " + libraryURL.path + "/lib/python3.13/site-packages/")
@@ -396,7 +831,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
             installQueue.async{
                 // The version number changed, so the App has been re-installed. Clean all pre-compiled Python files:
                 NSLog("Cleaning __pycache__ and .cpan/build")
-                ios_switchSession("filesCleanup")
+                switchToSession(named: "filesCleanup")
                 if (FileManager().fileExists(atPath: libraryURL.path + "/__pycache__")) {
                     executeCommandAndWait(command: "rm -rf " + libraryURL.path + "/__pycache__/*")
                 }
@@ -16,6 +16,10 @@ var runningInExtension = false
 var cachedDelegate: SceneDelegate? = nil
 
 var currentDelegate: SceneDelegate? {
+    // The context is the sessionContext pointer of a window: no need to compare strings for the usual case.
+    if let delegate = cachedDelegate, let context = delegate.sessionContext, (ios_getContext() == UnsafeMutableRawPointer(context)) {
+        return delegate
+    }
     let opaquePointer = OpaquePointer(ios_getContext())
     if let stringPointer = UnsafeMutablePointer<CChar>(opaquePointer) {
         let currentSessionIdentifier = String(cString: stringPointer)
@@ -1888,42 +1892,59 @@ public func updateCommands(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutable
 }
 
 
-// Used both by z and by auto-complete for directories
-public func rankDirectory(dir: String, base: String?) -> Int {
-    var key = dir
+// Rank a list of directories by frecency, with one access to the index:
+// directories never visited come after the others, and hidden directories last.
+public func rankDirectories(dirs: [String], base: String?) -> [Double] {
+    var prefix = ""
     if (base != nil) {
-        key = base!
-        if (!key.hasSuffix("/")) {
-            key += "/"
+        prefix = base!
+        if (!prefix.hasSuffix("/")) {
+            prefix += "/"
         }
-        key += dir
-    }
-    if let used = directoriesUsed[key] {
-        return used
     }
-    if dir.hasPrefix(".") {
-        return -2
+    let frecencies = DirectoryIndex.shared.frecencies(dirs.map { prefix + $0 })
+    return zip(dirs, frecencies).map { dir, frecency in
+        if let frecency = frecency {
+            return frecency
+        }
+        return dir.hasPrefix(".") ? -2 : -1
     }
-    return -1
 }
 
-// Called by "cd", used to store the directory where we go, so we can sort them based on frequency
+// Sort directories in order of use (alphabetical order for directories with the same rank)
+public func sortDirectoriesByUse(_ dirs: [String], base: String?) -> [String] {
+    let ranks = rankDirectories(dirs: dirs, base: base)
+    return zip(dirs, ranks).sorted(by: { ($0.1 > $1.1) || (($0.1 == $1.1) && ($0.0 < $1.0)) }).map { $0.0 }
+}
+
+// Directories from the current directory matching the query, for z when nothing in the index
+// matches. Same matching rules (see DirectoryQuery), sorted in order of use.
+func localDirectoriesMatching(_ query: DirectoryQuery) -> [String] {
+    guard let urls = try? FileManager().contentsOfDirectory(at: URL(fileURLWithPath: FileManager().currentDirectoryPath),
+                                                            includingPropertiesForKeys: [.isDirectoryKey], options: []) else { return [] }
+    let names = urls.filter { $0.isDirectory }.map { $0.lastPathComponent }
+    var result = names.filter { query.score(Array($0.utf8)) != nil }
+    if (result.count == 0) {
+        result = names.filter { query.isCandidate(Array($0.utf8)) }
+    }
+    if (result.count > 1) {
+        let localDirCompact = String(cString: ios_getBookmarkedVersion(FileManager().currentDirectoryPath.utf8CString))
+        result = sortDirectoriesByUse(result, base: localDirCompact)
+    }
+    return result
+}
+
+// Called by "cd", used to store the directory where we go, so we can sort them based on frecency
 @_cdecl("storeDirectoryUsed")
 public func storeDirectoryUsed(directory: String) {
     var key = directory
     if (key.hasSuffix("/")) {
         key.removeLast()
     }
-    if let seenBefore = directoriesUsed[key] {
-        directoriesUsed[key] = seenBefore + 1;
-    } else {
-        directoriesUsed[key] = 0;
-    }
-    // NSLog("Storing directory: \(key) : \(directoriesUsed[key])")
+    DirectoryIndex.shared.visit(key)
 }
 
-// z command: change to the most recent directory that matches the argument(s)
-// TODO: autocomplete for z
+// z command: change to the most frecent directory that matches the argument(s)
 @_cdecl("z_command")
 public func z_command(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
     guard let args = convertCArguments(argc: argc, argv: argv) else { return 1 }
@@ -1941,91 +1962,45 @@ public func z_command(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePoint
             return 0
         }
     }
-    // If that didn't work
-    // we build a regex from the args, to make sure args are in order.
-    var matchingRegexp = args[1].replacingOccurrences(of: ".", with: "\\.").replacingOccurrences(of: "/", with: ".*/.*")
-    if (args.count > 2) {
-        for i in 2...args.count - 1 {
-            matchingRegexp += ".*" + args[i].replacingOccurrences(of: ".", with: "\\.").replacingOccurrences(of: "/", with: ".*/.*")
-        }
+    // If that didn't work, look for the arguments, in order, in the directories visited.
+    // Each argument is one pattern, so that z "my dir" looks for "my dir":
+    let query = DirectoryQuery(words: Array(args[1...]))
+    var result = DirectoryIndex.shared.matches(query, limit: 1)
+    if (result.count == 0) {
+        // No matches in history. Search local directory, same rules.
+        result = localDirectoriesMatching(query)
     }
-    do {
-        let regex = try NSRegularExpression(pattern: matchingRegexp, options: [])
-        // select keys from dictionary that match argument. Using partial match.
-        let result = directoriesUsed.filter( { regex.matches(in: $0.key, range: NSRange($0.key.startIndex..<$0.key.endIndex, in: $0.key)).count > 0 } )
-        if (result.count == 0) {
-            // No matches in history. Search local directory, same regexp.
-            let filePaths = try FileManager().contentsOfDirectory(atPath: FileManager().currentDirectoryPath)
-            var result = filePaths.filter( { regex.matches(in: $0, range: NSRange($0.startIndex..<$0.endIndex, in: $0)).count > 0 } )
-            NSLog("local search: \(result)")
-            NSLog("Current directory: \(FileManager().currentDirectoryPath)")
-            if (result.count == 0) {
-                fputs("No matches for ", thread_stdout)
-                for i in 1...args.count - 1 {
-                    fputs(args[i] + " ", thread_stdout)
-                }
-                fputs("\n", thread_stdout)
-                return -1
-            }
-            if (result.count > 1) {
-                let localDirCompact = String(cString: ios_getBookmarkedVersion(FileManager().currentDirectoryPath.utf8CString)) + "/"
-                result = result.sorted(by: { current, next in rankDirectory(dir: current, base: localDirCompact) > rankDirectory(dir: next, base: localDirCompact)})
-            }
-            fputs("cd \(result[0])\n", thread_stdout)
-            executeCommandAndWait(command: "cd " + result[0])
-            newPreviousDirectory()
-            return 0
-        }
-        if (result.count == 1) {
-            if let directory = result.first?.key {
-                fputs("cd \(directory)\n", thread_stdout)
-                executeCommandAndWait(command: "cd " + directory)
-                newPreviousDirectory()
-                return 0
-            }
-            return 1
+    if (result.count == 0) {
+        fputs("No matches for ", thread_stdout)
+        for i in 1...args.count - 1 {
+            fputs(args[i] + " ", thread_stdout)
         }
-        var keys = result.keys.sorted()
-        keys = keys.sorted(by: { current, next in rankDirectory(dir: current, base: nil) > rankDirectory(dir: next, base: nil)})
-        fputs("cd \(keys[0])\n", thread_stdout)
-        executeCommandAndWait(command: "cd " + keys[0])
-        newPreviousDirectory()
-        return 0
-    }
-    catch {
-        NSLog("Could not create regexp for: \(matchingRegexp)", thread_stderr)
+        fputs("\n", thread_stdout)
         return -1
     }
-    return 1
+    fputs("cd \(result[0])\n", thread_stdout)
+    executeCommandAndWait(command: "cd " + result[0].replacingOccurrences(of: " ", with: "\\ "))
+    newPreviousDirectory()
+    return 0
 }
 
 
-// TODO: autocomplete for z
-@_cdecl("rehash")
-public func rehash(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
-    guard let args = convertCArguments(argc: argc, argv: argv) else { return 1 }
-    if args.count > 1 {
-        fputs("usage: rehash\nRecomputes list of executables in $PATH for auto-complete.\n", thread_stdout)
-        return 0
-    }
-    // First get list of builtin commnds:
-    guard var commandsArray = commandsAsArray() as! [String]? else { return -1 }
-    // Then scan PATH for executable files:
-    let executablePath = String(cString: ios_getenv("PATH"))
-    // NSLog("\(executablePath)")
+// Builds the JavaScript that sends the list of commands (builtins + files in $PATH) to script.js
+// for autocomplete. The list goes as a single newline-separated string: it is much smaller than
+// an array literal, and script.js sorts and indexes it once (see setCommandList).
+func commandListJavascript(path executablePath: String) -> String? {
+    guard var commandsArray = commandsAsArray() as! [String]? else { return nil }
+    var knownCommands = Set(commandsArray)
     for directory in executablePath.components(separatedBy: ":") {
-        if (directory == "") {
-            continue
-        }
-        if (directory == ".") {
+        if (directory == "") || (directory == ".") {
             continue
         }
         do {
             // We don't check for exec status, because files inside $APPDIR have no x bit set.
             for file in try FileManager().contentsOfDirectory(atPath: directory) {
                 let newCommand = URL(fileURLWithPath: file).lastPathComponent
-                // Do not add a command if it is already present:
-                if (!commandsArray.contains(newCommand)) {
+                // Do not add a command if it is already present (or can't be sent in the list):
+                if (!newCommand.contains("\n") && knownCommands.insert(newCommand).inserted) {
                     commandsArray.append(newCommand)
                 }
             }
@@ -2034,18 +2009,27 @@ public func rehash(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<
             continue
         }
     }
-    commandsArray.sort() // make sure it's in alphabetical order
-    var javascriptCommand = "commandList = ["
-    for command in commandsArray {
-        javascriptCommand += "\"" + command + "\", "
+    let commandsString = commandsArray.map {
+        $0.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"")
+    }.joined(separator: "\\n")
+    return "setCommandList(\"" + commandsString + "\");"
+}
+
+// TODO: autocomplete for z
+@_cdecl("rehash")
+public func rehash(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
+    guard let args = convertCArguments(argc: argc, argv: argv) else { return 1 }
+    if args.count > 1 {
+        fputs("usage: rehash\nRecomputes list of executables in $PATH for auto-complete.\n", thread_stdout)
+        return 0
     }
-    javascriptCommand += "];"
+    guard let javascriptCommand = commandListJavascript(path: String(cString: ios_getenv("PATH"))) else { return -1 }
     DispatchQueue.main.async {
         if let delegate = currentDelegate {
             delegate.resignFirstResponder()
             delegate.webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
                 if let error = error {
-                    NSLog("Error in creating command list, line = \(javascriptCommand) error = \(error)")
+                    NSLog("Error in creating command list, error = \(error)")
                 }
                 // if let result = result as? Int32 {  }
             }
@@ -2057,7 +2041,7 @@ public func rehash(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<
 @_cdecl("repeatCommand")
 public func repeatCommand(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
     guard let args = convertCArguments(argc: argc, argv: argv) else { return 1 }
-    let usageString = "usage: repeatCommand interval command\n    Executes the command \"command\" every \"interval\" seconds.\nusage: repeatCommand\n    Shows the current running command, interval, last time it was executed and next scheduled execution.\nusage: repeatCommand --stop\n    Stops the repetition.\n"
+    let usageString = "usage: repeatCommand interval command\n    Executes the command \"command\" every \"interval\" seconds.\nusage: repeatCommand\n    Shows the current running command, interval, last time it was executed and next scheduled execution.\nusage: repeatCommand --stop\n    Stops the repetition.\nTo see the output of a command refresh in place, full screen, use watch.\n"
     if (args.count == 2) && ((args[1] == "-h") || (args[1] == "--help") || (args[1] == "-help")) {
         fputs(usageString, thread_stdout)
         return -1
@@ -2094,6 +2078,229 @@ public func repeatCommand(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutableP
     return 0
 }
 
+// Number of terminal columns used by a character (approximate: wide East Asian characters and emoji use 2).
+private func columnWidth(_ character: Character) -> Int {
+    guard let scalar = character.unicodeScalars.first?.value else { return 0 }
+    if (scalar >= 0x1100 && scalar <= 0x115F) || (scalar >= 0x2E80 && scalar <= 0xA4CF) ||
+        (scalar >= 0xAC00 && scalar <= 0xD7A3) || (scalar >= 0xF900 && scalar <= 0xFAFF) ||
+        (scalar >= 0xFE30 && scalar <= 0xFE4F) || (scalar >= 0xFF00 && scalar <= 0xFF60) ||
+        (scalar >= 0xFFE0 && scalar <= 0xFFE6) || (scalar >= 0x1F300 && scalar <= 0x1F64F) ||
+        (scalar >= 0x1F900 && scalar <= 0x1F9FF) || (scalar >= 0x20000 && scalar <= 0x3FFFD) {
+        return 2
+    }
+    return 1
+}
+
+// One line of output as it appears on the screen for watch: tabs expanded, cut at the
+// terminal width, escape sequences removed (or kept, with -c, but not counted in the width).
+private func watchScreenLine(_ line: Substring, width: Int, color: Bool) -> String {
+    var result = ""
+    var column = 0
+    var iterator = line.makeIterator()
+    while let c = iterator.next() {
+        if (c == "\u{001B}") {
+            // CSI sequences end with a character between @ and ~, others are ESC + one character:
+            var sequence = String(c)
+            if let next = iterator.next() {
+                sequence.append(next)
+                if (next == "[") {
+                    while let s = iterator.next() {
+                        sequence.append(s)
+                        if let value = s.asciiValue, (value >= 0x40) && (value <= 0x7E) { break }
+                    }
+                }
+            }
+            if (color) { result += sequence }
+            continue
+        }
+        if (c == "\t") {
+            let spaces = min(8 - column % 8, width - column)
+            result += String(repeating: " ", count: spaces)
+            column += spaces
+        } else if let value = c.asciiValue, value < 0x20 {
+            continue // other control characters (\r...)
+        } else {
+            let w = columnWidth(c)
+            if (column + w > width) { break }
+            result.append(c)
+            column += w
+        }
+        if (column >= width) { break }
+    }
+    return result
+}
+
+// Runs the command with its output going to a pipe, and returns the output.
+private func captureCommandOutput(command: String) -> String {
+    let outputPipe = Pipe()
+    let inputPipe = Pipe() // the command has no input
+    try? inputPipe.fileHandleForWriting.close()
+    // The FILEs get their own copies of the descriptors, since the FileHandles close theirs:
+    guard let output_file = fdopen(dup(outputPipe.fileHandleForWriting.fileDescriptor), "w") else { return "" }
+    try? outputPipe.fileHandleForWriting.close() // output_file is now the only writer
+    guard let input_file = fdopen(dup(inputPipe.fileHandleForReading.fileDescriptor), "r") else {
+        fclose(output_file)
+        return ""
+    }
+    // Read while the command runs, so it doesn't block on a full pipe:
+    var data = Data()
+    let reading = DispatchGroup()
+    reading.enter()
+    DispatchQueue.global(qos: .userInitiated).async {
+        data = outputPipe.fileHandleForReading.readDataToEndOfFile()
+        reading.leave()
+    }
+    let savedStdin = thread_stdin
+    let savedStdout = thread_stdout
+    let savedStderr = thread_stderr
+    thread_stdin = input_file
+    thread_stdout = output_file
+    thread_stderr = output_file
+    ios_setStreams(input_file, output_file, output_file)
+    let pid = ios_fork()
+    _ = ios_system(command)
+    fflush(output_file)
+    ios_waitpid(pid)
+    ios_releaseThreadId(pid)
+    thread_stdin = savedStdin
+    thread_stdout = savedStdout
+    thread_stderr = savedStderr
+    ios_setStreams(savedStdin, savedStdout, savedStderr)
+    fclose(output_file) // closes the last write end of the pipe, so the reader gets to the end
+    fclose(input_file)
+    reading.wait()
+    return String(decoding: data, as: UTF8.self)
+}
+
+// watch: runs the command repeatedly and shows its output full screen, on the alternate screen.
+// Output is captured, cut to the screen size and compared with the previous run: only the lines
+// that changed are sent to the terminal, starting from the first character that changed.
+// Runs are scheduled on a fixed grid: if one takes longer than the interval, the missed runs are
+// skipped instead of piling up. Waiting is done by polling the keyboard, so "q" or control-C stop
+// watch immediately (it is in the list of interactive commands in script.js).
+@_cdecl("watch_command")
+public func watch_command(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
+    guard let args = convertCArguments(argc: argc, argv: argv) else { return 1 }
+    let usageString = "usage: watch [-n seconds] [-t] [-c] command\n    Executes \"command\" every \"seconds\" (default 2, minimum 0.1, maximum 86400) and shows its output full screen.\n    -t: no title line. -c: keep colors. Press q or control-C to stop.\n"
+    var interval = 2.0
+    var showTitle = true
+    var color = false
+    var index = 1
+    while (index < args.count) && args[index].hasPrefix("-") {
+        let option = args[index]
+        if (option == "-n") || (option == "--interval") {
+            // Double() also accepts "nan" and "inf":
+            guard (index + 1 < args.count), let value = Double(args[index + 1]), value.isFinite else {
+                fputs("watch: unable to convert argument to time interval.\n", thread_stderr)
+                fputs(usageString, thread_stderr)
+                return -1
+            }
+            interval = min(max(value, 0.1), 86400)
+            index += 2
+            continue
+        } else if (option == "-t") || (option == "--no-title") {
+            showTitle = false
+        } else if (option == "-c") || (option == "--color") {
+            color = true
+        } else {
+            fputs(usageString, (option == "-h") || (option == "--help") ? thread_stdout : thread_stderr)
+            return (option == "-h") || (option == "--help") ? 0 : -1
+        }
+        index += 1
+    }
+    if (index >= args.count) {
+        fputs(usageString, thread_stderr)
+        return -1
+    }
+    // The command line is built once, and the title only changes with the time.
+    let command = args[index...].joined(separator: " ")
+    let title = "Every \(String(format: "%.1f", interval))s: \(command)"
+    let dateFormatter = DateFormatter()
+    dateFormatter.dateFormat = "HH:mm:ss"
+    let terminal = thread_stdout
+    let keyboard = (thread_stdin != nil) ? fileno(thread_stdin) : -1
+    var previousRows: [String] = []
+    var previousWidth = 0
+    var previousHeight = 0
+    var nextRun = Date().timeIntervalSince1970
+    // alternate screen, hide cursor:
+    fputs("\u{001B}[?1049h\u{001B}[?25l\u{001B}[H\u{001B}[2J", terminal)
+    fflush(terminal)
+    running: while true {
+        let output = captureCommandOutput(command: command)
+        let width = max(currentDelegate?.width ?? 80, 1)
+        let height = max(currentDelegate?.height ?? 24, 1)
+        var rows: [String] = []
+        if (showTitle) {
+            let time = dateFormatter.string(from: Date())
+            let space = max(width - title.count - time.count, 1)
+            rows.append(watchScreenLine(Substring(title + String(repeating: " ", count: space) + time), width: width, color: false))
+            rows.append("")
+        }
+        for line in output.split(separator: "\n", omittingEmptySubsequences: false) {
+            if (rows.count >= height) { break }
+            rows.append(watchScreenLine(line, width: width, color: color))
+        }
+        while (rows.count < height) {
+            rows.append("")
+        }
+        var screen = ""
+        if (width != previousWidth) || (height != previousHeight) {
+            // The terminal was resized: repaint everything.
+            screen += "\u{001B}[H\u{001B}[2J"
+            previousRows = Array(repeating: "", count: height)
+            previousWidth = width
+            previousHeight = height
+        }
+        for row in 0..<height where rows[row] != previousRows[row] {
+            let old = previousRows[row]
+            let new = rows[row]
+            var start = 0
+            if (!color) && (old.utf8.count == old.unicodeScalars.count) && (new.utf8.count == new.unicodeScalars.count) {
+                // ASCII: a character is a column, we can start at the first difference.
+                start = zip(old.utf8, new.utf8).prefix(while: { $0 == $1 }).count
+            }
+            screen += "\u{001B}[\(row + 1);\(start + 1)H"
+            if (color) { screen += "\u{001B}[0m" }
+            screen += String(new.utf8.dropFirst(start))! + "\u{001B}[K"
+        }
+        if (color) { screen += "\u{001B}[0m" }
+        fputs(screen, terminal)
+        fflush(terminal)
+        previousRows = rows
+        // Wait for the next run, skipping the ones we missed, and watch the keyboard meanwhile:
+        let now = Date().timeIntervalSince1970
+        nextRun += interval
+        if (nextRun <= now) {
+            nextRun += (floor((now - nextRun) / interval) + 1) * interval
+        }
+        while true {
+            let delay = nextRun - Date().timeIntervalSince1970
+            if (delay <= 0) { break }
+            if (keyboard < 0) {
+                // usleep() may refuse a second or more:
+                usleep(useconds_t(min(delay, 0.999) * 1000000))
+                continue
+            }
+            var fds = pollfd(fd: keyboard, events: Int16(POLLIN), revents: 0)
+            let ready = poll(&fds, 1, Int32(min(ceil(delay * 1000), Double(Int32.max))))
+            if (ready > 0) {
+                var buffer = [UInt8](repeating: 0, count: 256)
+                let count = read(keyboard, &buffer, buffer.count)
+                if (count <= 0) || buffer[0..<count].contains(where: { $0 == UInt8(ascii: "q") || $0 == 3 || $0 == 4 }) {
+                    break running
+                }
+            } else if (ready < 0) && (errno != EINTR) {
+                break running
+            }
+        }
+    }
+    // show cursor, back to the main screen:
+    fputs("\u{001B}[?25h\u{001B}[?1049l", terminal)
+    fflush(terminal)
+    return 0
+}
+
 public func executeCommandAndWait(command: String) {
     NSLog("executeCommandAndWait: \(command)")
     resultStack.removeAll()
@@ -15,6 +15,7 @@ import Combine
 import AVKit // for media playback
 import AVFoundation // for media playback
 import TipKit // for helpful tips
+import SQLite3 // for command history
 
 var inputFileURLBackup: URL?
 
@@ -25,7 +26,6 @@ let factoryFontLigature = "contextual" // normal has a bug, so contextual by def
 var stdinString: String = ""
 var lastKey: Character?
 var lastKeyTime: Date = Date(timeIntervalSinceNow: 0)
-var directoriesUsed: [String:Int] = [:]
 
 // Experimental: execute JS & webAssembly commands in reverse order, so they can be piped.
 struct javascriptCommand {
@@ -37,8 +37,767 @@ struct javascriptCommand {
     var originalCommand: String = ""
 }
 
+// The context of the window that made its session current with switchToSession(), nil after
+// a switch to any other session. Counters for diagnostics (logged when a window goes to the background).
+var currentSessionContext: UnsafeMutablePointer<CChar>? = nil
+var sessionSwitches = 0
+var sessionSwitchesSkipped = 0
+
+// For sessions that don't belong to a window (installation, clean-up...):
+func switchToSession(named name: String) {
+    currentSessionContext = nil
+    ios_switchSession(name)
+}
+
 var commandsStack: [javascriptCommand?] = []
 var resultStack: [Int32?] = []
+
+// Command history, shared by all windows and kept across launches.
+// Each command executed is appended with its time, directory and exit status; nothing is
+// ever rewritten, so there is no limit on the number of commands kept. The per-window
+// history used by the arrow keys only keeps the last historyLimit commands.
+// Ctrl-R in script.js asks for the entries added since its last request, aggregated by
+// command (number of uses, failures, last use) to rank them by frecency.
+class HistoryDatabase {
+    static let shared = HistoryDatabase()
+    static let historyLimit = 1000
+    private var db: OpaquePointer? = nil
+    // All access to the database goes through this queue:
+    private let queue = DispatchQueue(label: "AsheKube.a-Shell.history", qos: .utility)
+    private let transient = unsafeBitCast(-1, to: sqlite3_destructor_type.self)
+
+    private init() {
+        queue.async { self.open() }
+    }
+
+    // must be called on queue:
+    private func execute(_ sql: String) {
+        if (sqlite3_exec(db, sql, nil, nil, nil) != SQLITE_OK) {
+            NSLog("History database error: \(String(cString: sqlite3_errmsg(db))) in \(sql)")
+        }
+    }
+
+    // must be called on queue:
+    private func prepare(_ sql: String) -> OpaquePointer? {
+        var statement: OpaquePointer? = nil
+        if (sqlite3_prepare_v2(db, sql, -1, &statement, nil) != SQLITE_OK) {
+            NSLog("History database error: \(String(cString: sqlite3_errmsg(db))) in \(sql)")
+            return nil
+        }
+        return statement
+    }
+
+    // must be called on queue:
+    private func insert(command: String, directory: String?, time: Double) -> Int64 {
+        guard let statement = prepare("INSERT INTO history (command, cwd, time) VALUES (?, ?, ?)") else { return 0 }
+        defer { sqlite3_finalize(statement) }
+        sqlite3_bind_text(statement, 1, command, -1, transient)
+        if let directory = directory {
+            sqlite3_bind_text(statement, 2, directory, -1, transient)
+        }
+        sqlite3_bind_double(statement, 3, time)
+        if (sqlite3_step(statement) != SQLITE_DONE) {
+            return 0
+        }
+        return sqlite3_last_insert_rowid(db)
+    }
+
+    private func open() {
+        let libraryURL = try! FileManager().url(for: .libraryDirectory,
+                                                in: .userDomainMask,
+                                                appropriateFor: nil,
+                                                create: true)
+        let path = libraryURL.appendingPathComponent("history.sqlite").path
+        if (sqlite3_open(path, &db) != SQLITE_OK) {
+            NSLog("Could not open history database at \(path)")
+            sqlite3_close(db)
+            db = nil
+            return
+        }
+        execute("PRAGMA journal_mode = WAL")
+        execute("PRAGMA synchronous = NORMAL")
+        execute("CREATE TABLE IF NOT EXISTS history (id INTEGER PRIMARY KEY, command TEXT NOT NULL, cwd TEXT, time REAL NOT NULL, status INTEGER)")
+        execute("CREATE INDEX IF NOT EXISTS history_command ON history (command)")
+        // Earlier versions kept the last 100 commands in the UserDefaults. Import them once:
+        if let oldHistory = UserDefaults.standard.array(forKey: "history") as? [String] {
+            let now = Date().timeIntervalSince1970
+            execute("BEGIN")
+            for (index, command) in oldHistory.enumerated() {
+                _ = insert(command: command, directory: nil, time: now - Double(oldHistory.count - index))
+            }
+            execute("COMMIT")
+            UserDefaults.standard.removeObject(forKey: "history")
+        }
+    }
+
+    // The insert is done in the background, so that saving a command never delays running it.
+    // append() returns a handle instead of the row id: setStatus() is queued behind the insert
+    // and finds the row id in rowIds.
+    private let handleLock = NSLock()
+    private var lastHandle: Int64 = 0
+    private var rowIds: [Int64: Int64] = [:] // handle -> row id, must be accessed on queue
+    private static let maxPendingStatus = 64
+
+    // Returns a handle for the new entry, used to store its exit status later.
+    func append(command: String, directory: String) -> Int64 {
+        let time = Date().timeIntervalSince1970
+        handleLock.lock()
+        lastHandle += 1
+        let handle = lastHandle
+        handleLock.unlock()
+        queue.async {
+            if (self.db == nil) { return }
+            let id = self.insert(command: command, directory: directory, time: time)
+            if (id > 0) {
+                self.rowIds[handle] = id
+            }
+            // Commands that never report a status (e.g. newWindow) must not accumulate:
+            if (self.rowIds.count > HistoryDatabase.maxPendingStatus) {
+                self.rowIds = self.rowIds.filter { $0.key > handle - Int64(HistoryDatabase.maxPendingStatus) }
+            }
+        }
+        return handle
+    }
+
+    func setStatus(_ status: Int32, id handle: Int64) {
+        if (handle <= 0) { return }
+        queue.async {
+            guard let id = self.rowIds.removeValue(forKey: handle),
+                  let statement = self.prepare("UPDATE history SET status = ? WHERE id = ?") else { return }
+            sqlite3_bind_int(statement, 1, status)
+            sqlite3_bind_int64(statement, 2, id)
+            sqlite3_step(statement)
+            sqlite3_finalize(statement)
+        }
+    }
+
+    // The last commands executed in all windows, oldest first, without consecutive duplicates.
+    func recentCommands() -> [String] {
+        return queue.sync {
+            var commands: [String] = []
+            guard let statement = prepare("SELECT command FROM history ORDER BY id DESC LIMIT ?") else { return commands }
+            defer { sqlite3_finalize(statement) }
+            sqlite3_bind_int(statement, 1, Int32(HistoryDatabase.historyLimit))
+            while (sqlite3_step(statement) == SQLITE_ROW) {
+                let command = String(cString: sqlite3_column_text(statement, 0)!)
+                if (commands.last != command) {
+                    commands.append(command)
+                }
+            }
+            return commands.reversed()
+        }
+    }
+
+    // Entries with an identifier larger than id, one line per command:
+    // last id, last use (seconds since 1970), number of uses, number of failures, command.
+    func searchEntries(after id: Int64, completion: @escaping (String) -> Void) {
+        queue.async {
+            var lines: [String] = []
+            if let statement = self.prepare("SELECT MAX(id), MAX(time), COUNT(*), SUM(status IS NOT NULL AND status != 0), command FROM history WHERE id > ? GROUP BY command") {
+                sqlite3_bind_int64(statement, 1, id)
+                while (sqlite3_step(statement) == SQLITE_ROW) {
+                    let command = String(cString: sqlite3_column_text(statement, 4)!)
+                    lines.append("\(sqlite3_column_int64(statement, 0))\t\(Int64(sqlite3_column_double(statement, 1)))\t\(sqlite3_column_int(statement, 2))\t\(sqlite3_column_int(statement, 3))\t" + command)
+                }
+                sqlite3_finalize(statement)
+            }
+            completion(lines.joined(separator: "\n"))
+        }
+    }
+}
+
+// Directory listings for file name autocomplete, one cache per window.
+// A listing holds the sorted names and whether each entry is a directory, from a single
+// enumeration of the directory. It is reused as long as the modification date of the
+// directory is unchanged (creating, deleting or renaming an entry updates it), so a Tab
+// costs one stat instead of one per file. The current directory is listed in advance
+// at each prompt (see printPrompt).
+class DirectoryListingCache {
+    struct Listing {
+        let modificationDate: Date?
+        let names: [String] // sorted
+        let isDirectory: [Bool]
+    }
+    private static let maxDirectories = 16
+    private var listings: [String: Listing] = [:]
+    private var recentDirectories: [String] = [] // most recent last
+    // All access to the listings goes through this queue:
+    private let queue = DispatchQueue(label: "AsheKube.a-Shell.directoryListings", qos: .userInitiated)
+
+    private func modificationDate(path: String) -> Date? {
+        return (try? FileManager().attributesOfItem(atPath: path))?[.modificationDate] as? Date
+    }
+
+    // must be called on queue:
+    private func cachedListing(path: String) throws -> Listing {
+        let date = modificationDate(path: path)
+        if let listing = listings[path], (date != nil) && (listing.modificationDate == date) {
+            if let index = recentDirectories.lastIndex(of: path) {
+                recentDirectories.remove(at: index)
+            }
+            recentDirectories.append(path)
+            return listing
+        }
+        let urls = try FileManager().contentsOfDirectory(at: URL(fileURLWithPath: path),
+                                                         includingPropertiesForKeys: [.isDirectoryKey], options: [])
+        let entries = urls.map { ($0.lastPathComponent, $0.isDirectory) }.sorted(by: { $0.0 < $1.0 })
+        let listing = Listing(modificationDate: date, names: entries.map { $0.0 }, isDirectory: entries.map { $0.1 })
+        if (listings[path] == nil) && (recentDirectories.count >= DirectoryListingCache.maxDirectories) {
+            listings[recentDirectories.removeFirst()] = nil
+        }
+        listings[path] = listing
+        if let index = recentDirectories.lastIndex(of: path) {
+            recentDirectories.remove(at: index)
+        }
+        recentDirectories.append(path)
+        return listing
+    }
+
+    // Relative paths are resolved against the current directory.
+    private func key(path: String) -> String {
+        let url = path.hasPrefix("/") ? URL(fileURLWithPath: path) :
+            URL(fileURLWithPath: FileManager().currentDirectoryPath).appendingPathComponent(path)
+        return url.standardizedFileURL.path
+    }
+
+    func listing(path: String) throws -> Listing {
+        let path = key(path: path)
+        return try queue.sync { try cachedListing(path: path) }
+    }
+
+    // List a directory in the background, so it is ready for the next Tab.
+    func prefetch(path: String) {
+        let path = key(path: path)
+        queue.async { _ = try? self.cachedListing(path: path) }
+    }
+}
+// A query for z and z + Tab: words separated by spaces, that must appear in this order in
+// the path, and "/" that must match a "/" between them ("z doc/py" is "doc.*/.*py").
+// If the query has no upper case letters, the match ignores case (for ASCII letters).
+// Paths are compared as UTF-8 bytes, there is no regular expression to compile.
+struct DirectoryQuery {
+    let bytes: [UInt8] // the query without spaces, for the subsequence test
+    private let segments: [[UInt8]]
+    let caseSensitive: Bool
+
+    // Each word must be found as is, spaces included: the z command passes its arguments.
+    init(words: [String]) {
+        var segments: [[UInt8]] = []
+        for word in words {
+            var segment: [UInt8] = []
+            for c in word.utf8 {
+                if (c == UInt8(ascii: "/")) {
+                    if (segment.count > 0) { segments.append(segment) }
+                    segments.append([c])
+                    segment = []
+                } else {
+                    segment.append(c)
+                }
+            }
+            if (segment.count > 0) { segments.append(segment) }
+        }
+        self.segments = segments
+        bytes = segments.flatMap { $0 }
+        caseSensitive = bytes.contains(where: { $0 >= UInt8(ascii: "A") && $0 <= UInt8(ascii: "Z") })
+    }
+
+    // The words typed after z, for the Tab menu.
+    init(_ query: String) {
+        self.init(words: query.split(separator: " ").map { String($0) })
+    }
+
+    var isEmpty: Bool { return segments.isEmpty }
+
+    @inline(__always) private func fold(_ c: UInt8) -> UInt8 {
+        if (!caseSensitive) && (c >= UInt8(ascii: "A")) && (c <= UInt8(ascii: "Z")) {
+            return c + 32
+        }
+        return c
+    }
+
+    // Is the query a subsequence of the path? Necessary for any match. Adding characters at
+    // the end of the query only removes paths, so the candidates for a query are searched
+    // among those of the previous one.
+    func isCandidate(_ path: [UInt8]) -> Bool {
+        var i = 0
+        for c in path {
+            if (i == bytes.count) { break }
+            if (fold(c) == fold(bytes[i])) { i += 1 }
+        }
+        return i == bytes.count
+    }
+
+    private func matches(_ path: [UInt8], _ segment: [UInt8], at position: Int) -> Bool {
+        for j in 0..<segment.count {
+            if (fold(path[position + j]) != fold(segment[j])) { return false }
+        }
+        return true
+    }
+
+    // How well the path matches: nil if the segments are not found in order, 1 if they are,
+    // more if the last segment is in the last path component, starts it or is all of it.
+    func score(_ path: [UInt8]) -> Double? {
+        if (segments.isEmpty) { return nil }
+        var position = 0
+        for segment in segments.dropLast() {
+            var found = false
+            while (position + segment.count <= path.count) {
+                if matches(path, segment, at: position) {
+                    found = true
+                    break
+                }
+                position += 1
+            }
+            if (!found) { return nil }
+            position += segment.count
+        }
+        // The last segment: take the last occurrence, the one closest to the last component.
+        let last = segments[segments.count - 1]
+        var start = path.count - last.count
+        while (start >= position) && !matches(path, last, at: start) {
+            start -= 1
+        }
+        if (start < position) { return nil }
+        let end = start + last.count
+        if (path[end...].contains(UInt8(ascii: "/"))) { return 1 }
+        var score = 4.0
+        if (start == 0) || (path[start - 1] == UInt8(ascii: "/")) {
+            score *= 2
+            if (end == path.count) { score *= 2 }
+        }
+        return score
+    }
+}
+
+// Directories visited with cd, shared by all windows, for z and the Tab menu after cd and z.
+// Directories are ranked by "frecency", as in z: each visit adds 1 to the rank, and the rank is
+// weighted by the time since the last visit (x4 within the hour, x2 within the day, /2 within
+// the week, /4 after that). When the sum of ranks goes over maxTotalRank, all ranks are aged
+// and directories whose rank falls under 1 are forgotten. The index also never keeps more than
+// maxDirectories entries. Paths are in their compact form (~bookmark/...), as cd stores them.
+// The index is read from the UserDefaults on first use, and saved when a window goes to the
+// background, only if it changed.
+class DirectoryIndex {
+    static let shared = DirectoryIndex()
+    private static let maxTotalRank = 9000.0
+    private static let maxDirectories = 2000
+    private static let storageKey = "directoryIndex"
+    private static let oldStorageKey = "directoriesUsed" // [String:Int], number of visits
+
+    private var paths: [String] = []
+    private var bytes: [[UInt8]] = []
+    private var ranks: [Double] = []
+    private var lastVisits: [Double] = []
+    private var positions: [String: Int] = [:]
+    private var totalRank = 0.0
+    private var loaded = false
+    private var changed = false
+    // The last query and the directories that can match it, reset when directories are added or removed:
+    private var lastQuery: [UInt8] = []
+    private var lastCandidates: [Int]? = nil
+    // All access to the index goes through this queue:
+    private let queue = DispatchQueue(label: "AsheKube.a-Shell.directoryIndex", qos: .userInitiated)
+
+    // must be called on queue:
+    private func append(path: String, rank: Double, lastVisit: Double) {
+        positions[path] = paths.count
+        paths.append(path)
+        bytes.append(Array(path.utf8))
+        ranks.append(rank)
+        lastVisits.append(lastVisit)
+        totalRank += rank
+        lastCandidates = nil
+    }
+
+    // must be called on queue:
+    private func remove(at index: Int) {
+        totalRank -= ranks[index]
+        positions[paths[index]] = nil
+        let last = paths.count - 1
+        if (index != last) {
+            paths[index] = paths[last]
+            bytes[index] = bytes[last]
+            ranks[index] = ranks[last]
+            lastVisits[index] = lastVisits[last]
+            positions[paths[index]] = index
+        }
+        paths.removeLast()
+        bytes.removeLast()
+        ranks.removeLast()
+        lastVisits.removeLast()
+        lastCandidates = nil
+    }
+
+    // must be called on queue:
+    private func loadIfNeeded() {
+        if (loaded) { return }
+        loaded = true
+        if let stored = UserDefaults.standard.dictionary(forKey: DirectoryIndex.storageKey) as? [String: [Double]] {
+            for (path, values) in stored where values.count == 2 {
+                append(path: path, rank: values[0], lastVisit: values[1])
+            }
+        } else if let oldDirectories = UserDefaults.standard.dictionary(forKey: DirectoryIndex.oldStorageKey) as? [String: Int] {
+            // Earlier versions only counted visits (starting at 0). Import them once:
+            let now = Date().timeIntervalSince1970
+            for (path, count) in oldDirectories {
+                append(path: path, rank: Double(count + 1), lastVisit: now)
+            }
+            changed = true
+            ageIfNeeded()
+        }
+    }
+
+    // must be called on queue:
+    private func frecency(_ index: Int, now: Double) -> Double {
+        let age = now - lastVisits[index]
+        if (age < 3600) { return ranks[index] * 4 }
+        if (age < 86400) { return ranks[index] * 2 }
+        if (age < 604800) { return ranks[index] / 2 }
+        return ranks[index] / 4
+    }
+
+    // must be called on queue:
+    private func ageIfNeeded() {
+        if (totalRank > DirectoryIndex.maxTotalRank) {
+            totalRank = 0
+            for i in 0..<ranks.count {
+                ranks[i] *= 0.9
+                totalRank += ranks[i]
+            }
+            for i in stride(from: ranks.count - 1, through: 0, by: -1) where ranks[i] < 1 {
+                remove(at: i)
+            }
+        }
+        if (paths.count > DirectoryIndex.maxDirectories) {
+            // Keep 90% of the maximum, so this doesn't happen at every new directory:
+            let now = Date().timeIntervalSince1970
+            let sorted = (0..<paths.count).sorted(by: { frecency($0, now: now) < frecency($1, now: now) })
+            let removed = sorted.prefix(paths.count - DirectoryIndex.maxDirectories * 9 / 10).map { paths[$0] }
+            for path in removed {
+                remove(at: positions[path]!)
+            }
+        }
+    }
+
+    func visit(_ path: String) {
+        let now = Date().timeIntervalSince1970
+        queue.sync {
+            loadIfNeeded()
+            if let index = positions[path] {
+                ranks[index] += 1
+                lastVisits[index] = now
+                totalRank += 1
+            } else {
+                append(path: path, rank: 1, lastVisit: now)
+            }
+            changed = true
+            ageIfNeeded()
+        }
+    }
+
+    func remove(_ path: String) {
+        queue.sync {
+            loadIfNeeded()
+            if let index = positions[path] {
+                remove(at: index)
+                changed = true
+            }
+        }
+    }
+
+    func removeAll() {
+        queue.sync {
+            loaded = true
+            paths = []
+            bytes = []
+            ranks = []
+            lastVisits = []
+            positions = [:]
+            totalRank = 0
+            lastCandidates = nil
+            changed = true
+        }
+    }
+
+    // The frecency of each path, nil for directories never visited.
+    func frecencies(_ paths: [String]) -> [Double?] {
+        let now = Date().timeIntervalSince1970
+        return queue.sync {
+            loadIfNeeded()
+            return paths.map { path in positions[path].map { frecency($0, now: now) } }
+        }
+    }
+
+    // The directories that match the query, best first: frecency multiplied by the match score.
+    func matches(_ query: DirectoryQuery, limit: Int = 100) -> [String] {
+        if (query.isEmpty) { return [] }
+        let now = Date().timeIntervalSince1970
+        return queue.sync {
+            loadIfNeeded()
+            let candidates: [Int]
+            if let lastCandidates = lastCandidates, query.bytes.starts(with: lastQuery) {
+                candidates = lastCandidates.filter { query.isCandidate(bytes[$0]) }
+            } else {
+                candidates = (0..<paths.count).filter { query.isCandidate(bytes[$0]) }
+            }
+            lastQuery = query.bytes
+            lastCandidates = candidates
+            var scored: [(Int, Double)] = []
+            for index in candidates {
+                if let score = query.score(bytes[index]) {
+                    scored.append((index, score * frecency(index, now: now)))
+                }
+            }
+            scored.sort(by: { ($0.1 > $1.1) || (($0.1 == $1.1) && (paths[$0.0] < paths[$1.0])) })
+            return scored.prefix(limit).map { paths[$0.0] }
+        }
+    }
+
+    // Store the index in the UserDefaults if it changed, away from the main thread.
+    func save() {
+        queue.async {
+            if (!self.changed) { return }
+            self.changed = false
+            var stored: [String: [Double]] = [:]
+            for i in 0..<self.paths.count {
+                stored[self.paths[i]] = [self.ranks[i], self.lastVisits[i]]
+            }
+            DispatchQueue.global(qos: .utility).async {
+                UserDefaults.standard.set(stored, forKey: DirectoryIndex.storageKey)
+                UserDefaults.standard.removeObject(forKey: DirectoryIndex.oldStorageKey)
+            }
+        }
+    }
+}
+
+// PS1 (bash syntax), compiled once into a list of segments. Documentation from:
+// https://www.cyberciti.biz/tips/howto-linux-unix-bash-shell-setup-prompt.html
+// Escapes that can't change between two prompts (host name, version, octal characters...) are
+// expanded when compiling. The others keep their value until it can change: the directory
+// until the current directory changes, the time until the next second or minute, depending
+// on the format, the history number until a command is added.
+// The result is the content of a JavaScript string between single quotes: text from PS1 is
+// kept as is (so \n or \x1b work), values such as the directory are escaped once, when they change.
+final class PromptTemplate {
+    private enum Segment {
+        case text
+        case clock(format: String, seconds: Bool) // DateFormatter format
+        case strftime(format: String)
+        case directory(basename: Bool)
+        case historyNumber
+    }
+    let source: String
+    private var segments: [Segment] = []
+    private var values: [String] = []
+    private var validUntil: [Double] = []
+    private var formatters: [String: DateFormatter] = [:]
+    private var usesDirectory = false
+    private var usesHistory = false
+    private var lastDirectory: String? = nil
+    private var lastHistoryCount = -1
+    private var lastPrompt: String? = nil
+
+    // Escape a value for a JavaScript string between single quotes:
+    static func javascriptLiteral(_ string: String) -> String {
+        return string.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "'", with: "\\'").replacingOccurrences(of: "\n", with: "\\n").replacingOccurrences(of: "\r", with: "\\r")
+    }
+
+    private func append(text: String) {
+        if (text.isEmpty) { return }
+        if let last = segments.last, case .text = last {
+            values[values.count - 1] += text
+            return
+        }
+        append(.text, value: text)
+    }
+
+    private func append(_ segment: Segment, value: String = "") {
+        segments.append(segment)
+        values.append(value)
+        validUntil.append(0)
+    }
+
+    private static func userName() -> String {
+        for variable in ["USERNAME", "USER", "LOGNAME"] {
+            if let username = ios_getenv(variable) {
+                return String(utf8String: username) ?? "mobile"
+            }
+        }
+        if let pw = getpwuid((getuid())) {
+            if let username = pw.pointee.pw_name {
+                return String(utf8String: username) ?? "mobile"
+            }
+        }
+        return "mobile"
+    }
+
+    init(_ prompt: String) {
+        source = prompt
+        let scalars = Array(prompt.unicodeScalars)
+        var text = String.UnicodeScalarView()
+        var i = 0
+        while (i < scalars.count) {
+            let c = scalars[i]
+            if (c != "\\") || (i + 1 == scalars.count) {
+                // Quotes and line breaks would end the JavaScript string:
+                if (c == "'") || (c == "\n") || (c == "\r") {
+                    text.append(contentsOf: PromptTemplate.javascriptLiteral(String(c)).unicodeScalars)
+                } else {
+                    text.append(c)
+                }
+                i += 1
+                continue
+            }
+            let code = scalars[i + 1]
+            i += 2
+            var value: String? = nil
+            var segment: Segment? = nil
+            switch (code) {
+            case "a": // ASCII bell character (07)
+                value = "\u{0007}"
+            case "A": // current time in 24-hour HH:MM format
+                segment = .clock(format: "HH:mm", seconds: false)
+            case "d": // the date in “Weekday Month Date” format (e.g., “Tue May 26”)
+                segment = .clock(format: "E MMM d", seconds: false)
+            case "D": // \D{format} : the format is passed to strftime(3). The braces are required
+                if (i < scalars.count) && (scalars[i] == "{"), let end = scalars[i...].firstIndex(of: "}") {
+                    var format = String.UnicodeScalarView()
+                    format.append(contentsOf: scalars[(i + 1)..<end])
+                    segment = .strftime(format: String(format))
+                    i = end + 1
+                } else {
+                    value = "\\D"
+                }
+            case "e": // escape character
+                value = "\u{001B}"
+            case "h", "H": // the hostname up to the first ‘.’ or the hostname
+                // No easy access to hostname, we print the device name:
+                value = PromptTemplate.javascriptLiteral(UIDevice.current.name)
+            case "j": // the number of jobs currently managed by the shell
+                value = "0" // no job management
+            case "l": // the basename of the shell's terminal device name
+                value = PromptTemplate.javascriptLiteral(UIDevice.current.localizedModel)
+            case "s": // the name of the shell, the basename of $0 (the portion following the final slash)
+                value = (Bundle.main.infoDictionary?["CFBundleName"] as? String) ?? "a-Shell"
+            case "t": // the current time in 24-hour HH:MM:SS format
+                segment = .clock(format: "HH:mm:ss", seconds: true)
+            case "T": // the current time in 12-hour HH:MM:SS format
+                segment = .clock(format: "h:mm:ss", seconds: true)
+            case "@": // the current time in 12-hour am/pm format
+                segment = .clock(format: "h:mm a", seconds: false)
+            case "u": // username
+                value = PromptTemplate.javascriptLiteral(PromptTemplate.userName())
+            case "v": //  the version of bash (e.g., 2.00)
+                value = (Bundle.main.infoDictionary?["CFBundleShortVersionString"] as? String) ?? ""
+            case "V": // the release of bash, version + patch level (e.g., 2.00.0)
+                value = ""
+                if let currentVersion = Bundle.main.infoDictionary?["CFBundleShortVersionString"] as? String {
+                    value = currentVersion
+                    if let currentBuild = Bundle.main.infoDictionary?["CFBundleVersion"] as? String {
+                        value! += " " + currentBuild
+                    }
+                }
+            case "w": // the current working directory, with $HOME abbreviated with a tilde
+                segment = .directory(basename: false)
+            case "W": // the basename of the current working directory, with $HOME abbreviated with a tilde
+                segment = .directory(basename: true)
+            case "!", "#": //  the history number of this command or the command number of this command
+                segment = .historyNumber
+            case "$": // if the effective UID is 0, a #, otherwise a $
+                value = "$"
+            case "[", "]": // supposed to encase zero-length characters. Not needed for a-Shell.
+                value = ""
+            case "0", "1", "2", "3", "4", "5", "6", "7": // \nnn: the character with octal code nnn
+                var code = 0
+                var digits = 0
+                i -= 1
+                while (i < scalars.count) && (digits < 3) && (scalars[i] >= "0") && (scalars[i] <= "7") {
+                    code = code * 8 + Int(scalars[i].value - 48)
+                    i += 1
+                    digits += 1
+                }
+                value = PromptTemplate.javascriptLiteral(String(UnicodeScalar(UInt8(code & 0xff))))
+            default: // \n, \r, \\ and JavaScript escapes: kept as they are
+                value = "\\" + String(code)
+            }
+            if let value = value {
+                text.append(contentsOf: value.unicodeScalars)
+            } else if let segment = segment {
+                append(text: String(text))
+                text = String.UnicodeScalarView()
+                append(segment)
+                if case .directory = segment { usesDirectory = true }
+                if case .historyNumber = segment { usesHistory = true }
+            }
+        }
+        append(text: String(text))
+    }
+
+    private func formatter(_ format: String) -> DateFormatter {
+        if let formatter = formatters[format] {
+            return formatter
+        }
+        let formatter = DateFormatter()
+        formatter.dateFormat = format
+        formatters[format] = formatter
+        return formatter
+    }
+
+    func render(historyCount: () -> Int) -> String {
+        let now = Date().timeIntervalSince1970
+        var changed = (lastPrompt == nil)
+        var directory: String? = nil
+        if (usesDirectory) {
+            let currentDirectory = FileManager().currentDirectoryPath
+            if (currentDirectory != lastDirectory) {
+                lastDirectory = currentDirectory
+                directory = String(cString: ios_getBookmarkedVersion(currentDirectory.utf8CString))
+            }
+        }
+        var count = lastHistoryCount
+        if (usesHistory) {
+            count = historyCount()
+        }
+        for i in 0..<segments.count {
+            switch (segments[i]) {
+            case .text:
+                continue
+            case .clock(let format, let seconds):
+                if (now < validUntil[i]) { continue }
+                values[i] = PromptTemplate.javascriptLiteral(formatter(format).string(from: Date(timeIntervalSince1970: now)))
+                validUntil[i] = seconds ? floor(now) + 1 : floor(now / 60) * 60 + 60
+            case .strftime(let format):
+                if (now < validUntil[i]) { continue }
+                let maxSize = 256
+                var buffer: [CChar] = [CChar](repeating: 0, count: maxSize)
+                var time: time_t = Int(now)
+                _ = strftime(&buffer, maxSize, format, localtime(&time))
+                values[i] = PromptTemplate.javascriptLiteral(String(cString: buffer))
+                validUntil[i] = floor(now) + 1
+            case .directory(let basename):
+                guard let path = directory else { continue }
+                let pathComponents = path.split(separator: "/")
+                if (basename) && (pathComponents.count > 1) {
+                    values[i] = PromptTemplate.javascriptLiteral(String(pathComponents[pathComponents.endIndex - 1]))
+                } else {
+                    values[i] = PromptTemplate.javascriptLiteral(path)
+                }
+            case .historyNumber:
+                if (count == lastHistoryCount) { continue }
+                values[i] = String(count)
+            }
+            changed = true
+        }
+        lastHistoryCount = count
+        if (!changed), let lastPrompt = lastPrompt {
+            return lastPrompt
+        }
+        let prompt = values.joined()
+        lastPrompt = prompt
+        return prompt
+    }
+}
+
 // Tips:
 @available(iOS 17, *)
 let myToolbarTip = toolbarTip()
@@ -53,16 +812,29 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
     var wasmWebView: WKWebView? // webView for executing wasm
     var contentView: ContentView?
     var history: [String] = []
+    private var historyNotLoaded = false // restored from the history database on first use
+    let directoryListings = DirectoryListingCache() // for file name autocomplete
     var width = 80
     var height = 80
     var stdout_active = false
     var stdout_button_active = false
     var persistentIdentifier: String? = nil
+    // persistentIdentifier as a C string, allocated once: it is the name of the ios_system session
+    // for this window and its context (ios_setContext keeps the pointer). See switchToSession().
+    private(set) var sessionContext: UnsafeMutablePointer<CChar>? = nil
     var stdin_file: UnsafeMutablePointer<FILE>? = nil
     var stdin_file_input: FileHandle? = nil
     var stdout_file: UnsafeMutablePointer<FILE>? = nil
     var tty_file: UnsafeMutablePointer<FILE>? = nil
     var tty_file_input: FileHandle? = nil
+    // Keyboard input for the running command is delivered in batches: messages received before
+    // the main queue gets to flushInput() are sent together, with a single session switch.
+    // Writes to stdin happen on stdinQueue, so a large paste doesn't block the main thread.
+    private var pendingInput = Data()
+    private var pendingTTYInput = ""
+    private var pendingWasmInput = ""
+    private var inputFlushScheduled = false
+    private let stdinQueue = DispatchQueue(label: "AsheKube.a-Shell.stdin", qos: .userInteractive)
     // copies of thread_std*, used when inside a sub-thread, for example executing webAssembly
     var thread_stdin_copy: UnsafeMutablePointer<FILE>? = nil
     var thread_stdout_copy: UnsafeMutablePointer<FILE>? = nil
@@ -90,7 +862,6 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
     var currentCommand = ""
     var shortcutCommandReceived: String? = nil
     var windowPrintedContent = ""
-    var windowHistory = ""
     var pid: pid_t = 0
     private var selectedDirectory = ""
     private var selectedFont = ""
@@ -125,6 +896,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
     var fontPicker = UIFontPickerViewController()
     var navigationType: WKNavigationType = .other
     var lastUsedPrompt = "$"
+    var promptTemplate: PromptTemplate? = nil // PS1, compiled (see parsePrompt)
     // for when a webAssembly command returns:
     var currentDispatchGroup: DispatchGroup? = nil
     var errorCode:Int32 = 0
@@ -1127,178 +1899,29 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
     }()
     
     func parsePrompt() -> String {
-        // Documentation from: https://www.cyberciti.biz/tips/howto-linux-unix-bash-shell-setup-prompt.html
-        // Not implemented: \nnn (octal char), \[ \] (non-printing characters)
         // - get PS1 from environment:
         guard let promptC = getenv("PS1") else {
             return "$ "
         }
-        guard let prompt = String(utf8String: promptC) else {
-            return "$ "
-        }
-        // - parse PS1 (bash syntax) using a regexp:
-        do {
-            let regex = try NSRegularExpression(pattern: #"\\[]adDehHjlnrstT@AuvVwW!#$\[]"#, options: [])
-            let matches = regex.matches(in: prompt, range: NSRange(prompt.startIndex..<prompt.endIndex, in: prompt))
-            var offset = 0
-            var newPrompt = ""
-            for match in matches {
-                var range = match.range
-                newPrompt += prompt[prompt.index(prompt.startIndex, offsetBy:offset)..<prompt.index(prompt.startIndex, offsetBy: range.lowerBound)]
-                let subString = prompt[prompt.index(prompt.startIndex, offsetBy:range.lowerBound)..<prompt.index(prompt.startIndex, offsetBy: range.upperBound)]
-                // NSLog("Found: \(subString)")
-                switch (subString) {
-                    //aAdDehHjlnrstTuvVwW@! # $ [ ]
-                case "\\a": // ASCII bell character (07)
-                    newPrompt += "\u{0007}"
-                    break
-                case "\\A": // current time in 24-hour HH:MM format
-                    let format = DateFormatter()
-                    format.dateFormat = "HH:mm"
-                    newPrompt += format.string(from: Date())
-                    break
-                case "\\d": // the date in “Weekday Month Date” format (e.g., “Tue May 26”)
-                    let format = DateFormatter()
-                    format.dateFormat = "E MMM d"
-                    newPrompt += format.string(from: Date())
-                    break
-                case "\\D": // \D{format} : the format is passed to strftime(3) and the result is inserted into the prompt string; an empty format results in a locale-specific time representation. The braces are required
-                    var formatStringParse = prompt[prompt.index(prompt.startIndex, offsetBy:range.upperBound)..<prompt.endIndex]
-                    if (formatStringParse.hasPrefix("{")) {
-                        formatStringParse.removeFirst()
-                        if let formatString = formatStringParse.split(separator: "}").first {
-                            let maxSize: UInt = 256
-                            var buffer: [CChar] = [CChar](repeating: 0, count: Int(maxSize))
-                            var time: time_t = Int(NSDate().timeIntervalSince1970)
-                            _ = strftime(&buffer, Int(maxSize), String(formatString).toCString(), localtime(&time))
-                            newPrompt += String(cString: buffer)
-                            // Advance to after "}":
-                            range = NSRange(prompt.range(of: "}", options: [], range: (prompt.index(prompt.startIndex, offsetBy:range.upperBound)..<prompt.endIndex))!, in: prompt)
-                        }
-                    }
-                    break
-                case "\\e": // escape character
-                    newPrompt += escape
-                    break
-                    // hHjlnrstTuvVwW@! # $
-                case "\\h", "\\H": // the hostname up to the first ‘.’ or the hostname
-                    // No easy access to hostname, we print the device name:
-                    newPrompt += UIDevice.current.name
-                    break
-                case "\\j": // the number of jobs currently managed by the shell
-                    newPrompt += "0" // no job management
-                    break
-                case "\\l": // the basename of the shell's terminal device name
-                    newPrompt += UIDevice.current.localizedModel
-                    break
-                case "\\n", "\\r": // newline, carriage return
-                    newPrompt += subString
-                    break
-                case "\\s": // the name of the shell, the basename of $0 (the portion following the final slash)
-                    if let appName = Bundle.main.infoDictionary?["CFBundleName"] as? String {
-                        newPrompt += appName
-                    } else {
-                        newPrompt += "a-Shell"
-                    }
-                    break
-                case "\\t": // the current time in 24-hour HH:MM:SS format
-                    let format = DateFormatter()
-                    format.dateFormat = "HH:mm:ss"
-                    newPrompt += format.string(from: Date())
-                    break
-                case "\\T": // the current time in 12-hour HH:MM:SS format
-                    let format = DateFormatter()
-                    format.dateFormat = "h:mm:ss"
-                    newPrompt += format.string(from: Date())
-                    break
-                case "\\u": // username
-                    if let username = ios_getenv("USERNAME") {
-                        newPrompt += String(utf8String: username) ?? "mobile"
-                        break;
-                    }
-                    if let username = ios_getenv("USER") {
-                        newPrompt += String(utf8String: username) ?? "mobile"
-                        break;
-                    }
-                    if let username = ios_getenv("LOGNAME") {
-                        newPrompt += String(utf8String: username) ?? "mobile"
-                        break;
-                    }
-                    if let pw = getpwuid((getuid())) {
-                        if let username = pw.pointee.pw_name {
-                            newPrompt += String(utf8String: username) ?? "mobile"
-                            break;
-                        }
-                    }
-                    newPrompt += "mobile"
-                    break;
-                case "\\v": //  the version of bash (e.g., 2.00)
-                    if let currentVersion = Bundle.main.infoDictionary?["CFBundleShortVersionString"] as? String {
-                        newPrompt += currentVersion
-                    }
-                    break
-                case "\\V": // the release of bash, version + patch level (e.g., 2.00.0)
-                    if let currentVersion = Bundle.main.infoDictionary?["CFBundleShortVersionString"] as? String {
-                        newPrompt += currentVersion
-                        if let currentBuild = Bundle.main.infoDictionary?["CFBundleVersion"] as? String {
-                            newPrompt += " " + currentBuild
-                        }
-                    }
-                    break
-                case "\\w": // the current working directory, with $HOME abbreviated with a tilde
-                    let currentDirectory = FileManager().currentDirectoryPath
-                    let path = String(cString: ios_getBookmarkedVersion(currentDirectory.utf8CString))
-                    newPrompt += path
-                    break
-                case "\\W": // the basename of the current working directory, with $HOME abbreviated with a tilde
-                    let currentDirectory = FileManager().currentDirectoryPath
-                    let path = String(cString: ios_getBookmarkedVersion(currentDirectory.utf8CString))
-                    let pathComponents = path.split(separator: "/")
-                    if (pathComponents.count > 1) {
-                        newPrompt += pathComponents[pathComponents.endIndex - 1]
-                    } else {
-                        newPrompt += path
-                    }
-                    break
-                case "\\@": // the current time in 12-hour am/pm format
-                    let format = DateFormatter()
-                    format.dateFormat = "h:mm a"
-                    newPrompt += format.string(from: Date())
-                    break
-                case "\\!", "\\#": //  the history number of this command or the command number of this command
-                    newPrompt += String(history.count)
-                    break
-                case "\\$": // if the effective UID is 0, a #, otherwise a $
-                    newPrompt += "$"
-                    break
-                case "\\[", "\\]": // supposed to encase zero-length characters. Not needed for a-Shell.
-                    break
-                case "\\0", "\\1", "\\2", "\\3", "\\4", "\\5", "\\6", "\\7", "\\8", "\\9": // \nnn: unicode character
-                    newPrompt += "\\u\\{"
-                    newPrompt += prompt[prompt.index(prompt.startIndex, offsetBy:range.lowerBound + 1)..<prompt.index(prompt.startIndex, offsetBy: range.upperBound + 2)]
-                    newPrompt += "\\}"
-                    let newRange = prompt.index(prompt.startIndex, offsetBy:range.lowerBound)..<prompt.index(prompt.startIndex, offsetBy: range.upperBound+2)
-                    range = NSRange(newRange, in: prompt)
-                    break
-                default:
-                    newPrompt += subString
-                }
-                offset = range.upperBound
-                // NSLog("Edited prompt: \(newPrompt) offset: \(offset)")
+        // - compile it, only if it changed since the last prompt:
+        if (promptTemplate == nil) || (strcmp(promptC, promptTemplate!.source) != 0) {
+            guard let prompt = String(utf8String: promptC) else {
+                return "$ "
             }
-            newPrompt += prompt[prompt.index(prompt.startIndex, offsetBy:offset)..<prompt.index(prompt.endIndex, offsetBy: 0)]
-            return newPrompt
-        }
-        catch {
-            NSLog("Failed regexp creation")
+            promptTemplate = PromptTemplate(prompt)
         }
-        return "$ "
+        return promptTemplate!.render(historyCount: {
+            loadHistoryIfNeeded()
+            return history.count
+        })
     }
     
     func printPrompt() {
         // - set promptstring in JS
         // - have window.printPrompt() use promptString
         lastUsedPrompt = parsePrompt()
+        // Get ready for file name autocomplete in the current directory:
+        directoryListings.prefetch(path: FileManager().currentDirectoryPath)
         DispatchQueue.main.async {
             self.webView?.evaluateJavaScript("window.commandRunning = ''; window.promptMessage='\(self.lastUsedPrompt)'; window.printPrompt(); window.updatePromptPosition();") { (result, error) in
                 /* if let error = error {
@@ -1311,7 +1934,140 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
         }
     }
     
+    // There seems to be cases where the webassembly command did not terminate properly.
+    // We catch it here:
+    func checkWebAssemblyCommandRunning() {
+        if (!javascriptRunning && executeWebAssemblyCommandsRunning) {
+            wasmWebView?.evaluateJavaScript("commandIsRunning;") { (result, error) in
+                // if let error = error { print(error) }
+                if let result = result as? Bool {
+                    if (!result) {
+                        self.endWebAssemblyCommand(error: 0, message: "")
+                    }
+                }
+            }
+        }
+    }
+
+    // Make the session of this window the current ios_system session, unless it already is.
+    // Messages from the page (keystrokes, listings...) all need it, and usually come from the
+    // window that is already current.
+    func switchToSession() {
+        guard let context = sessionContext else { return }
+        if (currentSessionContext == context) && (ios_getContext() == UnsafeMutableRawPointer(context)) {
+            sessionSwitchesSkipped += 1
+            return
+        }
+        ios_switchSession(context)
+        ios_setContext(UnsafeMutableRawPointer(context))
+        currentSessionContext = context
+        sessionSwitches += 1
+    }
+
+    // Keyboard input for the running command (stdin, or the webAssembly command), sent with the next batch.
+    func queueInput(_ input: String) {
+        if (javascriptRunning && (thread_stdin_copy != nil)) {
+            pendingWasmInput += input
+            stdinString += input
+        } else if let data = input.data(using: .utf8) {
+            pendingInput.append(data)
+        }
+        scheduleInputFlush()
+    }
+
+    func scheduleInputFlush() {
+        if (!inputFlushScheduled) {
+            inputFlushScheduled = true
+            DispatchQueue.main.async {
+                self.flushInput()
+            }
+        }
+    }
+
+    func flushInput() {
+        inputFlushScheduled = false
+        if (pendingInput.isEmpty && pendingTTYInput.isEmpty && pendingWasmInput.isEmpty) { return }
+        let onlyTTY = pendingInput.isEmpty && pendingWasmInput.isEmpty
+        let savedSession = ios_getContext()
+        self.switchToSession()
+        ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
+        let pagerActive = (ios_activePager() != 0)
+        if (!pendingTTYInput.isEmpty) {
+            if pagerActive, let data = pendingTTYInput.data(using: .utf8) {
+                // Remove the string that we just sent from the command input
+                // Sync issues: it could be executed before the string has been added to io.currentCommand
+                webView?.evaluateJavaScript("window.term_.io.currentCommand = window.term_.io.currentCommand.substr(\(pendingTTYInput.utf16.count));") { (result, error) in
+                    // if let error = error { print(error) }
+                    // if let result = result { print(result) }
+                }
+                tty_file_input?.write(data)
+            }
+            pendingTTYInput = ""
+        }
+        if (!pendingWasmInput.isEmpty) {
+            if (!pagerActive) {
+                wasmWebView?.evaluateJavaScript("appendInput('\(pendingWasmInput.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "'", with: "\\'").replacingOccurrences(of: "\n", with: "\\n").replacingOccurrences(of: "\r", with: "\\n"))'); commandIsRunning;") { (result, error) in
+                    // if let error = error { print(error) }
+                    if let result = result as? Bool {
+                        if (!result) {
+                            self.endWebAssemblyCommand(error: 0, message: "")
+                        }
+                    }
+                }
+            }
+            pendingWasmInput = ""
+        }
+        if (!pendingInput.isEmpty) {
+            let data = pendingInput
+            pendingInput = Data()
+            if (!pagerActive) {
+                checkWebAssemblyCommandRunning()
+                // TODO: don't send data if pipe already closed (^D followed by another key)
+                // (store a variable that says the pipe has been closed)
+                if let input = stdin_file_input {
+                    stdinQueue.async {
+                        // Write by pieces, so the command can start reading a large paste before the end of it:
+                        var offset = 0
+                        while (offset < data.count) {
+                            let end = min(offset + 16384, data.count)
+                            do {
+                                try input.write(contentsOf: data.subdata(in: offset..<end))
+                            }
+                            catch {
+                                // the command has ended, its stdin is closed
+                                break
+                            }
+                            offset = end
+                        }
+                    }
+                }
+            }
+        }
+        if (onlyTTY) {
+            // We can get a session context that is not a valid UUID (InExtension, shSession...)
+            // In that case, don't switch back to it:
+            if let stringPointer = UnsafeMutablePointer<CChar>(OpaquePointer(savedSession)) {
+                let savedSessionIdentifier = String(cString: stringPointer)
+                if let uuid = UUID(uuidString: savedSessionIdentifier) {
+                    ios_switchSession(savedSession)
+                    ios_setContext(savedSession)
+                    currentSessionContext = stringPointer
+                }
+            }
+        }
+    }
+
+    // Windows restored without a history of their own start with the last commands of all windows,
+    // read from the database the first time they are needed rather than when the window is restored.
+    func loadHistoryIfNeeded() {
+        if (historyNotLoaded) {
+            historyNotLoaded = false
+            history = HistoryDatabase.shared.recentCommands() // includes the commands typed since
+        }
+    }
+
     func printHistory() {
+        loadHistoryIfNeeded()
         for command in history {
             fputs(command + "\n", thread_stdout)
         }
@@ -2226,8 +2982,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                         // we need to have a stdin, even if we won't use it.
                         let stdin_pipe = Pipe()
                         let stdin_file = fdopen(stdin_pipe.fileHandleForReading.fileDescriptor, "r")
-                        ios_switchSession(self.persistentIdentifier?.toCString())
-                        ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
+                        self.switchToSession()
                         ios_setStreams(stdin_file, stdout_file, stdout_file)
                         // don't run the scheduled command if another command is already running
                         // (either one from the user or another run of the scheduled command)
@@ -2378,8 +3133,9 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             }
             // Also clear history:
             history = []
+            historyNotLoaded = false
             // and directories used:
-            directoriesUsed = [:]
+            DirectoryIndex.shared.removeAll()
             // Also reset directory:
             if (resetDirectoryAfterCommandTerminates != "") {
                 // NSLog("Calling resetDirectoryAfterCommandTerminates in exit to \(resetDirectoryAfterCommandTerminates)")
@@ -2397,6 +3153,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             printPrompt()
             return
         } // exit()
+        var historyId: Int64 = 0
         if (!command.contains("\n")) {
             // save command in history. This duplicates the history array in hterm.html.
             // We don't store multi-line commands in history, as they create issues.
@@ -2404,10 +3161,11 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 // only store command if different from last command
                 history.append(command)
             }
-            while (history.count > 100) {
-                // only keep the last 100 commands
+            while (history.count > HistoryDatabase.historyLimit) {
+                // only keep the last historyLimit commands (all of them are in the history database)
                 history.removeFirst()
             }
+            historyId = HistoryDatabase.shared.append(command: command, directory: FileManager().currentDirectoryPath)
         }
         // Can't create/close windows through ios_system, because it creates/closes a new session.
         if (actualCommand == "newWindow") {
@@ -2467,12 +3225,11 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             stdout_pipe.fileHandleForReading.readabilityHandler = self.onStdout
             self.stdout_active = true
             // Make sure we're on the right session:
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+            self.switchToSession()
             // Set COLUMNS to term width:
             setenv("COLUMNS", "\(self.width)".toCString(), 1);
             setenv("LINES", "\(self.height)".toCString(), 1);
-            ios_setWindowSize(Int32(self.width), Int32(self.height), self.persistentIdentifier?.toCString())
+            ios_setWindowSize(Int32(self.width), Int32(self.height), self.sessionContext)
             thread_stdin  = nil
             thread_stdout = nil
             thread_stderr = nil
@@ -2545,7 +3302,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 DispatchQueue.main.async {
                     UIApplication.shared.isIdleTimerDisabled = true
                 }
-                ios_system(self.currentCommand)
+                var result = ios_system(self.currentCommand)
                 NSLog("Returned from ios_system")
                 // for long running commands, ios_waitpid eats up to 68% CPU.
                 // but for short-running commands, we need it to be reactive.
@@ -2553,6 +3310,10 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 ios_waitpid(self.pid)
                 NSLog("Returned from ios_waitpid")
                 ios_releaseThreadId(self.pid)
+                if (result == 0) {
+                    result = ios_getCommandStatus()
+                }
+                HistoryDatabase.shared.setStatus(result, id: historyId)
                 DispatchQueue.main.async {
                     UIApplication.shared.isIdleTimerDisabled = false
                 }
@@ -2613,8 +3374,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             if (self.resetDirectoryAfterCommandTerminates != "") {
                 // NSLog("Calling resetDirectoryAfterCommandTerminates to \(self.resetDirectoryAfterCommandTerminates)")
                 if (!changeDirectory(path: self.resetDirectoryAfterCommandTerminates)) {
-                    ios_switchSession(self.persistentIdentifier?.toCString())
-                    ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
+                    self.switchToSession()
                     changeDirectory(path: self.resetDirectoryAfterCommandTerminates)
                 }
                 self.resetDirectoryAfterCommandTerminates = ""
@@ -2686,7 +3446,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             let newWidth = Int(command) ?? 80
             if (newWidth != width) {
                 width = newWidth
-                ios_setWindowSize(Int32(width), Int32(height), self.persistentIdentifier?.toCString())
+                ios_setWindowSize(Int32(width), Int32(height), self.sessionContext)
                 setenv("COLUMNS", "\(width)".toCString(), 1)
             }
         } else if (cmd.hasPrefix("height:")) {
@@ -2696,7 +3456,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             if (newHeight != height) {
                 height = newHeight
                 // NSLog("Calling ios_setWindowSize: \(width) x \(height)")
-                ios_setWindowSize(Int32(width), Int32(height), self.persistentIdentifier?.toCString())
+                ios_setWindowSize(Int32(width), Int32(height), self.sessionContext)
                 setenv("LINES", "\(height)".toCString(), 1)
             }
         } else if (cmd.hasPrefix("controlOff")) {
@@ -2745,41 +3505,21 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 }
             }
         } else if (cmd.hasPrefix("input:")) {
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
-            ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
-            if (ios_activePager() != 0) { return }
             var command = cmd
             command.removeFirst("input:".count)
             // NSLog("Writing \(command) to stdin")
             // Because wasm is running asynchronously, we can have thread_stdin closed while wasm is still running
             // I would like to have a way to kill webassembly commands
-            if (javascriptRunning && (thread_stdin_copy != nil)) {
-                wasmWebView?.evaluateJavaScript("inputString += '\(command.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "'", with: "\\'").replacingOccurrences(of: "\n", with: "\\n").replacingOccurrences(of: "\r", with: "\\n"))'; commandIsRunning;") { (result, error) in
-                    // if let error = error { print(error) }
-                    if let result = result as? Bool {
-                        if (!result) {
-                            self.endWebAssemblyCommand(error: 0, message: "")
-                        }
-                    }
-                }
-                stdinString += command
-                NSLog("command sent: \(command)")
+            if (javascriptRunning && (thread_stdin_copy != nil)) || ((command != endOfTransmission) && (command != interrupt)) {
+                queueInput(command)
                 return
             }
-            if (!javascriptRunning && executeWebAssemblyCommandsRunning) {
-                // There seems to be cases where the webassembly command did not terminate properly.
-                // We catch it here:
-                wasmWebView?.evaluateJavaScript("commandIsRunning;") { (result, error) in
-                    // if let error = error { print(error) }
-                    if let result = result as? Bool {
-                        if (!result) {
-                            self.endWebAssemblyCommand(error: 0, message: "")
-                        }
-                    }
-                }
-            }
-            guard let data = command.data(using: .utf8) else { return }
+            // Control-C and control-D act on the command, after the input already typed:
+            flushInput()
+            self.switchToSession()
+            ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
+            if (ios_activePager() != 0) { return }
+            checkWebAssemblyCommandRunning()
             if (command == endOfTransmission) {
                 // There is a webAssembly command running, do not close stdin.
                 // Stop standard input for the command:
@@ -2788,11 +3528,15 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     printPrompt()
                     return
                 }
-                do {
-                    try stdin_file_input?.close()
-                }
-                catch {
-                    // NSLog("Could not close stdin input.")
+                // close after the input already sent:
+                let input = stdin_file_input
+                stdinQueue.async {
+                    do {
+                        try input?.close()
+                    }
+                    catch {
+                        // NSLog("Could not close stdin input.")
+                    }
                 }
                 stdin_file_input = nil
             } else if (command == interrupt) {
@@ -2801,58 +3545,16 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 if (!javascriptRunning) {
                     ios_kill() // TODO: add printPrompt() here if no command running
                 }
-            } else {
-                guard stdin_file_input != nil else { return }
-                // TODO: don't send data if pipe already closed (^D followed by another key)
-                // (store a variable that says the pipe has been closed)
-                // NSLog("Writing (not interactive) \(command) to stdin")
-                stdin_file_input?.write(data)
             }
         } else if (cmd.hasPrefix("inputInteractive:")) {
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
-            ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
-            if (ios_activePager() != 0) { return }
             // Interactive commands: just send the input to them. Allows Vim to map control-D to down half a page.
             var command = cmd
             command.removeFirst("inputInteractive:".count)
-            if (javascriptRunning && (thread_stdin_copy != nil)) {
-                wasmWebView?.evaluateJavaScript("inputString += '\(command.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "'", with: "\\'").replacingOccurrences(of: "\n", with: "\\n").replacingOccurrences(of: "\r", with: "\\n"))'; commandIsRunning;") { (result, error) in
-                    // if let error = error { print(error) }
-                    if let result = result as? Bool {
-                        if (!result) {
-                            self.endWebAssemblyCommand(error: 0, message: "")
-                        }
-                    }
-                }
-                stdinString += command
-                return
-            }
-            if (!javascriptRunning && executeWebAssemblyCommandsRunning) {
-                // There seems to be cases where the webassembly command did not terminate properly.
-                // We catch it here:
-                wasmWebView?.evaluateJavaScript("commandIsRunning;") { (result, error) in
-                    // if let error = error { print(error) }
-                    if let result = result as? Bool {
-                        if (!result) {
-                            self.endWebAssemblyCommand(error: 0, message: "")
-                        }
-                    }
-                }
-            }
-            guard let data = command.data(using: .utf8) else { return }
-            guard stdin_file_input != nil else { return }
-            // TODO: don't send data if pipe already closed (^D followed by another key)
-            // (store a variable that says the pipe has been closed)
-            // NSLog("Writing (interactive) \(command) to stdin")
-            if (ios_activePager() == 0) {
-                stdin_file_input?.write(data)
-            }
+            queueInput(command)
         } else if (cmd.hasPrefix("inputTTY:")) {
             var command = cmd
             command.removeFirst("inputTTY:".count)
             // NSLog("Received (inputTTY) \(command)")
-            guard let data = command.data(using: .utf8) else { return }
             if #available(iOS 15.0, *) {
                 // Take over from the system for letters, to enforce auto-repeat for letters:
                 if let character = command.last {
@@ -2865,28 +3567,8 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 }
             }
             guard tty_file_input != nil else { return }
-            let savedSession = ios_getContext()
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
-            ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
-            if (ios_activePager() != 0) {
-                // Remove the string that we just sent from the command input
-                // Sync issues: it could be executed before the string has been added to io.currentCommand
-                webView?.evaluateJavaScript("window.term_.io.currentCommand = window.term_.io.currentCommand.substr(\(command.count));") { (result, error) in
-                    // if let error = error { print(error) }
-                    // if let result = result { print(result) }
-                }
-                tty_file_input?.write(data)
-            }
-            // We can get a session context that is not a valid UUID (InExtension, shSession...)
-            // In that case, don't switch back to it:
-            if let stringPointer = UnsafeMutablePointer<CChar>(OpaquePointer(savedSession)) {
-                let savedSessionIdentifier = String(cString: stringPointer)
-                if let uuid = UUID(uuidString: savedSessionIdentifier) {
-                    ios_switchSession(savedSession)
-                    ios_setContext(savedSession)
-                }
-            }
+            pendingTTYInput += command
+            scheduleInputFlush()
         } else if (cmd.hasPrefix("listBookmarks:") || cmd.hasPrefix("listBookmarksDir:")) {
             let storedNamesDictionary = UserDefaults.standard.dictionary(forKey: "bookmarkNames") ?? [:]
             // let groupNamesDictionary = UserDefaults(suiteName: "group.AsheKube.a-Shell")?.dictionary(forKey: "bookmarkNames")
@@ -2900,7 +3582,8 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             var sortedKeys = storedNamesDictionary.keys.sorted() // alphabetical order
             if (onlyDirectories) {
                 // sort directories in order of use:
-                sortedKeys = sortedKeys.sorted(by: { current, next in rankDirectory(dir:"~" + current, base: nil) > rankDirectory(dir:"~" + next, base: nil)})
+                let ranks = rankDirectories(dirs: sortedKeys.map { "~" + $0 }, base: nil)
+                sortedKeys = zip(sortedKeys, ranks).sorted(by: { ($0.1 > $1.1) || (($0.1 == $1.1) && ($0.0 < $1.0)) }).map { $0.0 }
             }
             var javascriptCommand = "fileList = [ "
             for key in sortedKeys {
@@ -2929,6 +3612,38 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     // }
                 }
             }
+        } else if (cmd.hasPrefix("loadHistory:")) {
+            // First use of the history in this window (up arrow, autocomplete)
+            loadHistoryIfNeeded()
+            let commands = history
+            DispatchQueue.global(qos: .userInitiated).async {
+                var javascriptCommand = "setCommandHistory(["
+                for command in commands {
+                    javascriptCommand += "\"" + command.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "\\r").replacingOccurrences(of: "\n", with: "\\n") + "\", "
+                }
+                javascriptCommand += "]);"
+                DispatchQueue.main.async {
+                    self.webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
+                        // if let error = error {
+                        //     print(error)
+                        // }
+                    }
+                }
+            }
+        } else if (cmd.hasPrefix("historySearch:")) {
+            // Ctrl-R: send the history entries added since the last request
+            var lastId = cmd
+            lastId.removeFirst("historySearch:".count)
+            HistoryDatabase.shared.searchEntries(after: Int64(lastId) ?? 0) { entries in
+                let javascriptCommand = "addHistoryEntries(\"" + entries.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "").replacingOccurrences(of: "\n", with: "\\n") + "\");"
+                DispatchQueue.main.async {
+                    self.webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
+                        // if let error = error {
+                        //     print(error)
+                        // }
+                    }
+                }
+            }
         } else if (cmd.hasPrefix("listDirectory:") || cmd.hasPrefix("listDirectoryDir:")) {
             var directory = cmd
             var onlyDirectories = false
@@ -2940,8 +3655,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             }
             if (directory.count == 0) { return }
             do {
-                ios_switchSession(self.persistentIdentifier?.toCString())
-                ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+                self.switchToSession()
                 // NSLog("about to list: \(directory)")
                 var directoryForListing = directory
                 let components = directoryForListing.components(separatedBy: "/")
@@ -2983,9 +3697,10 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     }
                 }
                 // NSLog("after parsing: \(directoryForListing)")
-                var filePaths = try FileManager().contentsOfDirectory(atPath: directoryForListing.replacingOccurrences(of: "\\ ", with: " ")) // un-escape spaces
-                filePaths.sort() // alphabetical order
+                let listing = try directoryListings.listing(path: directoryForListing.replacingOccurrences(of: "\\ ", with: " ")) // un-escape spaces
+                var entries = Array(zip(listing.names, listing.isDirectory)) // alphabetical order
                 if (onlyDirectories) {
+                    entries = entries.filter { $0.1 }
                     // sort directories in order of use:
                     var directoryForSorting = directoryForListing
                     if (directoryForSorting.hasPrefix(".")) {
@@ -2998,19 +3713,13 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                         }
                     }
                     let localDirCompact = String(cString: ios_getBookmarkedVersion(directoryForSorting.utf8CString))
-                    filePaths = filePaths.sorted(by: { current, next in rankDirectory(dir:current, base: localDirCompact) > rankDirectory(dir:next, base: localDirCompact)})
-                    // NSLog("after sorting: \(filePaths)")
+                    entries = sortDirectoriesByUse(entries.map { $0.0 }, base: localDirCompact).map { ($0, true) }
+                    // NSLog("after sorting: \(entries)")
                 }
                 var javascriptCommand = "fileList = ["
-                for filePath in filePaths {
-                    let fullPath = directoryForListing.replacingOccurrences(of: "\\ ", with: " ") + "/" + filePath
-                    // NSLog("path = \(fullPath) , isDirectory: \(URL(fileURLWithPath: fullPath).isDirectory)")
-                    let isDirectory = URL(fileURLWithPath: fullPath).isDirectory
-                    if onlyDirectories && !isDirectory {
-                        continue
-                    }
-                    // escape spaces, replace "\r" in filenames with "?"
-                    javascriptCommand += "\"" + filePath.replacingOccurrences(of: " ", with: "\\\\ ").replacingOccurrences(of: "\r", with: "?")
+                for (filePath, isDirectory) in entries {
+                    // escape backslashes, quotes and spaces, replace "\r" and "\n" in filenames with "?"
+                    javascriptCommand += "\"" + filePath.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: " ", with: "\\\\ ").replacingOccurrences(of: "\r", with: "?").replacingOccurrences(of: "\n", with: "?")
                     if isDirectory {
                         javascriptCommand += "/"
                     }
@@ -3038,48 +3747,33 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             var directory = cmd
             directory.removeFirst("listDirectoriesForZ:".count)
             if (directory.count == 0) { return }
-            var keys: [String]
-            do {
-                ios_switchSession(self.persistentIdentifier?.toCString())
-                ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
-                let matchingRegexp = directory.replacingOccurrences(of: ".", with: "\\.").replacingOccurrences(of: "/", with: ".*/.*")
-                let regex = try NSRegularExpression(pattern: matchingRegexp, options: [])
-                // select keys from dictionary that match argument. Using partial match.
-                let result = directoriesUsed.filter( { regex.matches(in: $0.key, range: NSRange($0.key.startIndex..<$0.key.endIndex, in: $0.key)).count > 0 } )
-                if (result.count == 0) {
-                    // No matches in history. Search local directory, same regexp.
-                    let filePaths = try FileManager().contentsOfDirectory(atPath: FileManager().currentDirectoryPath)
-                    var result = filePaths.filter( { regex.matches(in: $0, range: NSRange($0.startIndex..<$0.endIndex, in: $0)).count > 0 } )
-                    if (result.count > 1) {
-                        let localDirCompact = String(cString: ios_getBookmarkedVersion(FileManager().currentDirectoryPath.utf8CString)) + "/"
-                        result = result.sorted(by: { current, next in rankDirectory(dir: current, base: localDirCompact) > rankDirectory(dir: next, base: localDirCompact)})
-                    }
-                }
-                keys = result.keys.sorted()
-                keys = keys.sorted(by: { current, next in rankDirectory(dir: current, base: nil) > rankDirectory(dir: next, base: nil)})
-
-                var javascriptCommand = "fileList = ["
-                for key in keys {
-                    // escape spaces, replace "\r" in filenames with "?"
-                    javascriptCommand += "\"" + key.replacingOccurrences(of: " ", with: "\\\\ ").replacingOccurrences(of: "\r", with: "?")
-                    javascriptCommand += " "
-                    javascriptCommand += "\", "
-                }
-                // We need to re-escapce spaces for string comparison to work in JS:
-                javascriptCommand += "]; lastDirectory = \"" + directory.replacingOccurrences(of: " ", with: "\\ ") + "\"; updateFileMenu(); "
-                // print(javascriptCommand)
-                DispatchQueue.main.async {
-                    self.webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
-                        if let error = error { 
-                            print("Error in executing \(javascriptCommand): \(error)")
-                        }
-                        // if let result = result { print(result) }
+            self.switchToSession()
+            // Directories visited that match, best first. The index keeps the candidates for the
+            // previous query, so each new character only looks at those.
+            let query = DirectoryQuery(directory)
+            var keys = DirectoryIndex.shared.matches(query)
+            if (keys.count == 0) {
+                // No matches in history. Search local directory, same rules.
+                keys = localDirectoriesMatching(query)
+            }
+            var javascriptCommand = "fileList = ["
+            for key in keys {
+                // escape spaces, replace "\r" in filenames with "?"
+                javascriptCommand += "\"" + key.replacingOccurrences(of: " ", with: "\\\\ ").replacingOccurrences(of: "\r", with: "?")
+                javascriptCommand += " "
+                javascriptCommand += "\", "
+            }
+            // We need to re-escapce spaces for string comparison to work in JS:
+            javascriptCommand += "]; lastDirectory = \"" + directory.replacingOccurrences(of: " ", with: "\\ ") + "\"; updateFileMenu(); "
+            // print(javascriptCommand)
+            DispatchQueue.main.async {
+                self.webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
+                    if let error = error { 
+                        print("Error in executing \(javascriptCommand): \(error)")
                     }
+                    // if let result = result { print(result) }
                 }
-            } catch {
-                NSLog("Error getting Z files from directory: \(directory): \(error.localizedDescription)")
             }
-        
         } else if (cmd.hasPrefix("copy:")) {
             // copy text to clipboard. Required since simpler methods don't work with what we want to do with cut in JS.
             var string = cmd
@@ -3148,40 +3842,14 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 } */
             }
             // also initialize command list for autocomplete:
-            guard var commandsArray = commandsAsArray() as! [String]? else { return }
-            // Also scan PATH for executable files:
-            let executablePath = String(cString: getenv("PATH"))
-            // NSLog("\(executablePath)")
-            for directory in executablePath.components(separatedBy: ":") {
-                if (directory == "") {
-                    continue
-                }
-                do {
-                    // We don't check for exec status, because files inside $APPDIR have no x bit set.
-                    for file in try FileManager().contentsOfDirectory(atPath: directory) {
-                        let newCommand = URL(fileURLWithPath: file).lastPathComponent
-                        // Do not add a command if it is already present:
-                        if (!commandsArray.contains(newCommand)) {
-                            commandsArray.append(newCommand)
-                        }
+            if let javascriptCommand = commandListJavascript(path: String(cString: getenv("PATH"))) {
+                webView!.evaluateJavaScript(javascriptCommand) { (result, error) in
+                    if let error = error {
+                        NSLog("Error in creating command list, error = \(error)")
+                        // print(error)
                     }
-                } catch {
-                    // The directory is unreadable, move to next one
-                    continue
-                }
-            }
-            commandsArray.sort() // make sure it's in alphabetical order
-            var javascriptCommand = "var commandList = ["
-            for command in commandsArray {
-                javascriptCommand += "\"" + command + "\", "
-            }
-            javascriptCommand += "];"
-            webView!.evaluateJavaScript(javascriptCommand) { (result, error) in
-                if let error = error {
-                    NSLog("Error in creating command list, line = \(javascriptCommand) error = \(error)")
-                    // print(error)
+                    // if let result = result { print(result) }
                 }
-                // if let result = result { print(result) }
             }
             // Add long-press gesture to the buttons:
             if (!useSystemToolbar) {
@@ -3244,7 +3912,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                         windowPrintedContent += "\n\rYou have installed the xz/xzdec commands.\n\ra-Shell has made incompatible changes with this version.\n\rYou should re-install them with `pkg install xz`.\n"
                     }
                     // When should I remove this warning? October 2026? 
-                    let command = "window.promptMessage = '\(self.parsePrompt())'; \(windowHistory)  window.printedContent = \"\(windowPrintedContent.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "\\r").replacingOccurrences(of: "\n", with: "\\n"))\"; window.commandRunning = '\(currentCommand)'; window.interactiveCommandRunning = isInteractive(window.commandRunning); if (window.printedContent != '') { window.term_.wipeContents(); let content=window.printedContent; window.printedContent=''; window.term_.io.print(content); } else { window.printPrompt(); } updatePromptPosition();"
+                    let command = "window.promptMessage = '\(self.parsePrompt())'; window.printedContent = \"\(windowPrintedContent.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "\\r").replacingOccurrences(of: "\n", with: "\\n"))\"; window.commandRunning = '\(currentCommand)'; window.interactiveCommandRunning = isInteractive(window.commandRunning); if (window.printedContent != '') { window.term_.wipeContents(); let content=window.printedContent; window.printedContent=''; window.term_.io.print(content); } else { window.printPrompt(); } updatePromptPosition();"
                     // NSLog("resendCommand, command=\(command)")
                     self.webView!.evaluateJavaScript(command) { (result, error) in
                         if let error = error {
@@ -3262,7 +3930,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     webView?.scrollView.setContentOffset(scrollPoint, animated: true)
                 } else {
                     NSLog("commandRunning= \(currentCommand)")
-                    let command = "window.commandRunning = '\(currentCommand)'; \(windowHistory) window.interactiveCommandRunning = isInteractive(window.commandRunning); window.printedContent = \"\(windowPrintedContent.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "\\r").replacingOccurrences(of: "\n", with: "\\n"))\";  window.term_.wipeContents(); let content=window.printedContent; window.printedContent=''; window.term_.io.print(content);" // window.printPrompt(); updatePromptPosition();"
+                    let command = "window.commandRunning = '\(currentCommand)'; window.interactiveCommandRunning = isInteractive(window.commandRunning); window.printedContent = \"\(windowPrintedContent.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"").replacingOccurrences(of: "\r", with: "\\r").replacingOccurrences(of: "\n", with: "\\n"))\";  window.term_.wipeContents(); let content=window.printedContent; window.printedContent=''; window.term_.io.print(content);" // window.printPrompt(); updatePromptPosition();"
                     self.webView!.evaluateJavaScript(command) { (result, error) in
                         if let error = error {
                             NSLog("Error in resendCommand, line = \(command)")
@@ -3462,9 +4130,9 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             //     }
             // }
             self.persistentIdentifier = session.persistentIdentifier
+            sessionContext = strdup(session.persistentIdentifier)
             NSLog("Setting identifier to \(session.persistentIdentifier)")
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+            self.switchToSession()
             webView = contentView?.webview.webView
             // add a contentController that is specific to each webview
             webView?.configuration.userContentController = WKUserContentController()
@@ -3545,6 +4213,9 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             wasmWebView?.isOpaque = false
             wasmWebView?.configuration.userContentController = WKUserContentController()
             wasmWebView?.configuration.userContentController.add(self, name: "aShell")
+            // jsc.batchAsync() in wasm.html:
+            wasmWebView?.configuration.userContentController.addScriptMessageHandler(JSCHostCallHandler(delegate: self),
+                                                                                     contentWorld: .page, name: "jscHost")
             wasmWebView?.navigationDelegate = self
             wasmWebView?.uiDelegate = self;
             wasmWebView?.isAccessibilityElement = false
@@ -3572,37 +4243,14 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                 terminalFontLigature = ligature
             }
             // initialize command list for autocomplete:
-            guard var commandsArray = commandsAsArray() as! [String]? else { return }
-            // Also scan PATH for executable files:
-            let executablePath = String(cString: getenv("PATH"))
-            // NSLog("\(executablePath)")
-            for directory in executablePath.components(separatedBy: ":") {
-                do {
-                    // We don't check for exec status, because files inside $APPDIR have no x bit set.
-                    for file in try FileManager().contentsOfDirectory(atPath: directory) {
-                        let newCommand = URL(fileURLWithPath: file).lastPathComponent
-                        // Do not add a command if it is already present:
-                        if (!commandsArray.contains(newCommand)) {
-                            commandsArray.append(newCommand)
-                        }
+            if let javascriptCommand = commandListJavascript(path: String(cString: getenv("PATH"))) {
+                webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
+                    if error != nil {
+                        // NSLog("Error in creating command list, line = \(javascriptCommand)")
+                        // print(error)
                     }
-                } catch {
-                    // The directory is unreadable, move to next one
-                    continue
-                }
-            }
-            commandsArray.sort() // make sure it's in alphabetical order
-            var javascriptCommand = "var commandList = ["
-            for command in commandsArray {
-                javascriptCommand += "\"" + command + "\", "
-            }
-            javascriptCommand += "];"
-            webView?.evaluateJavaScript(javascriptCommand) { (result, error) in
-                if error != nil {
-                    // NSLog("Error in creating command list, line = \(javascriptCommand)")
-                    // print(error)
+                    // if let result = result { print(result) }
                 }
-                // if let result = result { print(result) }
             }
             // If .profile or .bashrc exist, load them:
             for configFileName in [".profile", ".bashrc"] {
@@ -3617,8 +4265,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                         do {
                             let contentOfFile = try String(contentsOf: configFileUrl, encoding: String.Encoding.utf8)
                             let commands = contentOfFile.split(separator: "\n")
-                            ios_switchSession(self.persistentIdentifier?.toCString())
-                            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+                            self.switchToSession()
                             thread_stdin  = nil
                             thread_stdout = nil
                             thread_stderr = nil
@@ -3901,11 +4548,11 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     }
                     command += fileURL.path.removingPercentEncoding!.replacingOccurrences(of: " ", with: "\\ ") + "\n"
                     if let data = command.data(using: .utf8) {
-                        ios_switchSession(self.persistentIdentifier?.toCString())
-                        ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+                        self.switchToSession()
                         ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
                         if (stdin_file_input != nil) {
-                            stdin_file_input?.write(data)
+                            pendingInput.append(data) // after the input already queued
+                            flushInput()
                             return
                         }
                     }
@@ -3963,11 +4610,11 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             if (exitCommand != "") {
                 exitCommand += "\n"
                 if let data = exitCommand.data(using: .utf8) {
-                    ios_switchSession(self.persistentIdentifier?.toCString())
-                    ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
+                    self.switchToSession()
                     ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
                     if (stdin_file_input != nil) {
-                        stdin_file_input?.write(data)
+                        pendingInput.append(data) // after the input already queued
+                        flushInput()
                         return
                     }
                 }
@@ -4105,12 +4752,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
         // Called as the scene transitions from the background to the foreground.
         // Use this method to undo the changes made on entering the background.
         // Reload the webAssembly interpreter (this will also check if the local server is still running):
-        if (appVersion != "a-Shell-mini") {
-            wasmWebView?.load(URLRequest(url: URL(string: "https://localhost:8443/wasm.html")!))
-        } else {
-            NSLog("Loding wasm.html from 8334")
-            wasmWebView?.load(URLRequest(url: URL(string: "https://localhost:8334/wasm.html")!))
-        }
+        wasmWebView?.load(URLRequest(url: URL(string: localServerURL + "/wasm.html")!))
         // Was this window created with a purpose?
         let userActivity = scene.userActivity
         // Do not restore if a command is already running.
@@ -4179,31 +4821,18 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             if let historyData = userInfo["history"] {
                 history = historyData as! [String]
             } else {
-                history = UserDefaults.standard.array(forKey: "history") as? [String] ?? []
+                historyNotLoaded = true
             }
-            directoriesUsed = UserDefaults.standard.dictionary(forKey: "directoriesUsed") as? [String:Int] ?? [:]
             // NSLog("set history to \(history)")
-            // NSLog("set directoriesUsed to \(directoriesUsed)")
-            windowHistory = "window.commandArray = ["
-            for command in history {
-                windowHistory += "\"" + command.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"") + "\", "
-            }
-            windowHistory += "]; window.commandIndex = \(history.count); window.maxCommandIndex = \(history.count); "
-            // webView!.evaluateJavaScript(javascriptCommand) { (result, error) in
-            //     if error != nil {
-            //         NSLog("Error in recreating history, line = \(javascriptCommand)")
-            //         print(error)
-            //     }
-            //     if let result = result { print("Recreating history: \(result), line= \(javascriptCommand)") }
-            // }
+            // The history is sent to the page the first time it needs it (see "loadHistory:"),
+            // so restoring a window doesn't wait for it.
+            self.switchToSession()
             if let previousDirectoryData = userInfo["prev_wd"] {
                 if let previousDirectory = previousDirectoryData as? String {
                     NSLog("got previousDirectory as \(previousDirectory)")
                     if (FileManager().fileExists(atPath: previousDirectory) && FileManager().isReadableFile(atPath: previousDirectory)) {
                         NSLog("set previousDirectory to \(previousDirectory)")
                         // Call cd_main instead of executeCommand("cd dir") to avoid closing a prompt and history.
-                        ios_switchSession(self.persistentIdentifier?.toCString())
-                        ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
                         changeDirectory(path: previousDirectory) // call cd_main and checks secured bookmarked URLs
                     }
                 }
@@ -4227,8 +4856,6 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
                     if (FileManager().fileExists(atPath: currentDirectory) && FileManager().isReadableFile(atPath: currentDirectory)) {
                         NSLog("set currentDirectory to \(currentDirectory)")
                         // Call cd_main instead of executeCommand("cd dir") to avoid closing a prompt and history.
-                        ios_switchSession(self.persistentIdentifier?.toCString())
-                        ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()))
                         changeDirectory(path: currentDirectory) // call cd_main and checks secured bookmarked URLs
                     }
                 }
@@ -4527,6 +5154,7 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
         // Use this method to save data, release shared resources, and store enough scene-specific state information
         // to restore the scene back to its current state.
         NSLog("sceneDidEnterBackground: \(self.persistentIdentifier).")
+        NSLog("ios_system session switches: \(sessionSwitches), skipped: \(sessionSwitchesSkipped)")
         scene.session.stateRestorationActivity = NSUserActivity(activityType: "AsheKube.app.a-Shell.TermSession")
         if (currentDirectory == "") {
             currentDirectory = FileManager().currentDirectoryPath
@@ -4536,10 +5164,14 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             previousDirectory = FileManager().currentDirectoryPath
         }
         scene.session.stateRestorationActivity?.userInfo!["prev_wd"] = previousDirectory
-        scene.session.stateRestorationActivity?.userInfo!["history"] = history
-        // Store history and directories used in the UserDefaults (so new windows don't start with a blank state)
-        UserDefaults.standard.set(history, forKey: "history")
-        UserDefaults.standard.set(directoriesUsed, forKey: "directoriesUsed")
+        if (!historyNotLoaded) {
+            scene.session.stateRestorationActivity?.userInfo!["history"] = history
+        }
+        // Store directories used in the UserDefaults (so new windows don't start with a blank state)
+        // (history is in the history database). Only if they changed, and not on the main thread.
+        DirectoryIndex.shared.save()
+        // The prepared JavaScriptCore context is not worth keeping in the background:
+        JSContextPool.shared.drain()
         if (terminalFontSize != nil) {
             scene.session.stateRestorationActivity?.userInfo!["fontSize"] = terminalFontSize
         }
@@ -4615,11 +5247,11 @@ class SceneDelegate: UIViewController, UIWindowSceneDelegate, WKNavigationDelega
             if (saveCommand != "") {
                 // NSLog("Sending save command: \(saveCommand)")
                 if let data = saveCommand.data(using: .utf8) {
-                    ios_switchSession(self.persistentIdentifier?.toCString())
-                    ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+                    self.switchToSession()
                     ios_setStreams(self.stdin_file, self.stdout_file, self.stdout_file)
                     if (stdin_file_input != nil) {
-                        stdin_file_input?.write(data)
+                        pendingInput.append(data) // after the input already queued
+                        flushInput()
                         return
                     }
                 }
@@ -4967,8 +5599,7 @@ extension SceneDelegate: WKUIDelegate {
             if (arguments[1] != "read") && (arguments[1] != "write") {
                 NSLog("prompt: \(prompt.replacingOccurrences(of: "\n", with: " "))")
             }
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+            self.switchToSession()
             if (arguments[1] == "open") {
                 // NSLog("opening file: \(arguments[2])")
                 let rights = Int32(arguments[3]) ?? 577;
@@ -5370,7 +6001,7 @@ extension SceneDelegate: WKUIDelegate {
                             self.executeCommand(command: arguments[2])
                             self.executeCommand(command: commandBeforeEdit)
                         }
-                        wasmWebView?.evaluateJavaScript("inputString += 'q';") { (result, error) in
+                        wasmWebView?.evaluateJavaScript("appendInput('q');") { (result, error) in
                             if let error = error { print(error) }
                         }
                         stdinString += "q" // It takes around 0.2 seconds for the command to end
@@ -5509,9 +6140,7 @@ extension SceneDelegate: WKUIDelegate {
             // JSC extensions: readFile, writeFile...
             // Copied from the extensions in iOS_system, making them available to WkWebView JS interpreter.
             // Make sure we are on the right iOS session. This resets the current working directory.
-            // TODO: that's one call to ios_switchSession. Reset?
-            ios_switchSession(self.persistentIdentifier?.toCString())
-            ios_setContext(UnsafeMutableRawPointer(mutating: self.persistentIdentifier?.toCString()));
+            self.switchToSession()
             if (arguments[1] == "readFile") {
                 do {
                     completionHandler(try String(contentsOf: URL(fileURLWithPath: arguments[2]), encoding: .utf8))
@@ -5650,6 +6279,51 @@ extension SceneDelegate: WKUIDelegate {
             } else if (arguments[1] == "pickDirectory") {
                 completionHandler("\(FileManager().currentDirectoryPath)")
                 return
+            } else if (arguments[1] == "batch") {
+                // jsc.batch(): several operations in one prompt, as JSON
+                var json = prompt
+                json.removeFirst(arguments[0].count + 1 + arguments[1].count + 1)
+                completionHandler(JSCHostCalls.perform(json: json, directory: FileManager().currentDirectoryPath))
+                return
+            } else if (arguments[1] == "fileToken") {
+                // for the /__fd requests of jsc.openFile():
+                completionHandler(WebViewFiles.shared.token)
+                return
+            } else if (arguments[1] == "open") {
+                guard let flags = openFlags(mode: arguments[3]) else {
+                    completionHandler("-1\n" + String(cString: strerror(EINVAL)))
+                    return
+                }
+                let fd = open(arguments[2], flags, 0o644)
+                if (fd < 0) {
+                    completionHandler("-1\n" + String(cString: strerror(errno)) + ": " + arguments[2])
+                    errno = 0
+                } else {
+                    WebViewFiles.shared.insert(fd)
+                    completionHandler("\(fd)")
+                }
+                return
+            } else if (arguments[1] == "seek") {
+                if let fd = Int32(arguments[2]), WebViewFiles.shared.contains(fd),
+                   let offset = Int64(arguments[3]), let whence = Int32(arguments[4]) {
+                    let position = lseek(fd, off_t(offset), whence)
+                    if (position < 0) {
+                        completionHandler("-1\n" + String(cString: strerror(errno)))
+                        errno = 0
+                    } else {
+                        completionHandler("\(position)")
+                    }
+                } else {
+                    completionHandler("-1\n" + String(cString: strerror(EBADF)))
+                }
+                return
+            } else if (arguments[1] == "close") {
+                if let fd = Int32(arguments[2]), WebViewFiles.shared.remove(fd) {
+                    completionHandler("\(close(fd))")
+                } else {
+                    completionHandler("-1\n" + String(cString: strerror(EBADF)))
+                }
+                return
             }
         }
         // End of JavaScriptCore extensions
@@ -5810,12 +6484,7 @@ extension SceneDelegate: WKUIDelegate {
             // NSLog("Opening hterm.html")
             // if (navigationType == .backForward) && (currentCommand == "") {
             if (navigationType == .backForward) {
-                // reset JS history before reload:
-                windowHistory = "window.commandArray = ["
-                for command in history {
-                    windowHistory += "\"" + command.replacingOccurrences(of: "\\", with: "\\\\").replacingOccurrences(of: "\"", with: "\\\"") + "\", "
-                }
-                windowHistory += "]; window.commandIndex = \(history.count); window.maxCommandIndex = \(history.count); "
+                // (the page will ask for the history when it needs it)
                 webView.stopLoading()
                 webView.reload() // Now *that* gives us the keyboard
             }
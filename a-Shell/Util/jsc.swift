@@ -9,317 +9,943 @@
 import Foundation
 import ios_system
 import JavaScriptCore
+import WebKit // for the host calls of wasm.html
 
 func printUsage(command: String) {
     fputs("Usage: \(command) file.js\nExecutes JavaScript files using JavaScriptCore.\n", thread_stdout)
 }
 
-let timerJSSharedInstance = TimerJS()
+@objc protocol JSCEventLoopExport : JSExport {
 
-@objc protocol TimerJSExport : JSExport {
+    func setTimeout(_ callback : JSValue,_ ms : Double) -> Int
 
-    func setTimeout(_ callback : JSValue,_ ms : Double) -> String
+    func setInterval(_ callback : JSValue,_ ms : Double) -> Int
 
-    func clearTimeout(_ identifier: String)
-
-    func setInterval(_ callback : JSValue,_ ms : Double) -> String
+    func clearTimeout(_ identifier: Int)
 
 }
 
+// The event loop of one jsc command, on the command's own thread. jsc_core runs it after
+// the script, until there are no timers and no asynchronous operations left, so the command
+// ends when the script is really done.
+// Timers are kept in a min-heap, ordered by due time, then by creation order. Promise
+// reactions (microtasks) are run by JavaScriptCore at the end of each callback.
+// Asynchronous functions (jsc.readFileAsync...) run on a global queue and post their
+// completion to the loop, which resolves their Promise on the command thread.
 // Custom class must inherit from `NSObject`
-@objc class TimerJS: NSObject, TimerJSExport {
-    var timers = [String: Timer]()
-    
-    static func registerInto(jsContext: JSContext, forKeyedSubscript: String = "timerJS") {
-        jsContext.setObject(timerJSSharedInstance,
-                            forKeyedSubscript: forKeyedSubscript as (NSCopying & NSObjectProtocol))
+@objc class JSCEventLoop: NSObject, JSCEventLoopExport {
+    private struct Entry {
+        var due: TimeInterval
+        var sequence: Int
+        var identifier: Int
+    }
+    private var heap: [Entry] = []
+    // Active timers. A heap entry whose sequence doesn't match was cancelled or rescheduled:
+    private var timers: [Int: (callback: JSValue, interval: Double, repeats: Bool, sequence: Int)] = [:]
+    private var nextIdentifier = 1
+    private var nextSequence = 0
+    // Completed asynchronous operations, posted from other threads. post() also writes a byte
+    // to a pipe, and the loop waits in poll() on it, without holding the lock: a thread
+    // cancelled inside a condition wait (control-C) would leave the mutex locked for post().
+    private let lock = NSLock()
+    private var completions: [() -> Void] = []
+    private var pending = 0
+    private var wakeup: [Int32] = [-1, -1]
+
+    override init() {
+        super.init()
+        if (pipe(&wakeup) == 0) {
+            for fd in wakeup {
+                _ = fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)
+                _ = fcntl(fd, F_SETFD, FD_CLOEXEC)
+            }
+        } else {
+            wakeup = [-1, -1]
+        }
+    }
+
+    deinit {
+        for fd in wakeup where fd >= 0 {
+            close(fd)
+        }
+    }
+
+    static func registerInto(jsContext: JSContext) {
+        // _eventLoop is set for each command, in jsc_core:
         jsContext.evaluateScript(
-            "function setTimeout(callback, ms) {" +
-            "    return timerJS.setTimeout(callback, ms)" +
+            "function setTimeout(callback, ms, ...args) {" +
+            "    return _eventLoop.setTimeout(args.length ? () => callback(...args) : callback, ms || 0)" +
             "}" +
-            "function clearTimeout(indentifier) {" +
-            "    timerJS.clearTimeout(indentifier)" +
+            "function clearTimeout(identifier) {" +
+            "    if (identifier !== undefined) { _eventLoop.clearTimeout(identifier) }" +
             "}" +
-            "function setInterval(callback, ms) {" +
-            "    return timerJS.setInterval(callback, ms)" +
+            "function setInterval(callback, ms, ...args) {" +
+            "    return _eventLoop.setInterval(args.length ? () => callback(...args) : callback, ms || 0)" +
+            "}" +
+            "var clearInterval = clearTimeout;" +
+            "function setImmediate(callback, ...args) { return setTimeout(callback, 0, ...args) }" +
+            "var clearImmediate = clearTimeout;" +
+            "if (typeof queueMicrotask === 'undefined') {" +
+            "    var queueMicrotask = (callback) => { Promise.resolve().then(callback) }" +
             "}"
         )
     }
-    
-    func clearTimeout(_ identifier: String) {
-        let timer = timers.removeValue(forKey: identifier)
-        
-        timer?.invalidate()
+
+    // The loop of the command running in the current context:
+    static var current: JSCEventLoop? {
+        return JSContext.current()?.objectForKeyedSubscript("_eventLoop")?.toObject() as? JSCEventLoop
     }
-    
-    
-    func setInterval(_ callback: JSValue,_ ms: Double) -> String {
-        return createTimer(callback: callback, ms: ms, repeats: true)
+
+    private static var now: TimeInterval {
+        return ProcessInfo.processInfo.systemUptime
     }
-    
-    func setTimeout(_ callback: JSValue, _ ms: Double) -> String {
-        return createTimer(callback: callback, ms: ms , repeats: false)
+
+    private func less(_ a: Entry, _ b: Entry) -> Bool {
+        return (a.due < b.due) || ((a.due == b.due) && (a.sequence < b.sequence))
     }
-    
-    @objc func callJsCallback(timer: Timer) {
-        let callback = (timer.userInfo as! JSValue)
-        callback.call(withArguments: nil)
+
+    private func push(_ entry: Entry) {
+        heap.append(entry)
+        var child = heap.count - 1
+        while (child > 0) {
+            let parent = (child - 1) / 2
+            if (!less(heap[child], heap[parent])) { break }
+            heap.swapAt(child, parent)
+            child = parent
+        }
     }
-    
-    func createTimer(callback: JSValue, ms: Double, repeats : Bool) -> String {
-        let timeInterval  = ms/1000.0
-        
-        let uuid = NSUUID().uuidString
-        
-        // make sure that we are queueing it all in the same executable queue...
-        // JS calls are getting lost if the queue is not specified... that's what we believe... ;)
-        DispatchQueue.main.async(execute: {
-            let timer = Timer.scheduledTimer(timeInterval: timeInterval,
-                                             target: self,
-                                             selector: #selector(self.callJsCallback),
-                                             userInfo: callback,
-                                             repeats: repeats)
-            self.timers[uuid] = timer
-        })
-        
-        
-        return uuid
+
+    private func pop() -> Entry {
+        let top = heap[0]
+        let last = heap.removeLast()
+        if (!heap.isEmpty) {
+            heap[0] = last
+            var parent = 0
+            while (true) {
+                var smallest = parent
+                let left = 2 * parent + 1
+                let right = left + 1
+                if (left < heap.count) && less(heap[left], heap[smallest]) { smallest = left }
+                if (right < heap.count) && less(heap[right], heap[smallest]) { smallest = right }
+                if (smallest == parent) { break }
+                heap.swapAt(parent, smallest)
+                parent = smallest
+            }
+        }
+        return top
     }
-}
 
-// TODO:
-// add searching for modules in ~/Library and ~/Documents
-// npm to install new modules (not parcel, though)
+    // As in node: a delay that is not a number, infinite, or above TIMEOUT_MAX (2^31 - 1 ms)
+    // is 1 ms. Negative delays are 0, so that setImmediate() doesn't wait.
+    private static func delay(_ ms: Double) -> Double {
+        if (!ms.isFinite || (ms > 2147483647)) {
+            return 1
+        }
+        return max(ms, 0)
+    }
 
-// execute JavaScript files using JavaScriptCore instead of WkWebView:
-public func jsc_core(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
-    guard let args = convertCArguments(argc: argc, argv: argv) else {
-        printUsage(command: "jsc")
-        return 0
+    private func schedule(identifier: Int, ms: Double) {
+        nextSequence += 1
+        timers[identifier]?.sequence = nextSequence
+        push(Entry(due: JSCEventLoop.now + max(ms, 0) / 1000.0, sequence: nextSequence, identifier: identifier))
     }
-    if (argc != 2) {
-        printUsage(command: args[0])
-        return 0
+
+    private func createTimer(callback: JSValue, ms: Double, repeats: Bool) -> Int {
+        let ms = JSCEventLoop.delay(ms)
+        let identifier = nextIdentifier
+        nextIdentifier += 1
+        // An interval of 0 would never let the loop wait:
+        timers[identifier] = (callback: callback, interval: repeats ? max(ms, 1) : ms, repeats: repeats, sequence: 0)
+        schedule(identifier: identifier, ms: ms)
+        return identifier
     }
-    let command = args[1]
-    
-    // let fileName = FileManager().currentDirectoryPath + "/" + command
-    let fileName = command.hasPrefix("/") ? command : FileManager().currentDirectoryPath + "/" + command
-    do {
-        let javascript = try String(contentsOf: URL(fileURLWithPath: fileName), encoding: String.Encoding.utf8)
-        let context = JSContext()!
-        TimerJS.registerInto(jsContext: context) // for setTimeOut
-        
-        context.exceptionHandler = { context, exception in
-            let line = exception!.objectForKeyedSubscript("line").toString()
-            let column = exception!.objectForKeyedSubscript("column").toString()
-            let stacktrace = exception!.objectForKeyedSubscript("stack").toString()
-            let unknown = "<unknown>"
-            fputs("jsc: Error ", thread_stderr)
-            if let currentFilename = context?.evaluateScript("if (typeof __filename !== 'undefined') { __filename }") {
-                if (!currentFilename.isUndefined) {
-                    let file = currentFilename.toString()
-                    fputs("in file " + (file ?? unknown) + " ", thread_stderr)
-                }
-            }
-            fputs("at line " + (line ?? unknown), thread_stderr)
-            fputs(", column: " + (column ?? unknown) + ": ", thread_stderr)
-            fputs(exception!.toString() + "\n", thread_stderr)
-            if (stacktrace != nil) {
-                fputs("jsc: Full stack: " + stacktrace! + "\n", thread_stderr)
-            }
-        }
-        // create basic variables
-        context.evaluateScript(
-            "const global = (() => this)();\n" +
-            "global.jsc = { };\n" +
-            "global.document = { baseURI: \"/\" };\n" +
-            "self = this;\n")
-        
-        let gateway = context.objectForKeyedSubscript("jsc" as NSString)
-        // Key functions: print, println, console.log:
-        let print: @convention(block) (String) -> Void = { string in
-            fputs(string, thread_stdout)
-        }
-        context.setObject(print, forKeyedSubscript: "print" as NSString)
-        let println: @convention(block) (String) -> Void = { string in
-            fputs(string + "\n", thread_stdout)
-        }
-        context.setObject(println, forKeyedSubscript: "println" as NSString)
-        // console.log
-        context.evaluateScript("var console = { log: function(message) { _consoleLog(message) } }")
-        let consoleLog: @convention(block) (String) -> Void = { message in
-            fputs("console.log: " + message + "\n", thread_stderr)
-        }
-        context.setObject(consoleLog, forKeyedSubscript: "_consoleLog" as NSString)
-        // Add URL type using url-polyfill:
-        if let urlUrl = Bundle.main.url(forResource: "url-polyfill", withExtension: "js") {
-            if let urlData = try? Data(contentsOf: urlUrl) {
-                let urlContent = String(decoding: urlData, as: UTF8.self)
-                context.evaluateScript(urlContent) // Now we have URL type
-                context.evaluateScript("var location = new URL(\"" + Bundle.main.bundlePath + "/wasm.html\");")
-            }
+
+    func setTimeout(_ callback: JSValue, _ ms: Double) -> Int {
+        return createTimer(callback: callback, ms: ms, repeats: false)
+    }
+
+    func setInterval(_ callback: JSValue, _ ms: Double) -> Int {
+        return createTimer(callback: callback, ms: ms, repeats: true)
+    }
+
+    func clearTimeout(_ identifier: Int) {
+        timers.removeValue(forKey: identifier)
+    }
+
+    // Runs work on a global queue. Its result is converted to JavaScript by convert, on the loop thread.
+    // Returns a Promise for the result.
+    func submit<T>(in context: JSContext, work: @escaping () throws -> T, convert: @escaping (T, JSContext) -> JSValue?) -> JSValue? {
+        var resolveFunction: JSValue? = nil
+        var rejectFunction: JSValue? = nil
+        let promise = JSValue(newPromiseIn: context) { resolve, reject in
+            resolveFunction = resolve
+            rejectFunction = reject
         }
-        // JSC extensions: readFile, writeFile...
-        let readFile: @convention(block) (String) -> String = { string in
+        pending += 1
+        // Commands started by the work (jsc.systemAsync) write where the script writes:
+        let stdin = thread_stdin
+        let stdout = thread_stdout
+        let stderr = thread_stderr
+        DispatchQueue.global(qos: .userInitiated).async {
+            thread_stdin = stdin
+            thread_stdout = stdout
+            thread_stderr = stderr
+            var result: T? = nil
+            var failure: Error? = nil
             do {
-                return try String(contentsOf: URL(fileURLWithPath: string), encoding: String.Encoding.utf8)
+                result = try work()
             }
             catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
+                failure = error
+            }
+            self.post {
+                if (result != nil) {
+                    resolveFunction?.call(withArguments: [convert(result!, context) ?? JSValue(undefinedIn: context)!])
+                } else {
+                    let message = failure?.localizedDescription ?? "Unknown error"
+                    rejectFunction?.call(withArguments: [JSValue(newErrorFromMessage: message, in: context)!])
+                }
             }
-            return ""
         }
-        gateway?.setObject(readFile, forKeyedSubscript: "readFile" as NSString)
-        let readFileBase64: @convention(block) (String) -> String = { string in
-            do {
-                return try NSData(contentsOf: URL(fileURLWithPath: fileName)).base64EncodedString()
+        return promise
+    }
+
+    private func post(_ completion: @escaping () -> Void) {
+        lock.lock()
+        completions.append(completion)
+        lock.unlock()
+        // If the pipe is full, the loop has a wakeup pending already:
+        var byte: UInt8 = 0
+        _ = write(wakeup[1], &byte, 1)
+    }
+
+    // Runs until there is nothing left to do. The wait is a cancellation point, so ios_kill()
+    // (control-C) still stops a script waiting for its timers.
+    func run() {
+        while (true) {
+            lock.lock()
+            let ready = completions
+            completions.removeAll()
+            lock.unlock()
+            for completion in ready {
+                completion()
+                pending -= 1
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
+            // Timers created by these callbacks wait for the next iteration:
+            let now = JSCEventLoop.now
+            while let first = heap.first, (first.due <= now) {
+                let entry = pop()
+                guard let timer = timers[entry.identifier], (timer.sequence == entry.sequence) else { continue }
+                if (timer.repeats) {
+                    schedule(identifier: entry.identifier, ms: timer.interval)
+                } else {
+                    timers.removeValue(forKey: entry.identifier)
+                }
+                timer.callback.call(withArguments: [])
             }
-            return ""
-        }
-        gateway?.setObject(readFileBase64, forKeyedSubscript: "readFileBase64" as NSString)
-        
-        let writeFile: @convention(block) (String, String) -> Int = { filePath, content in
-            do {
-                try content.write(toFile: filePath, atomically: true, encoding: String.Encoding.utf8)
-                return 0
+            if (timers.isEmpty && (pending == 0)) {
+                break
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
+            lock.lock()
+            let idle = completions.isEmpty
+            lock.unlock()
+            if (idle) {
+                var timeout: Int32 = -1 // no timers: wait for a completion
+                if let first = heap.first {
+                    let delay = first.due - JSCEventLoop.now
+                    timeout = (delay > 0) ? Int32(min(ceil(delay * 1000), Double(Int32.max))) : 0
+                }
+                if (wakeup[0] < 0) && ((timeout < 0) || (timeout > 10)) {
+                    timeout = 10 // pipe() failed: look for completions every 10 ms
+                }
+                if (timeout != 0) {
+                    var fds = pollfd(fd: wakeup[0], events: Int16(POLLIN), revents: 0)
+                    _ = poll(&fds, 1, timeout)
+                }
+                // Completions are taken at the top of the loop; the bytes only wake it up:
+                var buffer = [UInt8](repeating: 0, count: 64)
+                while (read(wakeup[0], &buffer, buffer.count) > 0) { }
             }
-            return -1
         }
-        gateway?.setObject(writeFile, forKeyedSubscript: "writeFile" as NSString)
-        let writeFileBase64: @convention(block) (String, String) -> Int = { filePath, content in
-            do {
-                if let data = Data(base64Encoded: content, options: .ignoreUnknownCharacters) {
-                    try data.write(to: URL(fileURLWithPath: filePath))
-                    return 0
+        fflush(thread_stdout)
+        fflush(thread_stderr)
+    }
+}
+
+// Files read by jsc (scripts, url-polyfill.js, require_jscore.js), kept in memory
+// as long as their modification date and size don't change. In a shell loop calling
+// jsc on the same script, only the first call reads and decodes the file.
+class JSCSourceCache {
+    static let shared = JSCSourceCache()
+    private let queue = DispatchQueue(label: "jscSourceCache")
+    private var sources: [String: (modified: Date, size: UInt64, content: String)] = [:]
+    private var recent: [String] = [] // least recently used first
+    let maximumCount = 64
+
+    func source(path: String) throws -> String {
+        let attributes = try FileManager().attributesOfItem(atPath: path)
+        let modified = attributes[FileAttributeKey.modificationDate] as? Date ?? Date.distantPast
+        let size = attributes[FileAttributeKey.size] as? UInt64 ?? 0
+        let cached = queue.sync { () -> String? in
+            if let entry = sources[path], (entry.modified == modified) && (entry.size == size) {
+                if let index = recent.firstIndex(of: path) {
+                    recent.remove(at: index)
                 }
+                recent.append(path)
+                return entry.content
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
-            }
-            return -1
+            return nil
         }
-        gateway?.setObject(writeFileBase64, forKeyedSubscript: "writeFileBase64" as NSString)
-
-        let listFiles: @convention(block) (String) -> [String] = { directory in
-            do {
-                return try FileManager().contentsOfDirectory(atPath: directory)
+        if (cached != nil) {
+            return cached!
+        }
+        let content = try String(contentsOf: URL(fileURLWithPath: path), encoding: String.Encoding.utf8)
+        queue.sync {
+            if (sources[path] == nil) && (sources.count >= maximumCount) && (recent.count > 0) {
+                sources.removeValue(forKey: recent.removeFirst())
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
+            if let index = recent.firstIndex(of: path) {
+                recent.remove(at: index)
             }
-            return []
+            sources[path] = (modified: modified, size: size, content: content)
+            recent.append(path)
         }
-        gateway?.setObject(listFiles, forKeyedSubscript: "listFiles" as NSString)
+        return content
+    }
 
-        let isFile: @convention(block) (String) -> Bool = { filePath in
-            var isDirectory: ObjCBool = false
-            let isFile = FileManager().fileExists(atPath: filePath, isDirectory: &isDirectory)
-            return isFile && !isDirectory.boolValue
+    func bundleSource(resource: String) -> String? {
+        if let url = Bundle.main.url(forResource: resource, withExtension: "js") {
+            return try? source(path: url.path)
         }
-        gateway?.setObject(isFile, forKeyedSubscript: "isFile" as NSString)
-        
-        let isDirectory: @convention(block) (String) -> Bool = { path in
-            var isDirectory: ObjCBool = false
-            let isFile = FileManager().fileExists(atPath: path, isDirectory: &isDirectory)
-            return isFile && isDirectory.boolValue
+        return nil
+    }
+}
+
+// fopen-style modes for jsc.openFile(), in jsc and in the WebView:
+func openFlags(mode: String) -> Int32? {
+    switch (mode) {
+    case "r": return O_RDONLY
+    case "r+": return O_RDWR
+    case "w": return O_WRONLY | O_CREAT | O_TRUNC
+    case "w+": return O_RDWR | O_CREAT | O_TRUNC
+    case "a": return O_WRONLY | O_CREAT | O_APPEND
+    case "a+": return O_RDWR | O_CREAT | O_APPEND
+    default: return nil
+    }
+}
+
+// The functions available to scripts (jsc.readFile, print, console.log...).
+// They don't capture a context: errors are sent to JSContext.current(), so the same
+// blocks are shared by all contexts.
+enum JSCBootstrap {
+    static func raise(_ error: Error) {
+        if let context = JSContext.current() {
+            context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
         }
-        gateway?.setObject(isDirectory, forKeyedSubscript: "isDirectory" as NSString)
+    }
 
-        let createDirectory: @convention(block) (String) -> Int = { path in
-            do {
-                try FileManager().createDirectory(atPath: path, withIntermediateDirectories: true)
-                return 0
-            }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
-                return -1
+    static let exceptionHandler: (JSContext?, JSValue?) -> Void = { context, exception in
+        let line = exception!.objectForKeyedSubscript("line").toString()
+        let column = exception!.objectForKeyedSubscript("column").toString()
+        let stacktrace = exception!.objectForKeyedSubscript("stack").toString()
+        let unknown = "<unknown>"
+        fputs("jsc: Error ", thread_stderr)
+        if let currentFilename = context?.evaluateScript("if (typeof __filename !== 'undefined') { __filename }") {
+            if (!currentFilename.isUndefined) {
+                let file = currentFilename.toString()
+                fputs("in file " + (file ?? unknown) + " ", thread_stderr)
             }
         }
-        gateway?.setObject(createDirectory, forKeyedSubscript: "makeFolder" as NSString)
-        let delete: @convention(block) (String) -> Int = { path in
-            do {
-                try FileManager().removeItem(atPath: path)
-                return 0
-            }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
-                return -1
-            }
+        fputs("at line " + (line ?? unknown), thread_stderr)
+        fputs(", column: " + (column ?? unknown) + ": ", thread_stderr)
+        fputs(exception!.toString() + "\n", thread_stderr)
+        if (stacktrace != nil) {
+            fputs("jsc: Full stack: " + stacktrace! + "\n", thread_stderr)
         }
-        gateway?.setObject(delete, forKeyedSubscript: "delete" as NSString)
-        let move: @convention(block) (String, String) -> Int = { pathA, pathB in
-            do {
-                try FileManager().moveItem(atPath: pathA, toPath: pathB)
+    }
+
+    // Key functions: print, println, console.log:
+    static let print: @convention(block) (String) -> Void = { string in
+        fputs(string, thread_stdout)
+    }
+    static let println: @convention(block) (String) -> Void = { string in
+        fputs(string + "\n", thread_stdout)
+    }
+    static let consoleLog: @convention(block) (String) -> Void = { message in
+        fputs("console.log: " + message + "\n", thread_stderr)
+    }
+    // We also need performance.now (returns float in milliseconds):
+    static let performance_now: @convention(block) () -> Double = {
+        return Date().timeIntervalSince1970 * 1000.0
+    }
+
+    // JSC extensions: readFile, writeFile...
+    static let readFile: @convention(block) (String) -> String = { string in
+        do {
+            return try String(contentsOf: URL(fileURLWithPath: string), encoding: String.Encoding.utf8)
+        }
+        catch {
+            raise(error)
+        }
+        return ""
+    }
+    static let readFileBase64: @convention(block) (String) -> String = { string in
+        do {
+            return try NSData(contentsOf: URL(fileURLWithPath: string)).base64EncodedString()
+        }
+        catch {
+            raise(error)
+        }
+        return ""
+    }
+    static let writeFile: @convention(block) (String, String) -> Int = { filePath, content in
+        do {
+            try content.write(toFile: filePath, atomically: true, encoding: String.Encoding.utf8)
+            return 0
+        }
+        catch {
+            raise(error)
+        }
+        return -1
+    }
+    static let writeFileBase64: @convention(block) (String, String) -> Int = { filePath, content in
+        do {
+            if let data = Data(base64Encoded: content, options: .ignoreUnknownCharacters) {
+                try data.write(to: URL(fileURLWithPath: filePath))
                 return 0
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
-            }
+        }
+        catch {
+            raise(error)
+        }
+        return -1
+    }
+    static let listFiles: @convention(block) (String) -> [String] = { directory in
+        do {
+            return try FileManager().contentsOfDirectory(atPath: directory)
+        }
+        catch {
+            raise(error)
+        }
+        return []
+    }
+    static let isFile: @convention(block) (String) -> Bool = { filePath in
+        var isDirectory: ObjCBool = false
+        let isFile = FileManager().fileExists(atPath: filePath, isDirectory: &isDirectory)
+        return isFile && !isDirectory.boolValue
+    }
+    static let isDirectory: @convention(block) (String) -> Bool = { path in
+        var isDirectory: ObjCBool = false
+        let isFile = FileManager().fileExists(atPath: path, isDirectory: &isDirectory)
+        return isFile && isDirectory.boolValue
+    }
+    static let createDirectory: @convention(block) (String) -> Int = { path in
+        do {
+            try FileManager().createDirectory(atPath: path, withIntermediateDirectories: true)
+            return 0
+        }
+        catch {
+            raise(error)
             return -1
         }
-        gateway?.setObject(move, forKeyedSubscript: "move" as NSString)
-        let copy: @convention(block) (String, String) -> Int = { pathA, pathB in
-            do {
-                try FileManager().copyItem(atPath: pathA, toPath: pathB)
-                return 0
+    }
+    static let delete: @convention(block) (String) -> Int = { path in
+        do {
+            try FileManager().removeItem(atPath: path)
+            return 0
+        }
+        catch {
+            raise(error)
+            return -1
+        }
+    }
+    static let move: @convention(block) (String, String) -> Int = { pathA, pathB in
+        do {
+            try FileManager().moveItem(atPath: pathA, toPath: pathB)
+            return 0
+        }
+        catch {
+            raise(error)
+        }
+        return -1
+    }
+    static let copy: @convention(block) (String, String) -> Int = { pathA, pathB in
+        do {
+            try FileManager().copyItem(atPath: pathA, toPath: pathB)
+            return 0
+        }
+        catch {
+            raise(error)
+        }
+        return -1
+    }
+    static let fileSize: @convention(block) (String) -> UInt64 = { path in
+        do {
+            //return [FileAttributeKey : Any]
+            let attr = try FileManager.default.attributesOfItem(atPath: path)
+            return attr[FileAttributeKey.size] as? UInt64 ?? 0
+        } catch {
+            raise(error)
+            return 0
+        }
+    }
+    static let system: @convention(block) (String) -> Int32 = { command in
+        let pid = ios_fork()
+        var result = ios_system(command)
+        ios_waitpid(pid)
+        ios_releaseThreadId(pid)
+        if (result == 0) {
+            // If there's already been an error (e.g. "command not found") no need to ask for more.
+            result = ios_getCommandStatus()
+        }
+        return result
+    }
+
+    // Binary files: ArrayBuffers and typed arrays are read and written in place, without
+    // going through a String or base64. Large files can be processed in chunks with
+    // jsc.openFile(), which works directly on a file descriptor.
+    static func raise(path: String) {
+        if let context = JSContext.current() {
+            let message = String(cString: strerror(errno)) + ": " + path
+            context.exception = JSValue(newErrorFromMessage: message, in: context)
+        }
+        errno = 0
+    }
+
+    // The memory of an ArrayBuffer or a typed array (or the UTF-8 bytes of a string),
+    // without copying it. nil for anything else.
+    static func withBytes<T>(of value: JSValue, _ body: (UnsafeMutableRawBufferPointer) -> T) -> T? {
+        guard let context = value.context else { return nil }
+        let ctx = context.jsGlobalContextRef
+        var exception: JSValueRef? = nil
+        let type = JSValueGetTypedArrayType(ctx, value.jsValueRef, &exception)
+        if (type == kJSTypedArrayTypeArrayBuffer) {
+            let object = JSValueToObject(ctx, value.jsValueRef, &exception)
+            let bytes = JSObjectGetArrayBufferBytesPtr(ctx, object, &exception)
+            let length = JSObjectGetArrayBufferByteLength(ctx, object, &exception)
+            return body(UnsafeMutableRawBufferPointer(start: bytes, count: length))
+        } else if (type != kJSTypedArrayTypeNone) {
+            let object = JSValueToObject(ctx, value.jsValueRef, &exception)
+            // This is the start of the underlying buffer, not of the view:
+            let bytes = JSObjectGetTypedArrayBytesPtr(ctx, object, &exception)
+            let offset = JSObjectGetTypedArrayByteOffset(ctx, object, &exception)
+            let length = JSObjectGetTypedArrayByteLength(ctx, object, &exception)
+            return body(UnsafeMutableRawBufferPointer(start: bytes?.advanced(by: offset), count: length))
+        } else if (value.isString) {
+            var bytes = Array((value.toString() ?? "").utf8)
+            return bytes.withUnsafeMutableBytes { body($0) }
+        }
+        return nil
+    }
+
+    // An ArrayBuffer that owns bytes (allocated with malloc):
+    static func makeArrayBuffer(bytes: UnsafeMutableRawPointer, count: Int, in context: JSContext) -> JSValue {
+        var exception: JSValueRef? = nil
+        let object = JSObjectMakeArrayBufferWithBytesNoCopy(context.jsGlobalContextRef, bytes, count,
+                                                            { bytes, _ in free(bytes) }, nil, &exception)
+        return JSValue(jsValueRef: object, in: context)
+    }
+
+    // Errors of another type than Error (TypeError, RangeError...):
+    static func raise(_ type: String, message: String) {
+        if let context = JSContext.current() {
+            context.exception = context.objectForKeyedSubscript(type).construct(withArguments: [message])
+        }
+    }
+
+    // Optional numeric arguments (undefined or null if absent). Anything else must be a number
+    // between -2^53 and 2^53 (Number.MAX_SAFE_INTEGER, as in node), so that it fits in an off_t.
+    // Otherwise, sets a TypeError or a RangeError as the exception and returns nil.
+    // Fractions are dropped, as with Math.trunc.
+    static func integer(_ value: JSValue, default defaultValue: Int64, name: String) -> Int64? {
+        if (value.isUndefined || value.isNull) {
+            return defaultValue
+        }
+        if (!value.isNumber) {
+            raise("TypeError", message: "The \"\(name)\" argument must be a number. Received \(value.toString() ?? "")")
+            return nil
+        }
+        let number = value.toDouble()
+        if (!number.isFinite || abs(number) > 9007199254740991) {
+            raise("RangeError", message: "The value of \"\(name)\" is out of range. It must be an integer. Received \(value.toString() ?? "")")
+            return nil
+        }
+        return Int64(number)
+    }
+
+    // read, or pread if position >= 0. Stops at end of file or when buffer is full.
+    static func readFully(_ fd: Int32, _ buffer: UnsafeMutableRawBufferPointer, position: Int64) -> Int {
+        var total = 0
+        while (total < buffer.count) {
+            let remaining = buffer.count - total
+            let pointer = buffer.baseAddress!.advanced(by: total)
+            let count = (position >= 0) ? pread(fd, pointer, remaining, off_t(position) + off_t(total)) : read(fd, pointer, remaining)
+            if (count < 0) {
+                if (errno == EINTR) { continue }
+                return (total > 0) ? total : -1
             }
-            catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
+            if (count == 0) { break }
+            total += count
+        }
+        return total
+    }
+
+    static func writeFully(_ fd: Int32, _ buffer: UnsafeMutableRawBufferPointer, position: Int64) -> Int {
+        var total = 0
+        while (total < buffer.count) {
+            let remaining = buffer.count - total
+            let pointer = buffer.baseAddress!.advanced(by: total)
+            let count = (position >= 0) ? pwrite(fd, pointer, remaining, off_t(position) + off_t(total)) : write(fd, pointer, remaining)
+            if (count < 0) {
+                if (errno == EINTR) { continue }
+                return -1
             }
+            total += count
+        }
+        return total
+    }
+
+    // jsc.readBytes(path, offset, length): ArrayBuffer. By default, the whole file from offset.
+    static let readBytes: @convention(block) (String, JSValue, JSValue) -> JSValue? = { path, offsetValue, lengthValue in
+        guard let context = JSContext.current(),
+              let offsetArgument = integer(offsetValue, default: 0, name: "offset"),
+              let requestedLength = integer(lengthValue, default: -1, name: "length") else { return nil }
+        let fd = open(path, O_RDONLY)
+        if (fd < 0) {
+            raise(path: path)
+            return nil
+        }
+        defer { close(fd) }
+        var info = stat()
+        fstat(fd, &info)
+        let offset = max(offsetArgument, 0)
+        let available = max(Int64(info.st_size) - offset, 0)
+        let length = Int((requestedLength < 0) ? available : min(requestedLength, available))
+        let bytes = malloc(max(length, 1))!
+        let count = readFully(fd, UnsafeMutableRawBufferPointer(start: bytes, count: length), position: offset)
+        if (count < 0) {
+            free(bytes)
+            raise(path: path)
+            return nil
+        }
+        return makeArrayBuffer(bytes: bytes, count: count, in: context)
+    }
+
+    static func writeBytes(path: String, data: JSValue, flags: Int32) -> Int {
+        let fd = open(path, flags, 0o644)
+        if (fd < 0) {
+            raise(path: path)
             return -1
         }
-        gateway?.setObject(copy, forKeyedSubscript: "copy" as NSString)
+        defer { close(fd) }
+        let count = withBytes(of: data) { writeFully(fd, $0, position: -1) }
+        if (count == nil) {
+            JSCBootstrap.raise(NSError(domain: NSPOSIXErrorDomain, code: Int(EINVAL),
+                                       userInfo: [NSLocalizedDescriptionKey: "data must be an ArrayBuffer, a typed array or a string"]))
+            return -1
+        } else if (count! < 0) {
+            raise(path: path)
+            return -1
+        }
+        return 0
+    }
+    // jsc.writeBytes(path, data), jsc.appendBytes(path, data): data is an ArrayBuffer, a typed array or a string.
+    static let writeBytesFunction: @convention(block) (String, JSValue) -> Int = { path, data in
+        return writeBytes(path: path, data: data, flags: O_WRONLY | O_CREAT | O_TRUNC)
+    }
+    static let appendBytes: @convention(block) (String, JSValue) -> Int = { path, data in
+        return writeBytes(path: path, data: data, flags: O_WRONLY | O_CREAT | O_APPEND)
+    }
 
-        let fileSize: @convention(block) (String) -> UInt64 = { path in
-            do {
-                //return [FileAttributeKey : Any]
-                let attr = try FileManager.default.attributesOfItem(atPath: path)
-                return attr[FileAttributeKey.size] as? UInt64 ?? 0
-            } catch {
-                context.exception = JSValue(newErrorFromMessage: error.localizedDescription, in: context)
-                return 0
-            }
+    // File descriptors, used by jsc.openFile() (defined in JavaScript below):
+    static let openFunction: @convention(block) (String, String) -> Int32 = { path, mode in
+        guard let flags = openFlags(mode: mode) else {
+            errno = EINVAL
+            raise(path: path)
+            return -1
         }
-        gateway?.setObject(fileSize, forKeyedSubscript: "fileSize" as NSString)
-        
-        let system: @convention(block) (String) -> Int32 = { command in
+        let fd = open(path, flags, 0o644)
+        if (fd < 0) {
+            raise(path: path)
+        }
+        return fd
+    }
+    // jsc._read(fd, buffer, position): reads into buffer, returns the number of bytes read (0 at the end of the file)
+    static let readFunction: @convention(block) (Int32, JSValue, JSValue) -> Int = { fd, buffer, positionValue in
+        guard let position = integer(positionValue, default: -1, name: "position") else { return -1 }
+        let count = withBytes(of: buffer) { readFully(fd, $0, position: position) } ?? -1
+        if (count < 0) {
+            raise(path: "fd \(fd)")
+        }
+        return count
+    }
+    static let writeFunction: @convention(block) (Int32, JSValue, JSValue) -> Int = { fd, data, positionValue in
+        guard let position = integer(positionValue, default: -1, name: "position") else { return -1 }
+        let count = withBytes(of: data) { writeFully(fd, $0, position: position) } ?? -1
+        if (count < 0) {
+            raise(path: "fd \(fd)")
+        }
+        return count
+    }
+    static let seekFunction: @convention(block) (Int32, JSValue, Int32) -> Double = { fd, offsetValue, whence in
+        guard let offset = integer(offsetValue, default: 0, name: "offset") else { return -1 }
+        let position = lseek(fd, off_t(offset), whence)
+        if (position < 0) {
+            raise(path: "fd \(fd)")
+        }
+        return Double(position)
+    }
+    static let closeFunction: @convention(block) (Int32) -> Int32 = { fd in
+        let result = close(fd)
+        if (result < 0) {
+            raise(path: "fd \(fd)")
+        }
+        return result
+    }
+    // Asynchronous versions, returning a Promise. The work is done outside of the command
+    // thread, and the event loop keeps the command alive until the Promise is settled.
+    static func posixError(path: String) -> NSError {
+        let message = String(cString: strerror(errno)) + ": " + path
+        return NSError(domain: NSPOSIXErrorDomain, code: Int(errno), userInfo: [NSLocalizedDescriptionKey: message])
+    }
+    static let readFileAsync: @convention(block) (String) -> JSValue? = { path in
+        guard let context = JSContext.current(), let loop = JSCEventLoop.current else { return nil }
+        return loop.submit(in: context, work: {
+            try String(contentsOf: URL(fileURLWithPath: path), encoding: String.Encoding.utf8)
+        }, convert: { content, context in
+            JSValue(object: content, in: context)
+        })
+    }
+    static let readBytesAsync: @convention(block) (String, JSValue, JSValue) -> JSValue? = { path, offsetValue, lengthValue in
+        guard let context = JSContext.current(), let loop = JSCEventLoop.current,
+              let offsetArgument = integer(offsetValue, default: 0, name: "offset"),
+              let requestedLength = integer(lengthValue, default: -1, name: "length") else { return nil }
+        let offset = max(offsetArgument, 0)
+        return loop.submit(in: context, work: { () -> (UnsafeMutableRawPointer, Int) in
+            let fd = open(path, O_RDONLY)
+            if (fd < 0) {
+                throw posixError(path: path)
+            }
+            defer { close(fd) }
+            var info = stat()
+            fstat(fd, &info)
+            let available = max(Int64(info.st_size) - offset, 0)
+            let length = Int((requestedLength < 0) ? available : min(requestedLength, available))
+            let bytes = malloc(max(length, 1))!
+            let count = readFully(fd, UnsafeMutableRawBufferPointer(start: bytes, count: length), position: offset)
+            if (count < 0) {
+                let error = posixError(path: path)
+                free(bytes)
+                throw error
+            }
+            return (bytes, count)
+        }, convert: { result, context in
+            makeArrayBuffer(bytes: result.0, count: result.1, in: context)
+        })
+    }
+    static let writeFileAsync: @convention(block) (String, String) -> JSValue? = { path, content in
+        guard let context = JSContext.current(), let loop = JSCEventLoop.current else { return nil }
+        return loop.submit(in: context, work: { () -> Int in
+            try content.write(toFile: path, atomically: true, encoding: String.Encoding.utf8)
+            return 0
+        }, convert: { result, context in
+            JSValue(int32: Int32(result), in: context)
+        })
+    }
+    static let systemAsync: @convention(block) (String) -> JSValue? = { command in
+        guard let context = JSContext.current(), let loop = JSCEventLoop.current else { return nil }
+        return loop.submit(in: context, work: { () -> Int32 in
             let pid = ios_fork()
             var result = ios_system(command)
             ios_waitpid(pid)
             ios_releaseThreadId(pid)
             if (result == 0) {
-                // If there's already been an error (e.g. "command not found") no need to ask for more.
                 result = ios_getCommandStatus()
             }
             return result
+        }, convert: { result, context in
+            JSValue(int32: result, in: context)
+        })
+    }
+    // The same object is returned by jsc.openFile() in wasm.html:
+    static let fileHandleScript = """
+    jsc.openFile = function(path, mode) {
+        var fd = jsc._open(path, mode || "r");
+        var toBytes = function(data) {
+            if (ArrayBuffer.isView(data) && !(data instanceof DataView)) { return data; }
+            if (data instanceof DataView) { return new Uint8Array(data.buffer, data.byteOffset, data.byteLength); }
+            return data;
+        };
+        return {
+            fd: fd,
+            // read(length, position): Uint8Array, empty at the end of the file.
+            // Without a length, reads to the end of the file.
+            read: function(length, position) {
+                if (length != undefined) {
+                    var buffer = new Uint8Array(length);
+                    return buffer.subarray(0, jsc._read(fd, buffer, position));
+                }
+                var chunks = [];
+                var total = 0;
+                while (true) {
+                    var chunk = new Uint8Array(65536);
+                    var count = jsc._read(fd, chunk, (position == undefined) ? position : position + total);
+                    if (count <= 0) { break; }
+                    chunks.push(chunk.subarray(0, count));
+                    total += count;
+                }
+                var bytes = new Uint8Array(total);
+                var offset = 0;
+                chunks.forEach(function(chunk) {
+                    bytes.set(chunk, offset);
+                    offset += chunk.length;
+                });
+                return bytes;
+            },
+            // readInto(buffer, position): number of bytes read
+            readInto: function(buffer, position) { return jsc._read(fd, toBytes(buffer), position); },
+            write: function(data, position) { return jsc._write(fd, toBytes(data), position); },
+            seek: function(offset, whence) { return jsc._seek(fd, offset, whence || 0); },
+            tell: function() { return jsc._seek(fd, 0, 1); },
+            close: function() { return jsc._close(fd); },
+        };
+    };
+    """
+
+    // A new context, with everything set up before the user script runs:
+    static func makeContext() -> JSContext {
+        let context = JSContext()!
+        JSCEventLoop.registerInto(jsContext: context) // for setTimeout
+        context.exceptionHandler = exceptionHandler
+        // create basic variables
+        context.evaluateScript(
+            "const global = (() => this)();\n" +
+            "global.jsc = { };\n" +
+            "global.document = { baseURI: \"/\" };\n" +
+            "self = this;\n")
+        let gateway = context.objectForKeyedSubscript("jsc" as NSString)
+        context.setObject(print, forKeyedSubscript: "print" as NSString)
+        context.setObject(println, forKeyedSubscript: "println" as NSString)
+        // console.log
+        context.evaluateScript("var console = { log: function(message) { _consoleLog(message) } }")
+        context.setObject(consoleLog, forKeyedSubscript: "_consoleLog" as NSString)
+        // Add URL type using url-polyfill:
+        if let urlContent = JSCSourceCache.shared.bundleSource(resource: "url-polyfill") {
+            context.evaluateScript(urlContent) // Now we have URL type
+            context.evaluateScript("var location = new URL(\"" + Bundle.main.bundlePath + "/wasm.html\");")
         }
+        gateway?.setObject(readFile, forKeyedSubscript: "readFile" as NSString)
+        gateway?.setObject(readFileBase64, forKeyedSubscript: "readFileBase64" as NSString)
+        gateway?.setObject(writeFile, forKeyedSubscript: "writeFile" as NSString)
+        gateway?.setObject(writeFileBase64, forKeyedSubscript: "writeFileBase64" as NSString)
+        gateway?.setObject(listFiles, forKeyedSubscript: "listFiles" as NSString)
+        gateway?.setObject(isFile, forKeyedSubscript: "isFile" as NSString)
+        gateway?.setObject(isDirectory, forKeyedSubscript: "isDirectory" as NSString)
+        gateway?.setObject(createDirectory, forKeyedSubscript: "makeFolder" as NSString)
+        gateway?.setObject(delete, forKeyedSubscript: "delete" as NSString)
+        gateway?.setObject(move, forKeyedSubscript: "move" as NSString)
+        gateway?.setObject(copy, forKeyedSubscript: "copy" as NSString)
+        gateway?.setObject(fileSize, forKeyedSubscript: "fileSize" as NSString)
         gateway?.setObject(system, forKeyedSubscript: "system" as NSString)
-
+        gateway?.setObject(readBytes, forKeyedSubscript: "readBytes" as NSString)
+        gateway?.setObject(writeBytesFunction, forKeyedSubscript: "writeBytes" as NSString)
+        gateway?.setObject(appendBytes, forKeyedSubscript: "appendBytes" as NSString)
+        gateway?.setObject(openFunction, forKeyedSubscript: "_open" as NSString)
+        gateway?.setObject(readFunction, forKeyedSubscript: "_read" as NSString)
+        gateway?.setObject(writeFunction, forKeyedSubscript: "_write" as NSString)
+        gateway?.setObject(seekFunction, forKeyedSubscript: "_seek" as NSString)
+        gateway?.setObject(closeFunction, forKeyedSubscript: "_close" as NSString)
+        gateway?.setObject(readFileAsync, forKeyedSubscript: "readFileAsync" as NSString)
+        gateway?.setObject(readBytesAsync, forKeyedSubscript: "readBytesAsync" as NSString)
+        gateway?.setObject(writeFileAsync, forKeyedSubscript: "writeFileAsync" as NSString)
+        gateway?.setObject(systemAsync, forKeyedSubscript: "systemAsync" as NSString)
+        context.evaluateScript(fileHandleScript)
         // Load require:
-        if let requireUrl = Bundle.main.url(forResource: "require_jscore", withExtension: "js") {
-            if let data = try? Data(contentsOf: requireUrl) {
-                let content = String(decoding: data, as: UTF8.self)
-                context.evaluateScript(content) // Now we should have require()
-            }
+        if let content = JSCSourceCache.shared.bundleSource(resource: "require_jscore") {
+            context.evaluateScript(content) // Now we should have require()
         }
-        
         // Extra things for WebAssembly:
-        // We also need performance.now (returns float in milliseconds):
-        let performance_now: @convention(block) () -> Double = {
-            return Date().timeIntervalSince1970 * 1000.0
-        }
         context.setObject(performance_now, forKeyedSubscript: "_performance_now" as NSString)
         context.evaluateScript("performance = {now: _performance_now };\n")
-        
+        return context
+    }
+}
+
+// Contexts with the bootstrap already applied, ready for the next jsc command.
+// A context runs only one script: top-level let/const/class declarations can't be
+// removed from a JSC global object, so the way to reset a context is to replace it.
+// Each time one is taken, a new one is prepared in the background while the script
+// runs, so the next call (e.g. in a shell loop) doesn't wait for it.
+class JSContextPool {
+    static let shared = JSContextPool()
+    private let queue = DispatchQueue(label: "jscContextPool")
+    private let warmingQueue = DispatchQueue(label: "jscContextWarming", qos: .utility)
+    private var ready: [JSContext] = []
+    private var warming = 0
+    // Each context has its own virtual machine (a few MB), and jsc_core also runs in extensions:
+    let capacity = 1
+
+    func acquire() -> JSContext {
+        let context = queue.sync { ready.popLast() }
+        refill()
+        return context ?? JSCBootstrap.makeContext()
+    }
+
+    func refill() {
+        let missing = queue.sync { () -> Int in
+            let missing = capacity - ready.count - warming
+            if (missing > 0) {
+                warming += missing
+            }
+            return missing
+        }
+        if (missing <= 0) {
+            return
+        }
+        for _ in 0..<missing {
+            warmingQueue.async {
+                let context = JSCBootstrap.makeContext()
+                self.queue.sync {
+                    self.warming -= 1
+                    self.ready.append(context)
+                }
+            }
+        }
+    }
+
+    // Release the prepared contexts (memory warning, app going to background):
+    func drain() {
+        queue.sync {
+            ready.removeAll()
+        }
+    }
+}
+
+// TODO:
+// add searching for modules in ~/Library and ~/Documents
+// npm to install new modules (not parcel, though)
+
+// execute JavaScript files using JavaScriptCore instead of WkWebView:
+public func jsc_core(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointer<Int8>?>?) -> Int32 {
+    guard let args = convertCArguments(argc: argc, argv: argv) else {
+        printUsage(command: "jsc")
+        return 0
+    }
+    if (argc != 2) {
+        printUsage(command: args[0])
+        return 0
+    }
+    let command = args[1]
+    
+    // let fileName = FileManager().currentDirectoryPath + "/" + command
+    let fileName = command.hasPrefix("/") ? command : FileManager().currentDirectoryPath + "/" + command
+    do {
+        let javascript = try JSCSourceCache.shared.source(path: fileName)
+        let context = JSContextPool.shared.acquire()
+        let loop = JSCEventLoop()
+        context.setObject(loop, forKeyedSubscript: "_eventLoop" as NSString)
         // actual script execution:
-        if let result = context.evaluateScript(javascript) {
+        if let result = context.evaluateScript(javascript, withSourceURL: URL(fileURLWithPath: fileName)) {
             if (!result.isUndefined) {
                 let string = result.toString()
                 fputs(string, thread_stdout)
@@ -328,6 +954,8 @@ public func jsc_core(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointe
                 fflush(thread_stderr)
             }
         }
+        // timers, Promises and asynchronous operations started by the script:
+        loop.run()
     }
     catch {
         fputs("Error executing JavaScript  file: " + command + ": \(error.localizedDescription) \n", thread_stderr)
@@ -335,3 +963,123 @@ public func jsc_core(argc: Int32, argv: UnsafeMutablePointer<UnsafeMutablePointe
     }
     return 0
 }
+
+// Batched host calls for the jsc object of wasm.html: one crossing for a list of
+// operations, [name, arguments...], instead of one prompt() per call. Each operation
+// gets {value: result} or {error: message}.
+// jsc.batch() sends them through prompt("jsc\nbatch\n..."), jsc.batchAsync() through
+// the "jscHost" message handler, which doesn't block the page.
+enum JSCHostCalls {
+    static func string(_ arguments: [Any], _ index: Int) throws -> String {
+        guard (index < arguments.count), let value = arguments[index] as? String else {
+            throw NSError(domain: NSPOSIXErrorDomain, code: Int(EINVAL),
+                          userInfo: [NSLocalizedDescriptionKey: "argument \(index + 1) must be a string"])
+        }
+        return value
+    }
+
+    // Relative paths are resolved here, since the operations may run outside of the session:
+    static func path(_ arguments: [Any], _ index: Int, directory: String) throws -> String {
+        let path = try string(arguments, index)
+        return path.hasPrefix("/") ? path : directory + "/" + path
+    }
+
+    // Same operations as the "jsc" prompts in SceneDelegate:
+    static func perform(_ name: String, _ arguments: [Any], directory: String) throws -> Any {
+        switch (name) {
+        case "readFile":
+            let url = URL(fileURLWithPath: try path(arguments, 0, directory: directory))
+            if let content = try? String(contentsOf: url, encoding: .utf8) {
+                return content
+            }
+            return try String(contentsOf: url, encoding: .ascii)
+        case "readFileBase64":
+            return try NSData(contentsOf: URL(fileURLWithPath: try path(arguments, 0, directory: directory))).base64EncodedString()
+        case "writeFile":
+            try string(arguments, 1).write(toFile: try path(arguments, 0, directory: directory), atomically: true, encoding: .utf8)
+            return 0
+        case "writeFileBase64":
+            guard let data = Data(base64Encoded: try string(arguments, 1), options: .ignoreUnknownCharacters) else {
+                throw NSError(domain: NSPOSIXErrorDomain, code: Int(EINVAL), userInfo: [NSLocalizedDescriptionKey: "invalid base64 content"])
+            }
+            try data.write(to: URL(fileURLWithPath: try path(arguments, 0, directory: directory)))
+            return 0
+        case "listFiles":
+            return try FileManager().contentsOfDirectory(atPath: try path(arguments, 0, directory: directory))
+        case "isFile", "isDirectory":
+            var isDirectory: ObjCBool = false
+            let exists = FileManager().fileExists(atPath: try path(arguments, 0, directory: directory), isDirectory: &isDirectory)
+            return exists && (isDirectory.boolValue == (name == "isDirectory"))
+        case "makeFolder":
+            try FileManager().createDirectory(atPath: try path(arguments, 0, directory: directory), withIntermediateDirectories: true)
+            return 0
+        case "delete", "deleteFile":
+            try FileManager().removeItem(atPath: try path(arguments, 0, directory: directory))
+            return 0
+        case "move":
+            try FileManager().moveItem(atPath: try path(arguments, 0, directory: directory), toPath: try path(arguments, 1, directory: directory))
+            return 0
+        case "copy":
+            try FileManager().copyItem(atPath: try path(arguments, 0, directory: directory), toPath: try path(arguments, 1, directory: directory))
+            return 0
+        case "fileSize", "getFileSize":
+            let attr = try FileManager.default.attributesOfItem(atPath: try path(arguments, 0, directory: directory))
+            return attr[FileAttributeKey.size] as? UInt64 ?? 0
+        default:
+            // system needs the terminal, it stays a separate prompt:
+            throw NSError(domain: NSPOSIXErrorDomain, code: Int(ENOTSUP),
+                          userInfo: [NSLocalizedDescriptionKey: "\(name): not available in jsc.batch"])
+        }
+    }
+
+    static func perform(batch: Any?, directory: String) -> [[String: Any]] {
+        guard let operations = batch as? [Any] else {
+            return [["error": "jsc.batch: expected an array of operations"]]
+        }
+        return operations.map { operation in
+            guard let operation = operation as? [Any], let name = operation.first as? String else {
+                return ["error": "operation must be [name, arguments...]"]
+            }
+            do {
+                return ["value": try perform(name, Array(operation.dropFirst()), directory: directory)]
+            }
+            catch {
+                return ["error": error.localizedDescription]
+            }
+        }
+    }
+
+    // prompt("jsc\nbatch\n" + JSON): the results as JSON.
+    static func perform(json: String, directory: String) -> String {
+        let batch = try? JSONSerialization.jsonObject(with: Data(json.utf8))
+        let results = perform(batch: batch, directory: directory)
+        if let data = try? JSONSerialization.data(withJSONObject: results) {
+            return String(decoding: data, as: UTF8.self)
+        }
+        return "[]"
+    }
+}
+
+// jsc.batchAsync(): the operations run on a background queue, the page gets a Promise.
+class JSCHostCallHandler: NSObject, WKScriptMessageHandlerWithReply {
+    weak var delegate: SceneDelegate?
+    private let queue = DispatchQueue(label: "jscHostCalls", qos: .userInitiated)
+
+    init(delegate: SceneDelegate) {
+        self.delegate = delegate
+    }
+
+    func userContentController(_ userContentController: WKUserContentController, didReceive message: WKScriptMessage,
+                               replyHandler: @escaping (Any?, String?) -> Void) {
+        // On the main thread: get the directory of this window before leaving it.
+        delegate?.switchToSession()
+        let directory = FileManager().currentDirectoryPath
+        let batch = message.body
+        queue.async {
+            let results = JSCHostCalls.perform(batch: batch, directory: directory)
+            DispatchQueue.main.async {
+                replyHandler(results, nil)
+            }
+        }
+    }
+}
@@ -0,0 +1,192 @@
+#!/usr/bin/env node
+// Throughput benchmark for the fsevents watcher (FSEvents on macOS, inotify
+// on Linux) over a large tree.
+//
+// Builds a tree of --files files spread over --dirs directories (two levels
+// deep), then times, for each phase:
+//
+//   poll     One stat() of every file: what a polling watcher (chokidar with
+//            usePolling, fs.watchFile) pays per interval, changes or not.
+//   watch    start() until a file written in every directory has been
+//            reported: registering the watches.
+//   modify   Append to every file --writes times.
+//   rename   Rename every file in place.
+//   delete   Remove every file.
+//
+// For the last three: time until every path involved has been reported, the
+// number of events delivered, events per second and per change (coalescing),
+// and the number of events asking for a rescan (queue overflows or dropped
+// watches); after one of those, the phase ends once the watcher is quiet.
+//
+// Usage:
+//   node benchmarks/fsevents/bench.js [--files N] [--dirs N] [--writes N]
+//                                     [--tmp DIR]
+//
+// The fsevents addon must be built first:
+//   (cd Resources/node_modules/fsevents && node-gyp rebuild)
+
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const fsevents = require('../../Resources/node_modules/fsevents');
+const C = fsevents.Constants;
+
+function option(name, fallback) {
+  const index = process.argv.indexOf('--' + name);
+  return index > 0 ? process.argv[index + 1] : fallback;
+}
+
+const FILES = Number(option('files', 100000));
+const DIRS = Number(option('dirs', 1000));
+const WRITES = Number(option('writes', 2));
+const TOP = Math.max(1, Math.round(Math.sqrt(DIRS)));
+const QUIET_MS = 1000;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function makeTree(root) {
+  const dirs = [];
+  for (let d = 0; d < DIRS; d++) {
+    const dir = path.join(root, 't' + (d % TOP), 'd' + d);
+    fs.mkdirSync(dir, {recursive: true});
+    dirs.push(dir);
+  }
+  const files = [];
+  for (let f = 0; f < FILES; f++) {
+    const file = path.join(dirs[f % DIRS], 'f' + f + '.txt');
+    fs.writeFileSync(file, 'x');
+    files.push(file);
+  }
+  return {dirs, files};
+}
+
+// Collects raw events: paths reported, and how many events asked for a rescan.
+class Recorder {
+  constructor(watcher) {
+    this.events = 0;
+    this.rescans = 0;
+    // Set after any rescan: paths may go unreported from then on.
+    this.lossy = false;
+    this.last = 0;
+    this.waiting = null;
+    watcher.on('fsevent', (file, flags) => {
+      this.events++;
+      this.last = Date.now();
+      if (flags & (C.kFSEventStreamEventFlagMustScanSubDirs |
+                   C.kFSEventStreamEventFlagKernelDropped |
+                   C.kFSEventStreamEventFlagUserDropped)) {
+        this.rescans++;
+        this.lossy = true;
+      }
+      if (this.waiting && this.waiting.delete(file) && this.waiting.size == 0) {
+        this.done();
+      }
+    });
+  }
+
+  // Resolves with the number of paths not reported, once every path in
+  // `paths` has been, or after a rescan once no event came for QUIET_MS.
+  expect(paths) {
+    this.events = 0;
+    this.rescans = 0;
+    this.last = Date.now();
+    this.waiting = new Set(paths);
+    return new Promise((resolve) => {
+      const timer = setInterval(() => {
+        if (this.lossy && Date.now() - this.last > QUIET_MS) {
+          this.done();
+        }
+      }, 50);
+      this.done = () => {
+        clearInterval(timer);
+        const missed = this.waiting.size;
+        this.waiting = null;
+        resolve(missed);
+      };
+    });
+  }
+}
+
+async function phase(name, recorder, changes, paths, action) {
+  const done = recorder.expect(paths);
+  const start = process.hrtime.bigint();
+  action();
+  recorder.last = Date.now();
+  const missed = await done;
+  const ms = Number(process.hrtime.bigint() - start) / 1e6;
+  console.log(
+      `${name.padEnd(8)}${ms.toFixed(0).padStart(8)} ms` +
+      `${String(recorder.events).padStart(9)} events` +
+      `${(recorder.events / ms * 1000).toFixed(0).padStart(9)} events/s` +
+      `${(recorder.events / changes).toFixed(2).padStart(7)} events/change` +
+      `${String(recorder.rescans).padStart(4)} rescans` +
+      (missed ? `  (${missed} paths not reported)` : ''));
+}
+
+async function main() {
+  const tmp = option('tmp', os.tmpdir());
+  const root = fs.realpathSync(fs.mkdtempSync(path.join(tmp, 'fsevents-bench-')));
+  try {
+    let start = Date.now();
+    const {dirs, files} = makeTree(root);
+    console.log(`${FILES} files in ${DIRS} directories (${process.platform}), ` +
+                `created in ${Date.now() - start} ms`);
+
+    start = process.hrtime.bigint();
+    for (const file of files) {
+      fs.statSync(file);
+    }
+    console.log(`poll    ${(Number(process.hrtime.bigint() - start) / 1e6)
+        .toFixed(0).padStart(8)} ms per pass`);
+
+    const watcher = fsevents(root);
+    const recorder = new Recorder(watcher);
+    start = process.hrtime.bigint();
+    watcher.start();
+    // Nothing says when the watches are in place: write a probe in every
+    // directory until each one has been reported.
+    const probes = new Set(dirs.map((dir) => path.join(dir, '.probe')));
+    const seen = recorder.expect(probes);
+    let ready = false;
+    seen.then(() => ready = true);
+    while (!ready) {
+      for (const probe of recorder.waiting || []) {
+        fs.writeFileSync(probe, 'x');
+      }
+      await sleep(50);
+    }
+    console.log(`watch   ${(Number(process.hrtime.bigint() - start) / 1e6)
+        .toFixed(0).padStart(8)} ms` +
+        (recorder.rescans ? `  (${recorder.rescans} rescans: out of watches?)` : ''));
+    await sleep(QUIET_MS);
+
+    await phase('modify', recorder, FILES * WRITES, files, () => {
+      for (let w = 0; w < WRITES; w++) {
+        for (const file of files) {
+          fs.appendFileSync(file, 'y');
+        }
+      }
+    });
+    await sleep(QUIET_MS);
+
+    const renamed = files.map((file) => file.replace(/\.txt$/, '.md'));
+    await phase('rename', recorder, FILES, files.concat(renamed), () => {
+      files.forEach((file, i) => fs.renameSync(file, renamed[i]));
+    });
+    await sleep(QUIET_MS);
+
+    await phase('delete', recorder, FILES, renamed, () => {
+      for (const file of renamed) {
+        fs.unlinkSync(file);
+      }
+    });
+    watcher.stop();
+  } finally {
+    fs.rmSync(root, {recursive: true, force: true});
+  }
+}
+
+main();
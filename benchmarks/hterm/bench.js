@@ -0,0 +1,406 @@
+#!/usr/bin/env node
+// Headless benchmark for hterm's output path.
+//
+// Loads hterm_all.js into a minimal DOM (dom_shim.js) under Node and feeds
+// it the traces from corpus.js in pty sized chunks.  For every trace it
+// reports three phases:
+//
+//   parse   hterm.VT with a terminal that discards everything: the cost of
+//           decoding escape sequences alone.
+//   screen  hterm.Terminal.interpret with a real Terminal/Screen: parsing
+//           plus text attributes, row management and scrollback.
+//   dom     node creation and mutation counts during the screen phase, per
+//           MB of input.
+//
+// There is no layout or paint here, so numbers are only comparable with other
+// runs of this script, not with what WKWebView does on a device.  They are
+// meant to catch regressions and to compare changes to hterm_all.js.
+//
+// Usage:
+//   node benchmarks/hterm/bench.js [options]
+//
+//   --hterm FILE      hterm_all.js to load (default: the one in the repo).
+//   --corpus DIR      Also run every file in DIR as a trace.
+//   --only NAME,...   Only run the named traces.
+//   --scale N         Multiply the size of the built-in traces (default 1).
+//   --chunk N         Characters per interpret() call (default 4096).
+//   --runs N          Measured runs per phase (default 5, after 2 warmups).
+//   --no-flood        Disable output flood mode, to time the per-row path.
+//   --json FILE       Write the results to FILE.
+//   --compare FILE    Compare with results saved by --json; exits with 1 if
+//                     any trace got slower by more than --tolerance percent.
+//   --tolerance N     Allowed slowdown in percent (default 10).
+//
+// Run with `node --expose-gc` to also get the heap retained by each trace.
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+const {PerformanceObserver, performance} = require('perf_hooks');
+
+const {createWindow} = require('./dom_shim.js');
+const corpus = require('./corpus.js');
+
+const WARMUP_RUNS = 2;
+
+function parseArgs(argv) {
+  const options = {
+    hterm: path.join(__dirname, '..', '..', 'hterm_all.js'),
+    corpus: null,
+    only: null,
+    scale: 1,
+    chunk: 4096,
+    runs: 5,
+    flood: true,
+    json: null,
+    compare: null,
+    tolerance: 10,
+  };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const value = () => {
+      if (i + 1 >= argv.length) {
+        throw new Error(`${arg} needs a value`);
+      }
+      return argv[++i];
+    };
+    switch (arg) {
+      case '--hterm': options.hterm = value(); break;
+      case '--corpus': options.corpus = value(); break;
+      case '--only': options.only = value().split(','); break;
+      case '--scale': options.scale = Number(value()); break;
+      case '--chunk': options.chunk = Number(value()); break;
+      case '--runs': options.runs = Number(value()); break;
+      case '--no-flood': options.flood = false; break;
+      case '--json': options.json = value(); break;
+      case '--compare': options.compare = value(); break;
+      case '--tolerance': options.tolerance = Number(value()); break;
+      case '-h':
+      case '--help':
+        // Print the comment at the top of this file.
+        const lines = fs.readFileSync(__filename, 'utf8').split('\n').slice(1);
+        console.log(lines.slice(0, lines.findIndex((l) => !l.startsWith('//')))
+            .map((l) => l.substr(3)).join('\n'));
+        process.exit(0);
+      default:
+        throw new Error(`unknown option ${arg}`);
+    }
+  }
+  return options;
+}
+
+/**
+ * Load hterm into a fresh shim window.
+ *
+ * @return {!Object} The window, with hterm and lib already evaluated.
+ */
+function loadHterm(file, options) {
+  const window = createWindow();
+  vm.createContext(window);
+  vm.runInContext(fs.readFileSync(file, 'utf8'), window, {filename: file});
+  // hterm and lib are declared with const, so they are not window properties.
+  window.hterm = vm.runInContext('hterm', window);
+  window.lib = vm.runInContext('lib', window);
+  window.hterm.defaultStorage = new window.lib.Storage.Memory();
+  if (!options.flood && window.hterm.Terminal.FLOOD_THRESHOLD !== undefined) {
+    window.hterm.Terminal.FLOOD_THRESHOLD = Infinity;
+  }
+  return window;
+}
+
+/**
+ * A terminal that accepts every call from hterm.VT and does nothing.
+ *
+ * Only what VT reads back has a real value.
+ */
+function createNullTerminal(window) {
+  const {hterm} = window;
+  const screenSize = {width: 80, height: 24};
+  const target = {
+    screenSize,
+    keyboard: {},
+    io: {sendString: () => {}, print: () => {}},
+    screen_: {textAttributes: new hterm.TextAttributes(window.document)},
+    getTextAttributes: () => target.screen_.textAttributes,
+    getCursorRow: () => 0,
+    getCursorColumn: () => 0,
+    getVTScrollTop: () => 0,
+    getVTScrollBottom: () => 23,
+    allowImagesInline: true,
+    displayImage: () => {},
+  };
+  return new Proxy(target, {
+    get: (obj, prop) => (prop in obj ? obj[prop] : () => {}),
+  });
+}
+
+/**
+ * Create a Terminal that works without being decorated.
+ *
+ * Everything that would touch the (missing) ScrollPort viewport or run on a
+ * timer is replaced with a counter.  The counts are reported with the DOM
+ * stats: they show how much deferred browser work a trace would queue.
+ */
+function createTerminal(window, deferred) {
+  const {hterm, document} = window;
+  const term = new hterm.Terminal();
+  // Applying the preferences styles the ScrollPort; the defaults from the
+  // constructor are what we want anyway.
+  term.prefs_.notifyAll = () => {};
+  term.accessibilityReader_ =
+      new hterm.AccessibilityReader(document.createElement('div'));
+  const count = (name) => () => { deferred[name] = (deferred[name] || 0) + 1; };
+  term.scheduleSyncCursorPosition_ = count('cursorSyncs');
+  term.syncCursorPosition_ = count('cursorSyncs');
+  term.cursorNode_ = document.createElement('x-cursor');
+  term.scheduleRedraw_ = count('redraws');
+  term.scheduleScrollDown_ = count('scrollDowns');
+  term.displayImage = count('images');
+  const port = term.scrollPort_;
+  port.getTopRowIndex = () => term.scrollbackRows_.length;
+  port.getBottomRowIndex = (top) => top + term.screenSize.height - 1;
+  port.isScrolledEnd = true;
+  for (const name of ['scrollRowToBottom', 'scrollRowToTop',
+                      'scrollRowToMiddle', 'invalidate', 'scheduleInvalidate',
+                      'resetCache', 'redraw_', 'syncScrollHeight',
+                      'resize']) {
+    port[name] = count('scrollPort');
+  }
+  term.realizeSize_(80, 24);
+  term.setCursorPosition(0, 0);
+  return term;
+}
+
+/**
+ * Feed a trace the way outputToWebView does: in pty sized pieces.
+ *
+ * The text following an inline image is handed back through io.print while
+ * the VT is still parsing; a real terminal prints it once the image has
+ * loaded, so it is queued and fed after the current piece.
+ */
+function feed(sink, data, chunk, queued) {
+  for (let i = 0; i < data.length; i += chunk) {
+    sink(data.substr(i, chunk));
+    while (queued.length) {
+      sink(queued.shift());
+    }
+  }
+}
+
+function median(values) {
+  const sorted = values.slice().sort((a, b) => a - b);
+  const mid = sorted.length >> 1;
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+/** Median absolute deviation, as a fraction of the median. */
+function spread(values) {
+  const m = median(values);
+  return m ? median(values.map((v) => Math.abs(v - m))) / m : 0;
+}
+
+/**
+ * Time a phase over warmup + measured runs.
+ *
+ * @param {function(): function()} setup Returns the function to time; the
+ *     setup itself (e.g. building a Terminal) is not timed.
+ */
+async function measure(setup, runs) {
+  const times = [];
+  const windows = [];
+  const gcEntries = [];
+  const observer = new PerformanceObserver((list) => {
+    gcEntries.push(...list.getEntries());
+  });
+  observer.observe({entryTypes: ['gc']});
+
+  let retained = null;
+  for (let i = 0; i < WARMUP_RUNS + runs; i++) {
+    const run = setup();
+    if (global.gc) {
+      global.gc();
+    }
+    const heapBefore = process.memoryUsage().heapUsed;
+    const start = performance.now();
+    const result = run();
+    const end = performance.now();
+    if (i >= WARMUP_RUNS) {
+      times.push(end - start);
+      windows.push([start, end]);
+      if (global.gc) {
+        global.gc();
+        const delta = process.memoryUsage().heapUsed - heapBefore;
+        retained = retained === null ? delta : Math.min(retained, delta);
+      }
+    }
+    // Keep the result alive until the heap has been measured.
+    void result;
+  }
+  // GC entries are delivered asynchronously.
+  await new Promise((resolve) => setTimeout(resolve, 0));
+  observer.disconnect();
+
+  // Only count collections that happened inside a measured run, not the
+  // forced ones in between.
+  let gcCount = 0;
+  let gcTime = 0;
+  for (const entry of gcEntries) {
+    if (windows.some(([s, e]) => entry.startTime >= s && entry.startTime < e)) {
+      gcCount++;
+      gcTime += entry.duration;
+    }
+  }
+  return {
+    ms: median(times),
+    spread: spread(times),
+    gcPerRun: gcCount / runs,
+    gcMsPerRun: gcTime / runs,
+    retained,
+  };
+}
+
+async function benchTrace(window, trace, options) {
+  const {hterm, document} = window;
+  const megabytes = trace.data.length / (1024 * 1024);
+  const result = {name: trace.name, chars: trace.data.length};
+
+  const parse = await measure(() => {
+    const terminal = createNullTerminal(window);
+    const vt = new hterm.VT(terminal);
+    const queued = [];
+    terminal.io.print = (str) => queued.push(str);
+    return () => {
+      feed((s) => vt.interpret(s), trace.data, options.chunk, queued);
+      return vt;
+    };
+  }, options.runs);
+  result.parse = Object.assign(parse, {mbps: megabytes / (parse.ms / 1000)});
+
+  let deferred;
+  const screen = await measure(() => {
+    deferred = {};
+    const term = createTerminal(window, deferred);
+    const queued = [];
+    term.io.print = (str) => queued.push(str);
+    document.resetStats();
+    return () => {
+      feed((s) => term.interpret(s), trace.data, options.chunk, queued);
+      // Flood mode holds output back until the next frame; run those frames
+      // now, including any text they hand back through io.print.
+      while ((term.flushOutput && term.flushOutput()) || queued.length) {
+        while (queued.length) {
+          term.interpret(queued.shift());
+        }
+      }
+      return term;
+    };
+  }, options.runs);
+  result.screen = Object.assign(screen, {mbps: megabytes / (screen.ms / 1000)});
+
+  // The counters are left over from the last measured run.
+  result.dom = {};
+  for (const [key, value] of Object.entries(document.stats)) {
+    result.dom[key] = Math.round(value / megabytes);
+  }
+  for (const [key, value] of Object.entries(deferred)) {
+    result.dom[key] = Math.round(value / megabytes);
+  }
+  return result;
+}
+
+function formatResult(r) {
+  const pct = (x) => `±${(x * 100).toFixed(1)}%`;
+  const kb = (x) => (x === null ? '' :
+      ` heap ${x < 0 ? '' : '+'}${(x / 1024).toFixed(0)}KB`);
+  const lines = [
+    `${r.name} (${(r.chars / (1024 * 1024)).toFixed(2)}M chars)`,
+    `  parse   ${r.parse.mbps.toFixed(1).padStart(8)} MB/s ` +
+        `${r.parse.ms.toFixed(1).padStart(8)} ms ${pct(r.parse.spread)} ` +
+        `gc ${r.parse.gcPerRun.toFixed(1)}x/${r.parse.gcMsPerRun.toFixed(1)}ms` +
+        kb(r.parse.retained),
+    `  screen  ${r.screen.mbps.toFixed(1).padStart(8)} MB/s ` +
+        `${r.screen.ms.toFixed(1).padStart(8)} ms ${pct(r.screen.spread)} ` +
+        `gc ${r.screen.gcPerRun.toFixed(1)}x/${r.screen.gcMsPerRun.toFixed(1)}` +
+        `ms` + kb(r.screen.retained),
+    '  dom/MB  ' + Object.entries(r.dom).map(([k, v]) => `${k}=${v}`)
+        .join(' '),
+  ];
+  return lines.join('\n');
+}
+
+/**
+ * Compare with an earlier run.
+ *
+ * @return {boolean} True if nothing regressed beyond the tolerance.
+ */
+function compare(results, baseline, tolerance) {
+  const previous = new Map(baseline.results.map((r) => [r.name, r]));
+  let ok = true;
+  console.log(`\nCompared with ${baseline.hterm} (${baseline.date}):`);
+  for (const r of results) {
+    const old = previous.get(r.name);
+    if (!old) {
+      continue;
+    }
+    const cells = [];
+    for (const phase of ['parse', 'screen']) {
+      const change = (r[phase].ms / old[phase].ms - 1) * 100;
+      // Don't fail on changes that are within the noise of either run.
+      const noise =
+          Math.max(r[phase].spread, old[phase].spread) * 100 * 2;
+      const regressed = change > Math.max(tolerance, noise);
+      ok = ok && !regressed;
+      cells.push(`${phase} ${change >= 0 ? '+' : ''}${change.toFixed(1)}%` +
+                 (regressed ? ' REGRESSION' : ''));
+    }
+    console.log(`  ${r.name.padEnd(16)} ${cells.join('  ')}`);
+  }
+  return ok;
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  let traces = corpus.builtinTraces(options.scale);
+  if (options.corpus) {
+    traces = traces.concat(corpus.loadTraces(options.corpus));
+  }
+  if (options.only) {
+    traces = traces.filter((t) => options.only.includes(t.name));
+  }
+
+  const window = loadHterm(options.hterm, options);
+  console.log(`hterm: ${options.hterm}, node ${process.version}, ` +
+              `${options.runs} runs, chunk ${options.chunk}` +
+              (options.flood ? '' : ', flood mode off') +
+              (global.gc ? '' : ' (use --expose-gc for heap numbers)'));
+
+  const results = [];
+  for (const trace of traces) {
+    const result = await benchTrace(window, trace, options);
+    results.push(result);
+    console.log(formatResult(result));
+  }
+
+  if (options.json) {
+    fs.writeFileSync(options.json, JSON.stringify({
+      hterm: options.hterm,
+      date: new Date().toISOString(),
+      node: process.version,
+      options: {chunk: options.chunk, runs: options.runs,
+                flood: options.flood, scale: options.scale},
+      results,
+    }, null, 2));
+  }
+  if (options.compare) {
+    const baseline = JSON.parse(fs.readFileSync(options.compare, 'utf8'));
+    if (!compare(results, baseline, options.tolerance)) {
+      process.exitCode = 1;
+    }
+  }
+  // Flood flushes may still be scheduled; they have nothing left to do.
+  process.exit();
+}
+
+main();
@@ -0,0 +1,220 @@
+// Terminal output traces for the hterm benchmark.
+//
+// The built-in traces are generated from a fixed seed, so every run (and every
+// machine) feeds hterm exactly the same bytes.  They imitate the kinds of
+// output that matter in a-Shell: floods of plain text, very long lines, wide
+// characters, colored logs, full-screen programs and inline images.
+// Recordings of real sessions (e.g. made with `script -q out.txt vim`) can be
+// added with --corpus.
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+
+/** Small deterministic PRNG (mulberry32). */
+function rng(seed) {
+  return () => {
+    seed |= 0;
+    seed = (seed + 0x6d2b79f5) | 0;
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+const ESC = '\x1b';
+const CSI = ESC + '[';
+// a-Shell turns "\n" into "\n\r" before printing (see outputToWebView).
+const NL = '\n\r';
+
+const WORDS = ('the of and to in is for on that with as by at from this be ' +
+               'error warning note undefined reference function return int ' +
+               'const char void static struct include make clang python3 ' +
+               'build src lib test main config value index buffer').split(' ');
+
+function words(random, count) {
+  const out = [];
+  for (let i = 0; i < count; i++) {
+    out.push(WORDS[Math.floor(random() * WORDS.length)]);
+  }
+  return out.join(' ');
+}
+
+function asciiFlood(size) {
+  const random = rng(1);
+  let out = '';
+  let n = 0;
+  while (out.length < size) {
+    // Mix `yes`-style short lines with `seq`/`make`-style longer ones.
+    out += (n % 3 == 0 ? 'y' : `${n} ` + words(random, 1 + (n % 12))) + NL;
+    n++;
+  }
+  return out;
+}
+
+function longLines(size) {
+  const random = rng(2);
+  let out = '';
+  while (out.length < size) {
+    out += words(random, 6000) + NL;
+  }
+  return out;
+}
+
+function wideChars(size) {
+  const random = rng(3);
+  const pick = (from, to) =>
+      String.fromCodePoint(from + Math.floor(random() * (to - from)));
+  let out = '';
+  while (out.length < size) {
+    let line = '';
+    for (let i = 0; i < 30; i++) {
+      const r = random();
+      if (r < 0.4) {
+        line += pick(0x4e00, 0x9fff);  // CJK ideographs
+      } else if (r < 0.5) {
+        line += pick(0x1f600, 0x1f64f);  // Emoji
+      } else if (r < 0.55) {
+        line += 'e' + pick(0x300, 0x36f);  // Combining marks
+      } else if (r < 0.65) {
+        line += pick(0xac00, 0xd7a3);  // Hangul
+      } else {
+        line += ' ' + words(random, 1);
+      }
+    }
+    out += line + NL;
+  }
+  return out;
+}
+
+function sgrLog(size) {
+  const random = rng(4);
+  const levels = [
+    `${CSI}1;31merror:${CSI}0m`,
+    `${CSI}1;35mwarning:${CSI}0m`,
+    `${CSI}1;36mnote:${CSI}0m`,
+  ];
+  let out = '';
+  let n = 0;
+  while (out.length < size) {
+    const kind = n % 4;
+    if (kind == 0) {
+      // Compiler diagnostic.
+      out += `${CSI}1msrc/${words(random, 1)}.c:${n}:${n % 80}: ${CSI}0m` +
+          levels[n % 3] + ' ' + words(random, 8) + NL +
+          `    ${words(random, 5)}` + NL +
+          `    ${CSI}32m^~~~~${CSI}0m` + NL;
+    } else if (kind == 1) {
+      // `ls --color` row.
+      for (let i = 0; i < 6; i++) {
+        const color = [34, 32, 36, 35, 33, 31][i];
+        out += `${CSI}0${i % 2 ? ';1' : ''};${color}m${words(random, 1)}` +
+            `${CSI}0m  `;
+      }
+      out += NL;
+    } else if (kind == 2) {
+      // 256 color log line.
+      out += `${CSI}38;5;${n % 256}m[${n}]${CSI}39m ${words(random, 6)} ` +
+          `${CSI}48;5;${(n * 7) % 256}m ${words(random, 1)} ${CSI}49m` + NL;
+    } else {
+      // True color, with colon separated subarguments.
+      out += `${CSI}38:2::${n % 256}:${(n * 3) % 256}:${(n * 5) % 256}m` +
+          `${words(random, 4)}${CSI}m` + NL;
+    }
+    n++;
+  }
+  return out;
+}
+
+function fullScreen(size, rows, columns, pager) {
+  const random = rng(pager ? 6 : 5);
+  let out = `${CSI}?1049h${CSI}?1h${ESC}=${CSI}H${CSI}2J`;
+  let frame = 0;
+  while (out.length < size) {
+    if (pager) {
+      // less: redraw the page, then the reverse video status line.
+      out += `${CSI}H${CSI}2J`;
+      for (let r = 0; r < rows - 1; r++) {
+        out += `${words(random, 1 + (r % 10))}${CSI}K` + NL;
+      }
+      out += `${CSI}7m lines ${frame * rows}-${(frame + 1) * rows} ${CSI}27m`;
+    } else {
+      // vim: scroll the text region, repaint a few lines and the status line.
+      out += `${CSI}1;${rows - 2}r${CSI}${rows - 2};1H`;
+      for (let i = 0; i < 3; i++) {
+        out += NL + `${CSI}33m${String(frame * 3 + i).padStart(4)} ${CSI}m` +
+            `${CSI}1;34m${words(random, 1)}${CSI}m ` +
+            `${words(random, 6)}${CSI}K`;
+      }
+      out += `${CSI}r${CSI}${rows - 1};1H${CSI}7m${words(random, 3)}` +
+          `${' '.repeat(20)}${frame},1${CSI}27m${CSI}K` +
+          `${CSI}${1 + (frame % (rows - 2))};${1 + (frame % columns)}H` +
+          `${CSI}?25h`;
+      if (frame % 10 == 0) {
+        // Reverse scroll, as with `k` at the top of the window.
+        out += `${CSI}1;1H${ESC}M${CSI}1S${CSI}1T`;
+      }
+    }
+    frame++;
+  }
+  return out + `${CSI}?1049l`;
+}
+
+function inlineImages(size) {
+  const random = rng(7);
+  // A 96KB (base64) payload: big enough to cross many pty reads.
+  const bytes = Buffer.alloc(72 * 1024);
+  for (let i = 0; i < bytes.length; i++) {
+    bytes[i] = Math.floor(random() * 256);
+  }
+  const image = `${ESC}]1337;File=name=${Buffer.from('a.png').toString(
+      'base64')};size=${bytes.length};inline=1:` + bytes.toString('base64') +
+      '\x07';
+  let out = '';
+  while (out.length < size) {
+    out += `$ imgcat a.png` + NL + image + NL + words(random, 10) + NL;
+  }
+  return out;
+}
+
+/**
+ * The built-in traces.
+ *
+ * @param {number} scale Multiplier for the trace sizes.
+ * @return {!Array<{name: string, data: string}>}
+ */
+function builtinTraces(scale = 1) {
+  const mb = Math.round(1024 * 1024 * scale);
+  return [
+    {name: 'ascii-flood', data: asciiFlood(2 * mb)},
+    {name: 'long-lines', data: longLines(mb / 4)},
+    {name: 'cjk-emoji', data: wideChars(mb / 8)},
+    {name: 'sgr-log', data: sgrLog(mb)},
+    {name: 'tui-vim', data: fullScreen(mb, 24, 80, false)},
+    {name: 'tui-less', data: fullScreen(mb, 24, 80, true)},
+    {name: 'inline-image', data: inlineImages(mb)},
+  ];
+}
+
+/**
+ * Load recorded output files from a directory.
+ *
+ * Each regular file is one trace, decoded as UTF-8 with a-Shell's line
+ * ending translation applied.
+ *
+ * @param {string} dir
+ * @return {!Array<{name: string, data: string}>}
+ */
+function loadTraces(dir) {
+  return fs.readdirSync(dir)
+      .filter((f) => fs.statSync(path.join(dir, f)).isFile())
+      .sort()
+      .map((f) => ({
+        name: f,
+        data: fs.readFileSync(path.join(dir, f), 'utf8')
+            .replace(/\r?\n/g, NL),
+      }));
+}
+
+module.exports = {builtinTraces, loadTraces};
@@ -0,0 +1,570 @@
+// Minimal DOM for running hterm_all.js headless under Node.
+//
+// This implements just enough of Node/Element/Text/Document for hterm.Terminal
+// to build its rows (x-row elements holding text nodes and styled spans)
+// without a browser.  There is no layout: sizes are all zero and the
+// ScrollPort is never decorated.  Every node creation and tree mutation is
+// counted in document.stats, which is what the benchmark reports as DOM work.
+
+'use strict';
+
+const ELEMENT_NODE = 1;
+const TEXT_NODE = 3;
+const DOCUMENT_NODE = 9;
+const DOCUMENT_FRAGMENT_NODE = 11;
+
+class Node {
+  constructor(ownerDocument, nodeType) {
+    this.ownerDocument = ownerDocument;
+    this.nodeType = nodeType;
+    this.parentNode = null;
+    // Children are a doubly linked list so that sibling walks and insertions
+    // are O(1), like in a real DOM.
+    this.firstChild = null;
+    this.lastChild = null;
+    this.previousSibling = null;
+    this.nextSibling = null;
+  }
+
+  get childNodes() {
+    const nodes = [];
+    for (let n = this.firstChild; n; n = n.nextSibling) {
+      nodes.push(n);
+    }
+    return nodes;
+  }
+
+  get parentElement() {
+    return this.parentNode && this.parentNode.nodeType == ELEMENT_NODE ?
+        this.parentNode : null;
+  }
+
+  get isConnected() {
+    let n = this;
+    while (n.parentNode) {
+      n = n.parentNode;
+    }
+    return n.nodeType == DOCUMENT_NODE;
+  }
+
+  hasChildNodes() {
+    return this.firstChild != null;
+  }
+
+  appendChild(node) {
+    return this.insertBefore(node, null);
+  }
+
+  insertBefore(node, ref) {
+    if (node.nodeType == DOCUMENT_FRAGMENT_NODE) {
+      let child;
+      while ((child = node.firstChild)) {
+        this.insertBefore(child, ref);
+      }
+      return node;
+    }
+
+    if (node.parentNode) {
+      node.parentNode.removeChild(node);
+    }
+    node.parentNode = this;
+    if (ref) {
+      node.nextSibling = ref;
+      node.previousSibling = ref.previousSibling;
+      if (ref.previousSibling) {
+        ref.previousSibling.nextSibling = node;
+      } else {
+        this.firstChild = node;
+      }
+      ref.previousSibling = node;
+    } else {
+      node.previousSibling = this.lastChild;
+      node.nextSibling = null;
+      if (this.lastChild) {
+        this.lastChild.nextSibling = node;
+      } else {
+        this.firstChild = node;
+      }
+      this.lastChild = node;
+    }
+    this.ownerDocument.stats.mutations++;
+    return node;
+  }
+
+  removeChild(node) {
+    if (node.previousSibling) {
+      node.previousSibling.nextSibling = node.nextSibling;
+    } else {
+      this.firstChild = node.nextSibling;
+    }
+    if (node.nextSibling) {
+      node.nextSibling.previousSibling = node.previousSibling;
+    } else {
+      this.lastChild = node.previousSibling;
+    }
+    node.parentNode = node.previousSibling = node.nextSibling = null;
+    this.ownerDocument.stats.mutations++;
+    return node;
+  }
+
+  replaceChild(node, old) {
+    this.insertBefore(node, old);
+    return this.removeChild(old);
+  }
+
+  remove() {
+    if (this.parentNode) {
+      this.parentNode.removeChild(this);
+    }
+  }
+
+  contains(node) {
+    for (let n = node; n; n = n.parentNode) {
+      if (n === this) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  get textContent() {
+    let text = '';
+    for (let n = this.firstChild; n; n = n.nextSibling) {
+      text += n.textContent;
+    }
+    return text;
+  }
+
+  set textContent(text) {
+    while (this.firstChild) {
+      this.removeChild(this.firstChild);
+    }
+    if (text !== '' && text != null) {
+      this.appendChild(this.ownerDocument.createTextNode(String(text)));
+    }
+  }
+
+  addEventListener() {}
+  removeEventListener() {}
+  dispatchEvent() {
+    return true;
+  }
+}
+
+class Text extends Node {
+  constructor(ownerDocument, data) {
+    super(ownerDocument, TEXT_NODE);
+    this.data = data;
+  }
+
+  get nodeValue() {
+    return this.data;
+  }
+
+  set nodeValue(data) {
+    this.data = String(data);
+    this.ownerDocument.stats.mutations++;
+  }
+
+  get textContent() {
+    return this.data;
+  }
+
+  set textContent(data) {
+    this.nodeValue = data;
+  }
+
+  get length() {
+    return this.data.length;
+  }
+
+  cloneNode() {
+    return this.ownerDocument.createTextNode(this.data);
+  }
+}
+
+class ClassList {
+  constructor(element) {
+    this.element_ = element;
+  }
+
+  list_() {
+    const name = this.element_.getAttribute('class');
+    return name ? name.split(/\s+/).filter((c) => c) : [];
+  }
+
+  contains(name) {
+    return this.list_().includes(name);
+  }
+
+  add(...names) {
+    const list = this.list_();
+    names.forEach((n) => list.includes(n) || list.push(n));
+    this.element_.setAttribute('class', list.join(' '));
+  }
+
+  remove(...names) {
+    this.element_.setAttribute(
+        'class', this.list_().filter((n) => !names.includes(n)).join(' '));
+  }
+
+  toggle(name, force) {
+    const on = force === undefined ? !this.contains(name) : force;
+    on ? this.add(name) : this.remove(name);
+    return on;
+  }
+}
+
+// CSSStyleDeclaration: camelCase properties plus cssText.
+function createStyle(ownerDocument) {
+  const props = new Map();
+  const toKebab = (p) => p.replace(/[A-Z]/g, (c) => '-' + c.toLowerCase());
+  const api = {
+    setProperty(name, value) {
+      props.set(name, String(value));
+      ownerDocument.stats.styleWrites++;
+    },
+    getPropertyValue(name) {
+      return props.get(name) || '';
+    },
+    removeProperty(name) {
+      props.delete(name);
+    },
+    get cssText() {
+      return Array.from(props, ([k, v]) => `${k}: ${v};`).join(' ');
+    },
+    set cssText(text) {
+      props.clear();
+      String(text).split(';').forEach((decl) => {
+        const i = decl.indexOf(':');
+        if (i > 0) {
+          props.set(decl.slice(0, i).trim(), decl.slice(i + 1).trim());
+        }
+      });
+      ownerDocument.stats.styleWrites++;
+    },
+  };
+  return new Proxy(api, {
+    get(target, key) {
+      if (key in target || typeof key != 'string') {
+        return target[key];
+      }
+      return props.get(toKebab(key)) || '';
+    },
+    set(target, key, value) {
+      if (key == 'cssText') {
+        target.cssText = value;
+      } else if (value === '' || value == null) {
+        props.delete(toKebab(key));
+      } else {
+        target.setProperty(toKebab(key), value);
+      }
+      return true;
+    },
+  });
+}
+
+class Element extends Node {
+  constructor(ownerDocument, tagName) {
+    super(ownerDocument, ELEMENT_NODE);
+    this.tagName = tagName.toUpperCase();
+    this.localName = tagName.toLowerCase();
+    this.attributes_ = new Map();
+    this.style_ = null;
+    this.classList_ = null;
+    this.sheet_ = null;
+  }
+
+  get nodeName() {
+    return this.tagName;
+  }
+
+  get style() {
+    if (!this.style_) {
+      this.style_ = createStyle(this.ownerDocument);
+    }
+    return this.style_;
+  }
+
+  get classList() {
+    if (!this.classList_) {
+      this.classList_ = new ClassList(this);
+    }
+    return this.classList_;
+  }
+
+  get className() {
+    return this.getAttribute('class') || '';
+  }
+
+  set className(name) {
+    this.setAttribute('class', name);
+  }
+
+  get id() {
+    return this.getAttribute('id') || '';
+  }
+
+  set id(id) {
+    this.setAttribute('id', id);
+  }
+
+  get innerText() {
+    return this.textContent;
+  }
+
+  set innerText(text) {
+    this.textContent = text;
+  }
+
+  get innerHTML() {
+    return this.textContent;
+  }
+
+  set innerHTML(html) {
+    // Markup isn't parsed; hterm only uses this to clear nodes or to load
+    // its own resources (find bar, menus) which the benchmark doesn't use.
+    this.textContent = String(html).replace(/<[^>]*>/g, '');
+  }
+
+  get children() {
+    return this.childNodes.filter((n) => n.nodeType == ELEMENT_NODE);
+  }
+
+  get sheet() {
+    if (this.localName != 'style') {
+      return null;
+    }
+    if (!this.sheet_) {
+      const cssRules = [];
+      this.sheet_ = {
+        cssRules,
+        insertRule(rule, index = 0) {
+          cssRules.splice(index, 0, {cssText: rule});
+          return index;
+        },
+        deleteRule(index) {
+          cssRules.splice(index, 1);
+        },
+      };
+    }
+    return this.sheet_;
+  }
+
+  setAttribute(name, value) {
+    if (name == 'style') {
+      // The style attribute reflects the style object.
+      this.style.cssText = value;
+      return;
+    }
+    this.attributes_.set(name, String(value));
+    this.ownerDocument.stats.attributeWrites++;
+  }
+
+  getAttribute(name) {
+    if (name == 'style') {
+      return this.style_ && this.style_.cssText ? this.style_.cssText : null;
+    }
+    const value = this.attributes_.get(name);
+    return value === undefined ? null : value;
+  }
+
+  hasAttribute(name) {
+    return this.getAttribute(name) !== null;
+  }
+
+  removeAttribute(name) {
+    if (this.attributes_.delete(name)) {
+      this.ownerDocument.stats.attributeWrites++;
+    }
+  }
+
+  cloneNode(deep = false) {
+    const clone = this.ownerDocument.createElement(this.localName);
+    this.attributes_.forEach((v, k) => clone.attributes_.set(k, v));
+    if (this.style_) {
+      clone.style.cssText = this.style_.cssText;
+    }
+    if (deep) {
+      for (let n = this.firstChild; n; n = n.nextSibling) {
+        clone.appendChild(n.cloneNode(true));
+      }
+    }
+    return clone;
+  }
+
+  querySelector() {
+    return null;
+  }
+
+  querySelectorAll() {
+    return [];
+  }
+
+  getElementsByTagName() {
+    return [];
+  }
+
+  getBoundingClientRect() {
+    return {top: 0, left: 0, right: 0, bottom: 0, width: 0, height: 0,
+            x: 0, y: 0};
+  }
+
+  get offsetWidth() {
+    return 0;
+  }
+
+  get offsetHeight() {
+    return 0;
+  }
+
+  get clientWidth() {
+    return 0;
+  }
+
+  get clientHeight() {
+    return 0;
+  }
+
+  focus() {}
+  blur() {}
+  click() {}
+  scrollIntoView() {}
+  attachShadow() {
+    return this.ownerDocument.createDocumentFragment();
+  }
+}
+
+class DocumentFragment extends Node {
+  constructor(ownerDocument) {
+    super(ownerDocument, DOCUMENT_FRAGMENT_NODE);
+  }
+}
+
+class Document extends Node {
+  constructor() {
+    super(null, DOCUMENT_NODE);
+    this.ownerDocument = this;
+    this.stats = {elements: 0, textNodes: 0, mutations: 0, styleWrites: 0,
+                  attributeWrites: 0};
+    this.characterSet = 'UTF-8';
+    this.readyState = 'complete';
+    this.defaultView = null;
+    this.documentElement = this.createElement('html');
+    this.head = this.createElement('head');
+    this.body = this.createElement('body');
+    this.documentElement.appendChild(this.head);
+    this.documentElement.appendChild(this.body);
+    this.appendChild(this.documentElement);
+  }
+
+  resetStats() {
+    for (const key in this.stats) {
+      this.stats[key] = 0;
+    }
+  }
+
+  createElement(tagName) {
+    this.stats.elements++;
+    return new Element(this, tagName);
+  }
+
+  createElementNS(ns, tagName) {
+    return this.createElement(tagName);
+  }
+
+  createTextNode(data) {
+    this.stats.textNodes++;
+    return new Text(this, String(data));
+  }
+
+  createDocumentFragment() {
+    return new DocumentFragment(this);
+  }
+
+  getElementById() {
+    return null;
+  }
+
+  querySelector() {
+    return null;
+  }
+
+  getSelection() {
+    return {
+      isCollapsed: true, rangeCount: 0, anchorNode: null, focusNode: null,
+      removeAllRanges() {}, addRange() {}, collapse() {},
+      getRangeAt() {
+        return null;
+      },
+      toString() {
+        return '';
+      },
+    };
+  }
+
+  hasFocus() {
+    return false;
+  }
+
+  execCommand() {
+    return false;
+  }
+}
+
+/**
+ * Build the globals of a window around a fresh document.
+ *
+ * @return {!Object} The window object, to be used as a vm context.
+ */
+function createWindow() {
+  const document = new Document();
+  const noop = () => {};
+  const window = {
+    document,
+    navigator: {userAgent: 'Node.js (hterm benchmark)', platform: 'Linux',
+                language: 'en-US', languages: ['en-US'], clipboard: null},
+    location: {href: 'about:blank', search: '', hash: ''},
+    devicePixelRatio: 1,
+    Node: {ELEMENT_NODE, TEXT_NODE, DOCUMENT_NODE, DOCUMENT_FRAGMENT_NODE},
+    HTMLElement: Element,
+    Element,
+    Text,
+    Event: class Event {
+      constructor(type, init = {}) {
+        this.type = type;
+        Object.assign(this, init);
+      }
+      preventDefault() {}
+      stopPropagation() {}
+    },
+    getComputedStyle: () => createStyle(document),
+    matchMedia: () => ({matches: false, addListener: noop,
+                        removeListener: noop}),
+    requestAnimationFrame: (cb) => setTimeout(() => cb(Date.now()), 0),
+    cancelAnimationFrame: (id) => clearTimeout(id),
+    ResizeObserver: class { observe() {} unobserve() {} disconnect() {} },
+    MutationObserver: class { observe() {} disconnect() {} },
+    addEventListener: noop,
+    removeEventListener: noop,
+    open: noop,
+    console,
+    setTimeout,
+    clearTimeout,
+    setInterval,
+    clearInterval,
+    queueMicrotask,
+    performance,
+    Blob,
+    URL,
+    TextEncoder,
+    TextDecoder,
+    atob,
+    btoa,
+  };
+  window.window = window.self = window.globalThis = window;
+  document.defaultView = window;
+  return window;
+}
+
+module.exports = {createWindow, Document, Element, Text};
@@ -0,0 +1,205 @@
+// Scalar and SIMD string codecs of nan and node-addon-api, side by side.
+//
+// Every codec runs over inputs from 16 bytes to 64 MB, once through its
+// scalar loop (the *_slow functions of nan_string_codecs.h, or a byte loop for
+// Napi::details::IsAscii) and once through the entry point the addons call,
+// which uses SSE2/SSSE3 or NEON when the target has them. Throughput is in
+// the bytes_per_second column.
+//
+// Before timing anything, the SIMD results are compared with the scalar ones
+// for every length up to 300 bytes and every alignment, so a run on a new
+// architecture also checks the vector code.
+//
+// Build and run with `make run` (see Makefile).
+
+#include <napi.h>
+#include <nan_string_codecs.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Nan::imp::base64_encode;
+using Nan::imp::base64_encode_slow;
+using Nan::imp::contains_non_ascii;
+using Nan::imp::contains_non_ascii_slow;
+using Nan::imp::force_ascii;
+using Nan::imp::force_ascii_slow;
+using Nan::imp::hex_encode;
+using Nan::imp::hex_encode_slow;
+using Nan::imp::latin1_widen;
+using Nan::imp::latin1_widen_slow;
+
+const size_t kMaxSize = 64 << 20;
+
+// kMaxSize random bytes, and as many random ASCII characters, shared by all
+// benchmarks so that large sizes are not dominated by setup.
+const std::vector<char>& Input(bool ascii) {
+  static std::vector<char> bytes;
+  static std::vector<char> text;
+  std::vector<char>& input = ascii ? text : bytes;
+  if (input.empty()) {
+    std::mt19937 random(ascii ? 1 : 2);
+    input.resize(kMaxSize);
+    for (char& c : input) {
+      c = static_cast<char>(ascii ? 0x20 + random() % 0x5f : random());
+    }
+  }
+  return input;
+}
+
+bool ScalarIsAscii(const char* data, size_t length) {
+  return !contains_non_ascii_slow(data, length);
+}
+
+bool VectorIsAscii(const char* data, size_t length) {
+  return Napi::details::IsAscii(data, length);
+}
+
+typedef bool (*CheckFunction)(const char*, size_t);
+typedef void (*AsciiFunction)(const char*, char*, size_t);
+typedef void (*WidenFunction)(const char*, uint16_t*, size_t);
+typedef size_t (*EncodeFunction)(const char*, size_t, char*, size_t);
+
+// Checks are timed on ASCII text, which they have to read to the end.
+void BM_Check(benchmark::State& state, CheckFunction check) {
+  const size_t size = state.range(0);
+  const char* input = Input(true).data();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(check(input, size));
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_ForceAscii(benchmark::State& state, AsciiFunction convert) {
+  const size_t size = state.range(0);
+  const char* input = Input(false).data();
+  std::vector<char> output(size);
+  for (auto _ : state) {
+    convert(input, output.data(), size);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_Latin1(benchmark::State& state, WidenFunction widen) {
+  const size_t size = state.range(0);
+  const char* input = Input(false).data();
+  std::vector<uint16_t> output(size);
+  for (auto _ : state) {
+    widen(input, output.data(), size);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_Encode(benchmark::State& state, EncodeFunction encode, size_t ratio) {
+  const size_t size = state.range(0);
+  const char* input = Input(false).data();
+  std::vector<char> output(size * ratio);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(encode(input, size, output.data(),
+                                    output.size()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void Sizes(benchmark::internal::Benchmark* benchmark) {
+  benchmark->RangeMultiplier(4)->Range(16, kMaxSize);
+}
+
+BENCHMARK_CAPTURE(BM_Check, ascii/scalar, ScalarIsAscii)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Check, ascii/vector, VectorIsAscii)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Check, non_ascii/scalar, contains_non_ascii_slow)
+    ->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Check, non_ascii/vector, contains_non_ascii)
+    ->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_ForceAscii, force_ascii/scalar, force_ascii_slow)
+    ->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_ForceAscii, force_ascii/vector, force_ascii)
+    ->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Latin1, latin1/scalar, latin1_widen_slow)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Latin1, latin1/vector, latin1_widen)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Encode, base64/scalar, base64_encode_slow, 2)
+    ->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Encode, base64/vector, base64_encode, 2)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Encode, hex/scalar, hex_encode_slow, 2)->Apply(Sizes);
+BENCHMARK_CAPTURE(BM_Encode, hex/vector, hex_encode, 2)->Apply(Sizes);
+
+void Fail(const char* codec, size_t offset, size_t length) {
+  std::fprintf(stderr, "%s: SIMD and scalar results differ at offset %zu, "
+               "length %zu\n", codec, offset, length);
+  std::exit(1);
+}
+
+// Compares the SIMD paths with the scalar ones on short inputs.
+void CheckCodecs() {
+  std::vector<char> data(Input(false).begin(), Input(false).begin() + 400);
+  std::vector<char> a(1024);
+  std::vector<char> b(1024);
+  std::vector<uint16_t> wa(400);
+  std::vector<uint16_t> wb(400);
+  for (size_t offset = 0; offset < 16; offset++) {
+    for (size_t length = 0; offset + length <= 300; length++) {
+      const char* src = data.data() + offset;
+      size_t na = base64_encode(src, length, a.data(), a.size());
+      size_t nb = base64_encode_slow(src, length, b.data(), b.size());
+      if (na != nb || std::memcmp(a.data(), b.data(), na) != 0) {
+        Fail("base64", offset, length);
+      }
+      na = hex_encode(src, length, a.data(), a.size());
+      nb = hex_encode_slow(src, length, b.data(), b.size());
+      if (na != nb || std::memcmp(a.data(), b.data(), na) != 0) {
+        Fail("hex", offset, length);
+      }
+      force_ascii(src, a.data() + offset, length);
+      force_ascii_slow(src, b.data() + offset, length);
+      if (std::memcmp(a.data() + offset, b.data() + offset, length) != 0) {
+        Fail("force_ascii", offset, length);
+      }
+      latin1_widen(src, wa.data(), length);
+      latin1_widen_slow(src, wb.data(), length);
+      if (std::memcmp(wa.data(), wb.data(), length * 2) != 0) {
+        Fail("latin1", offset, length);
+      }
+      // ASCII text with at most one byte that is not.
+      char* text = a.data() + offset;
+      std::memcpy(text, Input(true).data(), length);
+      for (size_t bad = 0; bad <= length; bad++) {
+        if (bad < length) {
+          text[bad] = src[bad] | 0x80;
+        }
+        bool expected = contains_non_ascii_slow(text, length);
+        if (contains_non_ascii(text, length) != expected) {
+          Fail("contains_non_ascii", bad, length);
+        }
+        if (VectorIsAscii(text, length) == expected) {
+          Fail("Napi::details::IsAscii", bad, length);
+        }
+        if (bad < length) {
+          text[bad] = Input(true)[bad];
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CheckCodecs();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
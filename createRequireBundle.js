@@ -0,0 +1,117 @@
+#!/usr/bin/env node
+// Creates node_modules/tarp_bundle.js: the modules loaded by the wasm WebView and its worker
+// at each (re)load (buffer, process, @wasmer/wasi, @wasmer/wasmfs and their dependencies),
+// with the result of every require() they make. require.js uses it instead of probing the
+// local server for each candidate file.
+// Resolution follows require.js exactly: bare ids are looked up in /node_modules/, and the
+// candidates are tried in the same order. Run again after changing these modules:
+//   node createRequireBundle.js Resources/node_modules
+//   node createRequireBundle.js Resources_mini/node_modules
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+
+// The require() calls made by wasm_withWorker.js, wasm_worker_wasm.js and wasm.js:
+const ENTRIES = [
+  'buffer',
+  'process',
+  '@wasmer/wasi/lib',
+  '@wasmer/wasi/lib/bindings/browser',
+  '@wasmer/wasmfs',
+];
+// Same order as requireEngine in require.js:
+const SUFFIXES = ['', '/browser.js', '-browserify/index.js', '/package.json',
+                  '.js', '/index.js'];
+const ORIGIN = 'https://localhost';
+
+const modulesDir = path.resolve(process.argv[2] || 'Resources/node_modules');
+const root = path.dirname(modulesDir);
+
+function isFile(urlPath) {
+  try {
+    return fs.statSync(path.join(root, decodeURIComponent(urlPath))).isFile();
+  } catch (e) {
+    return false;
+  }
+}
+
+// The directory used as base for id, as in requireEngine: the parent module, or /node_modules/.
+function baseDirectory(id, parentPath) {
+  const pwd = (id[0] == '.' && parentPath) ? ORIGIN + parentPath : ORIGIN + '/node_modules/';
+  return new URL('.', pwd).pathname;
+}
+
+function resolve(id, directory) {
+  const candidates = SUFFIXES.concat(['/' + id + '.js']);
+  for (const suffix of candidates) {
+    const urlPath = new URL(id + suffix, ORIGIN + directory).pathname;
+    if (isFile(urlPath)) {
+      return urlPath;
+    }
+  }
+  return null;
+}
+
+const resolved = {};
+const modules = {};
+const missing = [];
+const queue = ENTRIES.map((id) => [id, null]);
+
+while (queue.length > 0) {
+  const [id, parentPath] = queue.shift();
+  const directory = baseDirectory(id, parentPath);
+  const key = directory + '\n' + id;
+  if (key in resolved) {
+    continue;
+  }
+  const urlPath = resolve(id, directory);
+  if (urlPath == null) {
+    // Node built-ins or optional dependencies: left to the local server.
+    missing.push(id);
+    continue;
+  }
+  resolved[key] = urlPath;
+  if (urlPath in modules) {
+    continue;
+  }
+  const source = fs.readFileSync(path.join(root, decodeURIComponent(urlPath)), 'utf8');
+  modules[urlPath] = source;
+  if (/package\.json$/.test(urlPath)) {
+    // requireEngine then loads "main", relative to package.json:
+    if (!/package\.json$/.test(id)) {
+      const main = JSON.parse(source).main;
+      if (typeof main == 'string') {
+        queue.push([main.replace(/^\.*\/*/, './'), urlPath]);
+      }
+    }
+    continue;
+  }
+  if (/\.json$/.test(urlPath)) {
+    continue;
+  }
+  const pattern = /\brequire\s*\(\s*(['"])([^'"\n]+)\1\s*\)/g;
+  let match;
+  while ((match = pattern.exec(source)) != null) {
+    queue.push([match[2], urlPath]);
+  }
+}
+
+const packages = new Set(Object.keys(modules).map((urlPath) => {
+  const parts = urlPath.split('/');
+  return parts[2][0] == '@' ? parts[2] + '/' + parts[3] : parts[2];
+}));
+const output =
+    '// packages: ' + Array.from(packages).sort().join(' ') + '\n' +
+    '// Generated by createRequireBundle.js, do not edit.\n' +
+    '// If ~/Library/node_modules contains one of these packages, the local server sends\n' +
+    '// an empty file instead, so the user\'s version is loaded.\n' +
+    '(self.Tarp = self.Tarp || {}).bundle = {\n' +
+    'resolved: ' + JSON.stringify(resolved, null, 0) + ',\n' +
+    'modules: ' + JSON.stringify(modules, null, 0) + '\n' +
+    '};\n';
+fs.writeFileSync(path.join(modulesDir, 'tarp_bundle.js'), output);
+console.log(`${Object.keys(modules).length} modules, ` +
+            `${Object.keys(resolved).length} resolutions, ` +
+            `${output.length} bytes. Not found: ${missing.join(' ')}`);
@@ -6356,6 +6356,14 @@ hterm.FindBar = function(terminal) {
    * @private {boolean}
    */
   this.selectedResultKnown_ = true;
+
+  /**
+   * Trigram index over the scrollback rows searched so far.
+   *
+   * @private {!hterm.FindBar.TrigramIndex}
+   * @const
+   */
+  this.index_ = new hterm.FindBar.TrigramIndex();
 };
 
 /** @typedef {{findRow: ?Element, rowResult: !Array<!hterm.FindBar.Result>}} */
@@ -6478,8 +6486,34 @@ hterm.FindBar.prototype.syncResults_ = function() {
   }
 
   const rowCount = this.terminal_.getRowCount();
+
+  // Rows already in the index only need to be checked if they contain all the
+  // trigrams of the search text.  The rest are scanned one by one, which also
+  // adds the scrollback rows among them to the index.
+  this.index_.truncate(this.terminal_.getScrollbackRowCount());
+  const candidates = this.index_.query(this.searchText_);
+  const scanStart = candidates ? this.index_.rowCount : 0;
+  let candidate = 0;
+
   const runNextBatch = () => {
-    const batchEnd = Math.min(this.batchRow_ + this.batchSize, rowCount);
+    let budget = this.batchSize;
+    if (candidates) {
+      const end = Math.min(candidate + budget, candidates.length);
+      budget -= end - candidate;
+      for (; candidate < end; candidate++) {
+        const rowNum = candidates[candidate];
+        if (this.findInRow_(rowNum)) {
+          this.matchingRowsIndex_.push(rowNum);
+        }
+        // Rows in between are known not to match.
+        this.batchRow_ = rowNum + 1;
+      }
+      if (candidate == candidates.length) {
+        this.batchRow_ = Math.max(this.batchRow_, scanStart);
+      }
+    }
+
+    const batchEnd = Math.min(this.batchRow_ + budget, rowCount);
     while (this.batchRow_ < batchEnd) {
       // Matching rows are pushed in order of searching to keep list sorted.
       if (this.findInRow_(this.batchRow_)) {
@@ -6520,6 +6554,12 @@ hterm.FindBar.prototype.findInRow_ = function(rowNum, update = false) {
   const rowText = this.terminal_.getRowText(rowNum).toLowerCase();
   const rowResult = [];
 
+  // Scrollback rows never change, so they can be indexed as they're scanned.
+  if (rowNum == this.index_.rowCount &&
+      rowNum < this.terminal_.getScrollbackRowCount()) {
+    this.index_.addRow(rowText);
+  }
+
   let i;
   let startIndex = 0;
   // Find and create highlight for matching texts.
@@ -6786,6 +6826,161 @@ hterm.FindBar.indexOf = function(arr, value) {
   return index;
 };
 
+/**
+ * Discard indexed rows that are no longer in the scrollback.
+ *
+ * The terminal calls this when it clears the scrollback, or moves rows back
+ * out of it onto the screen.
+ *
+ * @param {number} rowCount The number of rows left in the scrollback.
+ */
+hterm.FindBar.prototype.truncateIndex = function(rowCount) {
+  this.index_.truncate(rowCount);
+};
+
+/**
+ * An index from the trigrams of the (lower cased) text of rows to the rows
+ * containing them.
+ *
+ * Rows are added in order, so each posting list is sorted.  A search for text
+ * of three or more characters only has to look at the rows containing all of
+ * its trigrams.
+ *
+ * @constructor
+ */
+hterm.FindBar.TrigramIndex = function() {
+  /**
+   * Posting lists, keyed by trigram.
+   *
+   * @private {!Map<number, {rows: !Int32Array, size: number}>}
+   * @const
+   */
+  this.postings_ = new Map();
+
+  /**
+   * Number of rows indexed so far.
+   *
+   * @type {number}
+   */
+  this.rowCount = 0;
+};
+
+/**
+ * Pack the three UTF-16 code units of a trigram into one number.
+ *
+ * @param {string} text
+ * @param {number} i The index of the first code unit.
+ * @return {number}
+ */
+hterm.FindBar.TrigramIndex.key = function(text, i) {
+  return (text.charCodeAt(i) * 0x10000 + text.charCodeAt(i + 1)) * 0x10000 +
+      text.charCodeAt(i + 2);
+};
+
+/**
+ * Add the next row to the index.
+ *
+ * @param {string} text The lower cased row text.
+ */
+hterm.FindBar.TrigramIndex.prototype.addRow = function(text) {
+  const rowNum = this.rowCount++;
+  for (let i = 0; i + 3 <= text.length; i++) {
+    const key = hterm.FindBar.TrigramIndex.key(text, i);
+    let list = this.postings_.get(key);
+    if (!list) {
+      list = {rows: new Int32Array(4), size: 0};
+      this.postings_.set(key, list);
+    } else if (list.rows[list.size - 1] == rowNum) {
+      // Trigram seen earlier in this row.
+      continue;
+    } else if (list.size == list.rows.length) {
+      const rows = new Int32Array(list.size * 2);
+      rows.set(list.rows);
+      list.rows = rows;
+    }
+    list.rows[list.size++] = rowNum;
+  }
+};
+
+/**
+ * Drop rows from the end of the index.
+ *
+ * @param {number} rowCount The number of rows to keep.
+ */
+hterm.FindBar.TrigramIndex.prototype.truncate = function(rowCount) {
+  if (rowCount >= this.rowCount) {
+    return;
+  }
+
+  if (rowCount == 0) {
+    this.postings_.clear();
+  } else {
+    this.postings_.forEach((list, key) => {
+      while (list.size && list.rows[list.size - 1] >= rowCount) {
+        list.size--;
+      }
+      if (!list.size) {
+        this.postings_.delete(key);
+      }
+    });
+  }
+  this.rowCount = rowCount;
+};
+
+/**
+ * Find the indexed rows that may contain some text.
+ *
+ * @param {string} text The lower cased text to look for.
+ * @return {?Array<number>} Sorted row numbers that contain all the trigrams
+ *     of the text, or null if the text is too short to use the index.
+ */
+hterm.FindBar.TrigramIndex.prototype.query = function(text) {
+  if (text.length < 3 || this.rowCount == 0) {
+    return null;
+  }
+
+  const lists = [];
+  const seen = new Set();
+  for (let i = 0; i + 3 <= text.length; i++) {
+    const key = hterm.FindBar.TrigramIndex.key(text, i);
+    if (seen.has(key)) {
+      continue;
+    }
+    seen.add(key);
+    const list = this.postings_.get(key);
+    if (!list) {
+      return [];
+    }
+    lists.push(list);
+  }
+
+  // Walk the shortest list, advancing a cursor through each of the others.
+  lists.sort((a, b) => a.size - b.size);
+  const cursors = new Array(lists.length).fill(0);
+  const result = [];
+  const shortest = lists[0];
+  outer:
+  for (let i = 0; i < shortest.size; i++) {
+    const rowNum = shortest.rows[i];
+    for (let j = 1; j < lists.length; j++) {
+      const list = lists[j];
+      let k = cursors[j];
+      while (k < list.size && list.rows[k] < rowNum) {
+        k++;
+      }
+      cursors[j] = k;
+      if (k == list.size) {
+        break outer;
+      }
+      if (list.rows[k] != rowNum) {
+        continue outer;
+      }
+    }
+    result.push(rowNum);
+  }
+  return result;
+};
+
 /**
  * Returns true if matchingRowsIndex_ index can be used to find next
  * via binary search.
@@ -11280,7 +11475,7 @@ hterm.Screen.prototype.syncSelectionCaret = function(selection) {
  *     occur.
  */
 hterm.Screen.prototype.splitNode_ = function(node, offset) {
-  const afterNode = node.cloneNode(false);
+  const afterNode = hterm.TextAttributes.cloneContainer(node);
 
   const textContent = node.textContent;
   node.textContent = hterm.TextAttributes.nodeSubstr(node, 0, offset);
@@ -11403,10 +11598,9 @@ hterm.Screen.prototype.insertString = function(str, wcwidth = undefined) {
                !(cursorNode.wcNode ||
                  !cursorNode.asciiNode ||
                  cursorNode.tileNode ||
-                 cursorNode.style.textDecoration ||
-                 cursorNode.style.textDecorationStyle ||
-                 cursorNode.style.textDecorationLine ||
-                 cursorNode.style.backgroundColor)) {
+                 cursorNode.underline ||
+                 cursorNode.strikethrough ||
+                 cursorNode.hasBackground)) {
       // Second best case, the current node is able to hold the whitespace.
       cursorNode.textContent = (cursorNodeText += ws);
     } else {
@@ -11969,6 +12163,362 @@ hterm.Screen.CursorState.prototype.restore = function(vt) {
   vt.G2 = this.G2;
   vt.G3 = this.G3;
 };
+
+/**
+ * Compact storage for the rows that have scrolled off the top of the screen.
+ *
+ * Rows are not kept as DOM nodes once they are in the scrollback.  A row of
+ * plain text is stored as a string, a row with styled text as the list of its
+ * text runs, each pointing to a description of its span shared with all the
+ * spans that look the same.  Rows holding anything else (inline images, the
+ * image download prompt) are kept as they are.
+ *
+ * The ScrollPort only ever draws a screenful or two of rows, so nodes are
+ * built again when it asks for them, and the last few hundred are kept so that
+ * scrolling back and forth doesn't rebuild them every time.
+ */
+
+/**
+ * @param {!Document} document The document owning the rows built again.
+ * @constructor
+ */
+hterm.Scrollback = function(document) {
+  this.document_ = document;
+
+  /**
+   * One entry per row: a string, an array of text runs (see compactRow_), or
+   * the row itself.
+   *
+   * @type {!Array<string|!Array|!Element>}
+   */
+  this.rows_ = [];
+
+  /**
+   * The number of rows, so that callers can go on treating the scrollback
+   * like the array of rows it used to be.
+   *
+   * @type {number}
+   */
+  this.length = 0;
+
+  /**
+   * Nodes of stored rows, by row index, oldest first: the rows built again
+   * for the ScrollPort, and those it was still drawing when they scrolled off.
+   *
+   * @type {!Map<number, !Element>}
+   */
+  this.nodes_ = new Map();
+
+  /**
+   * Descriptions of the spans of stored rows, by their attributes.
+   *
+   * @type {!Map<string, !Object>}
+   */
+  this.styles_ = new Map();
+};
+
+/**
+ * Maximum number of row nodes kept in nodes_.
+ *
+ * @const {number}
+ */
+hterm.Scrollback.MAX_NODES = 512;
+
+/**
+ * Kinds of text runs that are bare text nodes rather than spans: plain, and
+ * marked as ASCII by hterm.TextAttributes.createContainer().
+ *
+ * @const {number}
+ */
+hterm.Scrollback.TEXT = 0;
+/** @const {number} */
+hterm.Scrollback.ASCII_TEXT = 1;
+
+/**
+ * The document owning the rows built again.
+ *
+ * @param {!Document} document
+ */
+hterm.Scrollback.prototype.setDocument = function(document) {
+  this.document_ = document;
+};
+
+/**
+ * Add a row that scrolled off the top of the screen.
+ *
+ * @param {!Element} row The row, already removed from the screen.
+ * @return {boolean} True if the scrollback only kept a copy of the row, and
+ *     the node may be reused.
+ */
+hterm.Scrollback.prototype.push = function(row) {
+  const index = this.length++;
+  const entry = this.compactRow_(row);
+  if (entry === null) {
+    this.rows_.push(row);
+    return false;
+  }
+
+  this.rows_.push(entry);
+  if (row.parentNode) {
+    // The ScrollPort is drawing it and may keep it around: make sure it gets
+    // the same node back if it asks for this row.
+    this.keepNode_(index, row);
+    return false;
+  }
+  return true;
+};
+
+/**
+ * Add a row of text with default attributes, as a single text node.
+ *
+ * @param {string} text The text of the row.
+ * @param {boolean} overflow Whether the line goes on in the next row.
+ */
+hterm.Scrollback.prototype.pushText = function(text, overflow) {
+  this.rows_.push(overflow ? [true, hterm.Scrollback.TEXT, text] : text);
+  this.length++;
+};
+
+/**
+ * Remove rows from the end of the scrollback, to put them back on the screen.
+ *
+ * @param {number} count The number of rows.
+ * @return {!Array<!Element>} The rows, oldest first.
+ */
+hterm.Scrollback.prototype.popRows = function(count) {
+  const start = this.length - count;
+  const rows = [];
+  for (let index = start; index < this.length; index++) {
+    rows.push(this.getRowNode(index));
+    this.nodes_.delete(index);
+  }
+  this.rows_.length = start;
+  this.length = start;
+  return rows;
+};
+
+/**
+ * Remove all the rows.
+ *
+ * @return {!Array<!Element>} The row nodes held for stored rows, which the
+ *     caller may reuse once they are no longer drawn.
+ */
+hterm.Scrollback.prototype.clear = function() {
+  const rows = Array.from(this.nodes_.values());
+  this.rows_.length = 0;
+  this.length = 0;
+  this.nodes_.clear();
+  this.styles_.clear();
+  return rows;
+};
+
+/**
+ * Get the node of a row, building it if needed.
+ *
+ * @param {number} index The row index.
+ * @return {!Element}
+ */
+hterm.Scrollback.prototype.getRowNode = function(index) {
+  const entry = this.rows_[index];
+  if (typeof entry != 'string' && !Array.isArray(entry)) {
+    return entry;
+  }
+
+  let row = this.nodes_.get(index);
+  if (!row) {
+    row = this.buildRow_(entry);
+    row.rowIndex = index;
+    this.keepNode_(index, row);
+  }
+  return row;
+};
+
+/**
+ * Get the text of a row, without building its node.
+ *
+ * @param {number} index The row index.
+ * @return {string}
+ */
+hterm.Scrollback.prototype.getRowText = function(index) {
+  const entry = this.rows_[index];
+  if (typeof entry == 'string') {
+    return entry;
+  }
+  if (!Array.isArray(entry)) {
+    return entry.textContent;
+  }
+
+  let text = '';
+  for (let i = 2; i < entry.length; i += 2) {
+    text += entry[i];
+  }
+  return text;
+};
+
+/**
+ * Whether the line of a row goes on in the next row.
+ *
+ * @param {number} index The row index.
+ * @return {boolean}
+ */
+hterm.Scrollback.prototype.hasLineOverflow = function(index) {
+  const entry = this.rows_[index];
+  if (typeof entry == 'string') {
+    return false;
+  }
+  if (!Array.isArray(entry)) {
+    return !!entry.getAttribute('line-overflow');
+  }
+  return entry[0];
+};
+
+/**
+ * Remember the node of a row, forgetting the oldest one if there are too many.
+ *
+ * @param {number} index The row index.
+ * @param {!Element} row The row.
+ */
+hterm.Scrollback.prototype.keepNode_ = function(index, row) {
+  this.nodes_.set(index, row);
+  if (this.nodes_.size > hterm.Scrollback.MAX_NODES) {
+    this.nodes_.delete(this.nodes_.keys().next().value);
+  }
+};
+
+/**
+ * Describe a row compactly.
+ *
+ * A row holding a single plain text node (the common case: text printed with
+ * default attributes goes into the text node the row was created with)
+ * becomes its text.
+ * Otherwise the description is an array: whether the line overflows, then for
+ * each text node or span, its kind (hterm.Scrollback.TEXT, ASCII_TEXT or the
+ * description of the span from getStyle_) followed by its text.
+ *
+ * @param {!Element} row The row.
+ * @return {?string|?Array} The description, or null if the row holds more
+ *     than text nodes and spans of text.
+ */
+hterm.Scrollback.prototype.compactRow_ = function(row) {
+  const overflow = !!row.getAttribute('line-overflow');
+  let node = row.firstChild;
+  if (!overflow && (!node || (!node.nextSibling &&
+                              node.nodeType == Node.TEXT_NODE &&
+                              !node.asciiNode))) {
+    return node ? node.nodeValue : '';
+  }
+
+  const entry = [overflow];
+  for (; node; node = node.nextSibling) {
+    if (node.nodeType == Node.TEXT_NODE) {
+      entry.push(node.asciiNode ? hterm.Scrollback.ASCII_TEXT :
+                                  hterm.Scrollback.TEXT,
+                 node.nodeValue);
+      continue;
+    }
+
+    const text = node.firstChild;
+    if (node.nodeName != 'SPAN' ||
+        (text && (text.nextSibling || text.nodeType != Node.TEXT_NODE))) {
+      return null;
+    }
+    entry.push(this.getStyle_(node), text ? text.nodeValue : '');
+  }
+  return entry;
+};
+
+/**
+ * Get the shared description of a span: its attributes, and the properties
+ * hterm.TextAttributes.createContainer() sets on it.
+ *
+ * @param {!Element} span The span.
+ * @return {!Object}
+ */
+hterm.Scrollback.prototype.getStyle_ = function(span) {
+  const style = {
+    className: span.className,
+    style: span.getAttribute('style'),
+    title: span.title,
+    styleCss: span.styleCss,
+    uriId: span.uriId,
+    hasBackground: span.hasBackground,
+    faint: span.faint,
+    blinkNode: span.blinkNode,
+    underline: span.underline,
+    strikethrough: span.strikethrough,
+    wcNode: span.wcNode,
+    asciiNode: span.asciiNode,
+    tileNode: span.tileNode,
+  };
+  const key = Object.values(style).join('\x00');
+  const shared = this.styles_.get(key);
+  if (shared) {
+    return shared;
+  }
+  this.styles_.set(key, style);
+  return style;
+};
+
+/**
+ * Build the node of a stored row.
+ *
+ * @param {string|!Array} entry The description from compactRow_.
+ * @return {!Element}
+ */
+hterm.Scrollback.prototype.buildRow_ = function(entry) {
+  const document = this.document_;
+  const row = document.createElement('x-row');
+  if (typeof entry == 'string') {
+    row.appendChild(document.createTextNode(entry));
+    return row;
+  }
+
+  if (entry[0]) {
+    row.setAttribute('line-overflow', true);
+  }
+  const cache = hterm.TextAttributes.StyleCache.forDocument(document);
+  for (let i = 1; i < entry.length; i += 2) {
+    const style = entry[i];
+    const text = entry[i + 1];
+    if (typeof style == 'number') {
+      const node = document.createTextNode(text);
+      if (style == hterm.Scrollback.ASCII_TEXT) {
+        node.asciiNode = true;
+      }
+      row.appendChild(node);
+      continue;
+    }
+
+    const span = cache.takeSpan() || document.createElement('span');
+    if (style.className) {
+      span.className = style.className;
+    }
+    if (style.style) {
+      span.setAttribute('style', style.style);
+    }
+    if (style.title) {
+      span.title = style.title;
+    }
+    span.styleCss = style.styleCss;
+    span.hasBackground = style.hasBackground;
+    span.faint = style.faint;
+    span.blinkNode = style.blinkNode;
+    span.underline = style.underline;
+    span.strikethrough = style.strikethrough;
+    span.wcNode = style.wcNode;
+    span.asciiNode = style.asciiNode;
+    span.tileNode = style.tileNode;
+    if (style.uriId) {
+      span.uriId = style.uriId;
+      span.addEventListener('click', hterm.openUrl.bind(null, style.title));
+    }
+    if (text) {
+      span.textContent = text;
+    }
+    row.appendChild(span);
+  }
+  return row;
+};
 // SOURCE FILE: hterm/js/hterm_scrollport.js
 // Copyright (c) 2012 The Chromium OS Authors. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be
@@ -14051,7 +14601,7 @@ hterm.Terminal = function({profileId} = {}) {
   this.document_ = window.document;
 
   // The rows that have scrolled off screen and are no longer addressable.
-  this.scrollbackRows_ = [];
+  this.scrollbackRows_ = new hterm.Scrollback(this.document_);
 
   // Saved tab stops.
   this.tabStops_ = [];
@@ -14136,6 +14686,20 @@ hterm.Terminal = function({profileId} = {}) {
   // Timeouts we might need to clear.
   this.timeouts_ = {};
 
+  // Detached rows (and through them, spans) kept for reuse.  See createRow_().
+  /** @type {!Array<!Element>} */
+  this.rowPool_ = [];
+
+  // Output flood handling.  When the host writes faster than we can paint, the
+  // output is queued and interpreted once per frame.  See interpret().
+  this.floodMode_ = false;
+  /** @type {!Array<string>} */
+  this.floodPending_ = [];
+  this.floodWindowStart_ = 0;
+  this.floodWindowSize_ = 0;
+  // True while a batch of queued flood output is being interpreted.
+  this.interpretingFlood_ = false;
+
   // The VT escape sequence interpreter.
   this.vt = new hterm.VT(this);
 
@@ -15377,7 +15941,7 @@ hterm.Terminal.prototype.realizeHeight_ = function(rowCount) {
     }
 
     const ary = this.screen_.shiftRows(deltaRows);
-    this.scrollbackRows_.push.apply(this.scrollbackRows_, ary);
+    ary.forEach((row) => this.pushScrollbackRow_(row));
 
     // We just removed rows from the top of the screen, we need to update
     // the cursor to match.
@@ -15387,8 +15951,8 @@ hterm.Terminal.prototype.realizeHeight_ = function(rowCount) {
 
     if (deltaRows <= this.scrollbackRows_.length) {
       const scrollbackCount = Math.min(deltaRows, this.scrollbackRows_.length);
-      const rows = this.scrollbackRows_.splice(
-          this.scrollbackRows_.length - scrollbackCount, scrollbackCount);
+      const rows = this.scrollbackRows_.popRows(scrollbackCount);
+      this.findBar.truncateIndex(this.scrollbackRows_.length);
       this.screen_.unshiftRows(rows);
       deltaRows -= scrollbackCount;
       cursor.row += scrollbackCount;
@@ -15453,6 +16017,7 @@ hterm.Terminal.prototype.scrollLineDown = function() {
  * Clear primary screen, secondary screen, and the scrollback buffer.
  */
 hterm.Terminal.prototype.wipeContents = function() {
+  this.floodPending_.length = 0;
   this.clearHome(this.primaryScreen_);
   this.clearHome(this.alternateScreen_);
 
@@ -15467,7 +16032,8 @@ hterm.Terminal.prototype.clearScrollback = function() {
   // We're going to throw it away which would leave the display invalid.
   this.scrollEnd();
 
-  this.scrollbackRows_.length = 0;
+  this.recycleRows_(this.scrollbackRows_.clear());
+  this.findBar.truncateIndex(0);
   this.scrollPort_.resetCache();
 
   [this.primaryScreen_, this.alternateScreen_].forEach((screen) => {
@@ -15659,35 +16225,253 @@ hterm.Terminal.prototype.setDefaultTabStops = function(start = 0) {
  * @param {string} str Sequence of characters to interpret or pass through.
  */
 hterm.Terminal.prototype.interpret = function(str) {
+  if (this.floodMode_) {
+    this.floodPending_.push(str);
+    return;
+  }
+
+  const now = Date.now();
+  if (now - this.floodWindowStart_ > hterm.Terminal.FLOOD_WINDOW_MS) {
+    this.floodWindowStart_ = now;
+    this.floodWindowSize_ = 0;
+  }
+  this.floodWindowSize_ += str.length;
+
+  if (this.floodWindowSize_ > hterm.Terminal.FLOOD_THRESHOLD &&
+      !this.accessibilityReader_.accessibilityEnabled) {
+    // The host is writing faster than anyone can read.  Stop painting every
+    // write and catch up once per frame instead.
+    this.floodMode_ = true;
+    this.floodPending_.push(str);
+    this.scheduleFloodFlush_();
+    return;
+  }
+
   this.scheduleSyncCursorPosition_();
   this.vt.interpret(str);
 };
 
 /**
- * Take over the given DIV for use as the terminal display.
+ * Amount of time over which the output rate is measured, in milliseconds.
  *
- * @param {!Element} div The div to use as the terminal display.
+ * @const {number}
  */
-hterm.Terminal.prototype.decorate = function(div) {
-  const charset = div.ownerDocument.characterSet.toLowerCase();
-  if (charset != 'utf-8') {
-    console.warn(`Document encoding should be set to utf-8, not "${charset}";` +
-                 ` Add <meta charset='utf-8'/> to your HTML <head> to fix.`);
-  }
-
-  this.div_ = div;
-  this.div_.style.borderStyle = 'solid';
-  this.div_.style.borderWidth = 0;
-  this.div_.style.boxSizing = 'border-box';
-
-  this.accessibilityReader_ = new hterm.AccessibilityReader(div);
-
-  this.scrollPort_.decorate(div, () => this.setupScrollPort_());
-};
+hterm.Terminal.FLOOD_WINDOW_MS = 100;
 
 /**
- * Initialisation of ScrollPort properties which need to be set after its DOM
- * has been initialised.
+ * Number of characters per FLOOD_WINDOW_MS above which we enter flood mode.
+ *
+ * @const {number}
+ */
+hterm.Terminal.FLOOD_THRESHOLD = 64 * 1024;
+
+/**
+ * How often queued output is interpreted while in flood mode, in milliseconds.
+ *
+ * @const {number}
+ */
+hterm.Terminal.FLOOD_FRAME_MS = 16;
+
+/**
+ * Schedule the next flush of queued output while in flood mode.
+ */
+hterm.Terminal.prototype.scheduleFloodFlush_ = function() {
+  if (this.timeouts_.floodFlush) {
+    return;
+  }
+
+  this.timeouts_.floodFlush = setTimeout(() => {
+    delete this.timeouts_.floodFlush;
+    const size = this.flushOutput();
+    // Leave flood mode as soon as a frame's worth of output drops below the
+    // rate that got us here.
+    if (size * hterm.Terminal.FLOOD_WINDOW_MS <
+        hterm.Terminal.FLOOD_THRESHOLD * hterm.Terminal.FLOOD_FRAME_MS) {
+      this.floodMode_ = false;
+      this.floodWindowStart_ = Date.now();
+      this.floodWindowSize_ = 0;
+    } else {
+      this.scheduleFloodFlush_();
+    }
+  }, hterm.Terminal.FLOOD_FRAME_MS);
+};
+
+/**
+ * Interpret any output queued up by flood mode right now.
+ *
+ * Callers that inspect the screen or cursor state directly should call this
+ * first so they don't see stale state while output is flooding in.
+ *
+ * @return {number} The number of characters that were interpreted.
+ */
+hterm.Terminal.prototype.flushOutput = function() {
+  if (!this.floodPending_.length) {
+    return 0;
+  }
+
+  const str = this.floodPending_.length == 1 ?
+      this.floodPending_[0] : this.floodPending_.join('');
+  this.floodPending_.length = 0;
+
+  this.interpretingFlood_ = true;
+  try {
+    // Complete lines that are going to scroll off the screen anyway are
+    // moved straight into the scrollback; only the remainder goes through the
+    // VT and the Screen.
+    const start = this.appendFloodLines_(str);
+    this.vt.interpret(start ? str.substring(start) : str);
+  } finally {
+    this.interpretingFlood_ = false;
+  }
+
+  this.scheduleSyncCursorPosition_();
+  if (this.scrollOnOutput_ || this.scrollPort_.isScrolledEnd) {
+    this.scheduleScrollDown_();
+  }
+  return str.length;
+};
+
+/**
+ * Turn the complete lines at the start of some flood output into rows.
+ *
+ * This is a shortcut for the common case of a command spewing plain text: it
+ * only handles printable ASCII lines with default attributes, printed from
+ * the start of an empty last row, and builds each row as a single text node
+ * (which is what the Screen would have produced).  The rows that end up
+ * above the screen go into the scrollback as plain text, the others replace
+ * the top of the screen.
+ *
+ * @param {string} str The queued output.
+ * @return {number} The number of characters consumed.
+ */
+hterm.Terminal.prototype.appendFloodLines_ = function(str) {
+  const screen = this.screen_;
+  const cursor = screen.cursorPosition;
+  const width = this.screenSize.width;
+  if (screen != this.primaryScreen_ ||
+      this.vt.parseState_.func != this.vt.parseUnknown_ ||
+      (!this.vt.codingSystemUtf8_ && this.vt[this.vt.GL].GL) ||
+      this.options_.insertMode || !this.options_.wraparound ||
+      this.vtScrollTop_ != null || this.vtScrollBottom_ != null ||
+      cursor.row != screen.rowsArray.length - 1 || cursor.column != 0 ||
+      cursor.overflow || !screen.textAttributes.isDefault() ||
+      screen.rowsArray[cursor.row].textContent != '' || width <= 0) {
+    return 0;
+  }
+
+  // The new rows: their text, and whether the line goes on in the next one.
+  const lines = [];
+  const overflows = [];
+  let consumed = 0;
+  let pos = 0;
+  while (pos < str.length) {
+    // Find the end of this run of printable ASCII.
+    let end = pos;
+    let cc = 0;
+    while (end < str.length) {
+      cc = str.charCodeAt(end);
+      if (cc < 0x20 || cc > 0x7e) {
+        break;
+      }
+      ++end;
+    }
+
+    // The line must be followed by a newline that returns to column 0.
+    let next;
+    if (end + 1 < str.length && cc == 0x0a &&
+        str.charCodeAt(end + 1) == 0x0d) {
+      next = end + 2;
+    } else if (end + 1 < str.length && cc == 0x0d &&
+               str.charCodeAt(end + 1) == 0x0a) {
+      next = end + 2;
+    } else if (end < str.length && cc == 0x0a &&
+               this.options_.autoCarriageReturn) {
+      next = end + 1;
+    } else {
+      break;
+    }
+
+    // Wrap the line the way print() would.
+    let offset = pos;
+    do {
+      const rowEnd = Math.min(offset + width, end);
+      lines.push(str.substring(offset, rowEnd));
+      overflows.push(rowEnd < end);
+      offset = rowEnd;
+    } while (offset < end);
+
+    pos = consumed = next;
+  }
+
+  if (!lines.length) {
+    return 0;
+  }
+
+  // Rows above the cursor, then the new rows, then the (empty) cursor row.
+  // Keep the last screenful and push the rest into the scrollback: new rows
+  // going there never need a node at all.
+  const firstChanged = this.scrollbackRows_.length;
+  const above = screen.shiftRows(cursor.row);
+  const scrolledOff = Math.max(
+      0, above.length + lines.length - (this.screenSize.height - 1));
+  const keep = [];
+  for (let i = 0; i < above.length; i++) {
+    if (i < scrolledOff) {
+      this.pushScrollbackRow_(above[i]);
+    } else {
+      keep.push(above[i]);
+    }
+  }
+  for (let i = 0; i < lines.length; i++) {
+    if (above.length + i < scrolledOff) {
+      this.scrollbackRows_.pushText(lines[i], overflows[i]);
+      continue;
+    }
+    const row = this.createRow_();
+    row.firstChild.nodeValue = lines[i];
+    if (overflows[i]) {
+      row.setAttribute('line-overflow', true);
+    }
+    keep.push(row);
+  }
+  screen.unshiftRows(keep);
+  this.renumberRows_(0, screen.rowsArray.length);
+  this.setAbsoluteCursorPosition(screen.rowsArray.length - 1, 0);
+
+  if (this.findBar.isVisible) {
+    for (let i = firstChanged; i < this.getRowCount(); i++) {
+      this.findBar.scheduleNotifyChanges(i);
+    }
+  }
+  this.scrollPort_.scheduleInvalidate();
+  return consumed;
+};
+
+/**
+ * Take over the given DIV for use as the terminal display.
+ *
+ * @param {!Element} div The div to use as the terminal display.
+ */
+hterm.Terminal.prototype.decorate = function(div) {
+  const charset = div.ownerDocument.characterSet.toLowerCase();
+  if (charset != 'utf-8') {
+    console.warn(`Document encoding should be set to utf-8, not "${charset}";` +
+                 ` Add <meta charset='utf-8'/> to your HTML <head> to fix.`);
+  }
+
+  this.div_ = div;
+  this.div_.style.borderStyle = 'solid';
+  this.div_.style.borderWidth = 0;
+  this.div_.style.boxSizing = 'border-box';
+
+  this.accessibilityReader_ = new hterm.AccessibilityReader(div);
+
+  this.scrollPort_.decorate(div, () => this.setupScrollPort_());
+};
+
+/**
+ * Initialisation of ScrollPort properties which need to be set after its DOM
+ * has been initialised.
  *
  * @private
  */
@@ -15712,6 +16496,7 @@ hterm.Terminal.prototype.setupScrollPort_ = function() {
       this.prefs_.getNumber('scroll-wheel-move-multiplier'));
 
   this.document_ = this.scrollPort_.getDocument();
+  this.scrollbackRows_.setDocument(this.document_);
   this.accessibilityReader_.decorate(this.document_);
   this.findBar.decorate(this.document_);
 
@@ -15913,8 +16698,8 @@ hterm.Terminal.prototype.blur = function() {
  * This is a method from the RowProvider interface.  The ScrollPort uses
  * it to fetch rows on demand as they are scrolled into view.
  *
- * TODO(rginda): Consider saving scrollback rows as (HTML source, text content)
- * pairs to conserve memory.
+ * Scrollback rows are built again from their compact form if needed; see
+ * hterm.Scrollback.
  *
  * @param {number} index The zero-based row index, measured relative to the
  *     start of the scrollback buffer.  On-screen rows will always have the
@@ -15924,7 +16709,7 @@ hterm.Terminal.prototype.blur = function() {
  */
 hterm.Terminal.prototype.getRowNode = function(index) {
   if (index < this.scrollbackRows_.length) {
-    return this.scrollbackRows_[index];
+    return this.scrollbackRows_.getRowNode(index);
   }
 
   const screenIndex = index - this.scrollbackRows_.length;
@@ -15948,10 +16733,18 @@ hterm.Terminal.prototype.getRowNode = function(index) {
  */
 hterm.Terminal.prototype.getRowsText = function(start, end) {
   const ary = [];
+  const scrollback = this.scrollbackRows_;
   for (let i = start; i < end; i++) {
-    const node = this.getRowNode(i);
-    ary.push(node.textContent);
-    if (i < end - 1 && !node.getAttribute('line-overflow')) {
+    let overflow;
+    if (i < scrollback.length) {
+      ary.push(scrollback.getRowText(i));
+      overflow = scrollback.hasLineOverflow(i);
+    } else {
+      const node = this.screen_.rowsArray[i - scrollback.length];
+      ary.push(node.textContent);
+      overflow = !!node.getAttribute('line-overflow');
+    }
+    if (i < end - 1 && !overflow) {
       ary.push('\n');
     }
   }
@@ -15959,6 +16752,17 @@ hterm.Terminal.prototype.getRowsText = function(start, end) {
   return ary.join('');
 };
 
+/**
+ * Return the number of rows in the scrollback buffer.
+ *
+ * Scrollback rows come first in the row numbering, and never change.
+ *
+ * @return {number} The number of rows in the scrollback buffer.
+ */
+hterm.Terminal.prototype.getScrollbackRowCount = function() {
+  return this.scrollbackRows_.length;
+};
+
 /**
  * Return the text content for a given row.
  *
@@ -15972,8 +16776,10 @@ hterm.Terminal.prototype.getRowsText = function(start, end) {
  * @return {string} A string containing the text value of the selected row.
  */
 hterm.Terminal.prototype.getRowText = function(index) {
-  const node = this.getRowNode(index);
-  return node.textContent;
+  if (index < this.scrollbackRows_.length) {
+    return this.scrollbackRows_.getRowText(index);
+  }
+  return this.getRowNode(index).textContent;
 };
 
 /**
@@ -16010,8 +16816,7 @@ hterm.Terminal.prototype.appendRows_ = function(count) {
   let cursorRow = this.screen_.rowsArray.length;
   const offset = this.scrollbackRows_.length + cursorRow;
   for (let i = 0; i < count; i++) {
-    const row = this.document_.createElement('x-row');
-    row.appendChild(this.document_.createTextNode(''));
+    const row = this.createRow_();
     row.rowIndex = offset + i;
     this.screen_.pushRow(row);
   }
@@ -16019,7 +16824,7 @@ hterm.Terminal.prototype.appendRows_ = function(count) {
   const extraRows = this.screen_.rowsArray.length - this.screenSize.height;
   if (extraRows > 0) {
     const ary = this.screen_.shiftRows(extraRows);
-    Array.prototype.push.apply(this.scrollbackRows_, ary);
+    ary.forEach((row) => this.pushScrollbackRow_(row));
     if (this.scrollPort_.isScrolledEnd) {
       this.scheduleScrollDown_();
     }
@@ -16032,6 +16837,78 @@ hterm.Terminal.prototype.appendRows_ = function(count) {
   this.setAbsoluteCursorPosition(cursorRow, 0);
 };
 
+/**
+ * Get an empty row node, reusing a recycled one if possible.
+ *
+ * @return {!Element} The row, holding a single empty text node.
+ */
+hterm.Terminal.prototype.createRow_ = function() {
+  if (this.rowPool_.length) {
+    return this.rowPool_.pop();
+  }
+
+  const row = this.document_.createElement('x-row');
+  row.appendChild(this.document_.createTextNode(''));
+  return row;
+};
+
+/**
+ * Maximum number of rows kept for reuse by createRow_().
+ *
+ * @const {number}
+ */
+hterm.Terminal.ROW_POOL_SIZE = 256;
+
+/**
+ * Recycle rows that have left the terminal for good.
+ *
+ * @param {!Array<!Element>} rows The rows.
+ */
+hterm.Terminal.prototype.recycleRows_ = function(rows) {
+  for (let i = 0; i < rows.length; i++) {
+    this.recycleRow_(rows[i]);
+  }
+};
+
+/**
+ * Recycle a row that has left the terminal for good.
+ *
+ * A row still attached to the document (i.e. drawn by the ScrollPort) is left
+ * alone.  The spans of a recycled row are handed to the text attributes' pool.
+ *
+ * @param {!Element} row The row.
+ */
+hterm.Terminal.prototype.recycleRow_ = function(row) {
+  if (this.rowPool_.length >= hterm.Terminal.ROW_POOL_SIZE ||
+      row.parentNode) {
+    return;
+  }
+
+  const attrs = this.screen_.textAttributes;
+  let node;
+  while ((node = row.lastChild)) {
+    row.removeChild(node);
+    attrs.recycleContainer(node);
+  }
+  row.removeAttribute('line-overflow');
+  row.rowIndex = undefined;
+  row.appendChild(this.document_.createTextNode(''));
+  this.rowPool_.push(row);
+};
+
+/**
+ * Move a row that scrolled off the top of the screen into the scrollback.
+ *
+ * Only a compact copy of most rows is kept there, so the node is recycled.
+ *
+ * @param {!Element} row The row, already removed from the screen.
+ */
+hterm.Terminal.prototype.pushScrollbackRow_ = function(row) {
+  if (this.scrollbackRows_.push(row)) {
+    this.recycleRow_(row);
+  }
+};
+
 /**
  * Create a DOM node for a new row and insert it at the current position.
  *
@@ -16041,10 +16918,9 @@ hterm.Terminal.prototype.appendRows_ = function(count) {
  * The cursor will be positioned at column 0.
  */
 hterm.Terminal.prototype.insertRow_ = function() {
-  const row = this.document_.createElement('x-row');
-  row.appendChild(this.document_.createTextNode(''));
+  const row = this.createRow_();
 
-  this.scrollbackRows_.push(this.screen_.shiftRow());
+  this.pushScrollbackRow_(this.screen_.shiftRow());
 
   const cursorRow = this.screen_.cursorPosition.row;
   this.screen_.insertRow(cursorRow, row);
@@ -16126,12 +17002,20 @@ hterm.Terminal.prototype.renumberRows_ = function(
  * @param {string} str The string to print.
  */
 hterm.Terminal.prototype.print = function(str) {
-  this.scheduleSyncCursorPosition_();
+  // In flood mode, the cursor & accessibility updates happen once per batch.
+  if (!this.interpretingFlood_) {
+    this.scheduleSyncCursorPosition_();
 
-  // Basic accessibility output for the screen reader.
-  this.accessibilityReader_.announce(str);
+    // Basic accessibility output for the screen reader.
+    this.accessibilityReader_.announce(str);
+  }
 
   let startOffset = 0;
+  // The codepoint covering column startOffset and the column it starts at, so
+  // that each row only scans its own columns rather than the whole string
+  // from the start (long lines would otherwise be quadratic).
+  let startIndex = 0;
+  let startIndexColumn = 0;
 
   let strWidth = lib.wc.strWidth(str);
   // Fun edge case: If the string only contains zero width codepoints (like
@@ -16163,7 +17047,20 @@ hterm.Terminal.prototype.print = function(str) {
           lib.wc.substr(str, strWidth - 1);
       count = strWidth;
     } else {
-      substr = lib.wc.substr(str, startOffset, count);
+      // Same as lib.wc.substr(str, startOffset, count).
+      if (startOffset) {
+        while (startIndex < str.length) {
+          const codePoint = str.codePointAt(startIndex);
+          const width = lib.wc.charWidth(codePoint);
+          if (startIndexColumn + width > startOffset) {
+            break;
+          }
+          startIndexColumn += width;
+          startIndex += (codePoint <= 0xffff) ? 1 : 2;
+        }
+      }
+      substr = lib.wc.substr(
+          startIndex ? str.substring(startIndex) : str, 0, count);
     }
 
     const tokens = hterm.TextAttributes.splitWidecharString(substr);
@@ -16186,7 +17083,7 @@ hterm.Terminal.prototype.print = function(str) {
         this.scrollbackRows_.length + this.screen_.cursorPosition.row);
   }
 
-  if (this.scrollOnOutput_) {
+  if (this.scrollOnOutput_ && !this.interpretingFlood_) {
     this.scrollPort_.scrollRowToBottom(this.getRowCount());
   }
 };
@@ -17929,7 +18826,7 @@ hterm.Terminal.prototype.onMouse_ = function(e) {
     if (e.type == 'click' && !e.shiftKey && (e.ctrlKey || e.metaKey)) {
       // Ignore links created using OSC-8 as those will open by themselves, and
       // the visible text is most likely not the URI they want anyways.
-      if (e.target.className === 'uri-node') {
+      if (e.target.classList && e.target.classList.contains('uri-node')) {
         return;
       }
 
@@ -18677,51 +19574,37 @@ hterm.TextAttributes.prototype.createContainer = function(textContent = '') {
     return node;
   }
 
-  const span = this.document_.createElement('span');
-  const style = span.style;
+  const cache = hterm.TextAttributes.StyleCache.forDocument(this.document_);
+  const span = cache.takeSpan() || this.document_.createElement('span');
   const classes = [];
 
-  if (this.foreground != this.DEFAULT_COLOR) {
-    style.color = this.foreground.toString();
-  }
-
-  if (this.background != this.DEFAULT_COLOR) {
-    style.backgroundColor = this.background.toString();
-  }
-
-  if (this.enableBold && this.bold) {
-    style.fontWeight = 'bold';
+  // The inline style for these attributes doubles as the key of the shared
+  // CSS class implementing them.
+  const css = this.getStyleCss_();
+  span.styleCss = css;
+  if (css) {
+    const className = cache.getClassName(css);
+    if (className) {
+      classes.push(className);
+    } else {
+      span.style.cssText = css;
+    }
   }
+  span.hasBackground = this.background != this.DEFAULT_COLOR;
 
   if (this.faint) {
     span.faint = true;
   }
 
-  if (this.italic) {
-    style.fontStyle = 'italic';
-  }
-
   if (this.blink) {
     classes.push('blink-node');
     span.blinkNode = true;
   }
 
-  let textDecorationLine = '';
   span.underline = this.underline;
-  if (this.underline) {
-    textDecorationLine += ' underline';
-    style.textDecorationStyle = this.underline;
-  }
-  if (this.underlineColor != this.DEFAULT_COLOR) {
-    style.textDecorationColor = this.underlineColor;
-  }
   if (this.strikethrough) {
-    textDecorationLine += ' line-through';
     span.strikethrough = true;
   }
-  if (textDecorationLine) {
-    style.textDecorationLine = textDecorationLine;
-  }
 
   if (this.wcNode) {
     classes.push('wc-node');
@@ -18753,6 +19636,189 @@ hterm.TextAttributes.prototype.createContainer = function(textContent = '') {
   return span;
 };
 
+/**
+ * Build the CSS declarations implementing the current attributes.
+ *
+ * Attributes that are implemented through classes (blink, wide characters,
+ * tiles, links) are not included.
+ *
+ * @return {string} The CSS declarations, empty if there are none.
+ */
+hterm.TextAttributes.prototype.getStyleCss_ = function() {
+  let css = '';
+
+  if (this.foreground != this.DEFAULT_COLOR) {
+    css += `color: ${this.foreground};`;
+  }
+
+  if (this.background != this.DEFAULT_COLOR) {
+    css += `background-color: ${this.background};`;
+  }
+
+  if (this.enableBold && this.bold) {
+    css += 'font-weight: bold;';
+  }
+
+  if (this.italic) {
+    css += 'font-style: italic;';
+  }
+
+  let textDecorationLine = '';
+  if (this.underline) {
+    textDecorationLine += ' underline';
+    css += `text-decoration-style: ${this.underline};`;
+  }
+  if (this.underlineColor != this.DEFAULT_COLOR) {
+    css += `text-decoration-color: ${this.underlineColor};`;
+  }
+  if (this.strikethrough) {
+    textDecorationLine += ' line-through';
+  }
+  if (textDecorationLine) {
+    css += `text-decoration-line:${textDecorationLine};`;
+  }
+
+  return css;
+};
+
+/**
+ * Hand a container that is no longer in use back for reuse.
+ *
+ * Only plain styled spans are kept; text nodes are cheap, and link spans
+ * carry event listeners we can't remove.
+ *
+ * @param {!Node} node The container, which must be detached from its row.
+ */
+hterm.TextAttributes.prototype.recycleContainer = function(node) {
+  if (node.nodeType != Node.ELEMENT_NODE || node.uriId) {
+    return;
+  }
+
+  hterm.TextAttributes.StyleCache.forDocument(this.document_).putSpan(node);
+};
+
+/**
+ * The CSS classes generated for text attributes, and a pool of spans ready
+ * for reuse, shared by all the TextAttributes of one document.
+ *
+ * Identical attribute sets share one generated class instead of each span
+ * carrying its own inline style.
+ *
+ * @param {!Document} document The document owning the spans.
+ * @constructor
+ */
+hterm.TextAttributes.StyleCache = function(document) {
+  this.document_ = document;
+
+  /** @type {?HTMLStyleElement} */
+  this.styleNode_ = null;
+
+  /** @type {!Map<string, string>} */
+  this.classNames_ = new Map();
+
+  /** @type {!Array<!Element>} */
+  this.spans_ = [];
+};
+
+/**
+ * Maximum number of generated classes.
+ *
+ * Beyond this (e.g. true color gradients), new attribute sets fall back to
+ * inline styles.
+ *
+ * @const {number}
+ */
+hterm.TextAttributes.StyleCache.MAX_CLASSES = 4096;
+
+/**
+ * Maximum number of spans kept for reuse.
+ *
+ * @const {number}
+ */
+hterm.TextAttributes.StyleCache.MAX_SPANS = 1024;
+
+/**
+ * Get the style cache for a document, creating it if needed.
+ *
+ * @param {!Document} document
+ * @return {!hterm.TextAttributes.StyleCache}
+ */
+hterm.TextAttributes.StyleCache.forDocument = function(document) {
+  if (!document.htermStyleCache_) {
+    document.htermStyleCache_ = new hterm.TextAttributes.StyleCache(document);
+  }
+  return document.htermStyleCache_;
+};
+
+/**
+ * Get the class implementing some CSS declarations, generating it if needed.
+ *
+ * The rules have to win over the stock and user styles the way the inline
+ * styles they replace did, e.g. over .uri-node:hover (0,2,0), so they are
+ * scoped under the row with the class repeated: x-row .c.c is (0,2,1).
+ *
+ * @param {string} css The CSS declarations.
+ * @return {?string} The class name, or null if the cache is full.
+ */
+hterm.TextAttributes.StyleCache.prototype.getClassName = function(css) {
+  let className = this.classNames_.get(css);
+  if (className !== undefined) {
+    return className;
+  }
+
+  if (this.classNames_.size >= hterm.TextAttributes.StyleCache.MAX_CLASSES ||
+      !this.document_.head) {
+    return null;
+  }
+
+  if (!this.styleNode_) {
+    this.styleNode_ = this.document_.createElement('style');
+    this.styleNode_.id = 'hterm:text-attributes';
+    this.document_.head.appendChild(this.styleNode_);
+  }
+
+  className = `hterm-attrs-${this.classNames_.size}`;
+  const sheet = this.styleNode_.sheet;
+  sheet.insertRule(`x-row .${className}.${className} { ${css} }`,
+                   sheet.cssRules.length);
+  this.classNames_.set(css, className);
+  return className;
+};
+
+/**
+ * Take a blank span from the pool.
+ *
+ * @return {?Element} A span, or null if the pool is empty.
+ */
+hterm.TextAttributes.StyleCache.prototype.takeSpan = function() {
+  return this.spans_.length ? this.spans_.pop() : null;
+};
+
+/**
+ * Reset a span and put it in the pool.
+ *
+ * @param {!Element} span The detached span.
+ */
+hterm.TextAttributes.StyleCache.prototype.putSpan = function(span) {
+  if (this.spans_.length >= hterm.TextAttributes.StyleCache.MAX_SPANS) {
+    return;
+  }
+
+  span.removeAttribute('class');
+  span.removeAttribute('style');
+  span.textContent = '';
+  span.styleCss = undefined;
+  span.hasBackground = undefined;
+  span.faint = undefined;
+  span.blinkNode = undefined;
+  span.underline = undefined;
+  span.strikethrough = undefined;
+  span.wcNode = undefined;
+  span.asciiNode = undefined;
+  span.tileNode = undefined;
+  this.spans_.push(span);
+};
+
 /**
  * Tests if the provided object (string, span or text node) has the same
  * style as this TextAttributes instance.
@@ -18771,28 +19837,21 @@ hterm.TextAttributes.prototype.matchesContainer = function(obj) {
     return this.isDefault();
   }
 
-  const style = obj.style;
-
   // We don't want to put multiple characters in a wcNode or a tile.
   // See the comments in createContainer.
   // For attributes that default to false, we do not require that obj have them
   // declared, so always normalize them using !! (to turn undefined into false)
-  // in the compares below.
+  // in the compares below.  The CSS comparison comes last as it's the most
+  // expensive; it covers the colors, bold, italic and decorations.
   return (!(this.wcNode || obj.wcNode) &&
           this.asciiNode == obj.asciiNode &&
           !(this.tileData != null || obj.tileNode) &&
           this.uriId == obj.uriId &&
-          (this.foreground == this.DEFAULT_COLOR &&
-           style.color == '') &&
-          (this.background == this.DEFAULT_COLOR &&
-           style.backgroundColor == '') &&
-          (this.underlineColor == this.DEFAULT_COLOR &&
-           style.textDecorationColor == '') &&
-          (this.enableBold && this.bold) == !!style.fontWeight &&
           this.blink == !!obj.blinkNode &&
-          this.italic == !!style.fontStyle &&
           this.underline == obj.underline &&
-          !!this.strikethrough == !!obj.strikethrough);
+          !!this.strikethrough == !!obj.strikethrough &&
+          obj.styleCss !== undefined &&
+          this.getStyleCss_() == obj.styleCss);
 };
 
 /**
@@ -18896,18 +19955,7 @@ hterm.TextAttributes.containersMatch = function(obj1, obj2) {
     return true;
   }
 
-  const style1 = obj1.style;
-  const style2 = obj2.style;
-
-  return (style1.color == style2.color &&
-          style1.backgroundColor == style2.backgroundColor &&
-          style1.backgroundColor == style2.backgroundColor &&
-          style1.fontWeight == style2.fontWeight &&
-          style1.fontStyle == style2.fontStyle &&
-          style1.textDecoration == style2.textDecoration &&
-          style1.textDecorationColor == style2.textDecorationColor &&
-          style1.textDecorationStyle == style2.textDecorationStyle &&
-          style1.textDecorationLine == style2.textDecorationLine);
+  return obj1.styleCss == obj2.styleCss;
 };
 
 /**
@@ -18922,6 +19970,38 @@ hterm.TextAttributes.containerIsDefault = function(obj) {
   return typeof obj == 'string' || obj.nodeType == Node.TEXT_NODE;
 };
 
+/**
+ * Static method to make a copy of a container, e.g. to split it in two.
+ *
+ * cloneNode() only copies attributes.  The properties set by createContainer,
+ * which matchesContainer and the width functions rely on, are copied here, and
+ * links get their click handler back.
+ *
+ * @param {!Node} node The text node or span to copy.
+ * @return {!Node} The copy, with the same text.
+ */
+hterm.TextAttributes.cloneContainer = function(node) {
+  const copy = node.cloneNode(false);
+  copy.asciiNode = node.asciiNode;
+  if (node.nodeType == Node.TEXT_NODE) {
+    return copy;
+  }
+
+  copy.styleCss = node.styleCss;
+  copy.hasBackground = node.hasBackground;
+  copy.faint = node.faint;
+  copy.blinkNode = node.blinkNode;
+  copy.underline = node.underline;
+  copy.strikethrough = node.strikethrough;
+  copy.wcNode = node.wcNode;
+  copy.tileNode = node.tileNode;
+  if (node.uriId) {
+    copy.uriId = node.uriId;
+    copy.addEventListener('click', hterm.openUrl.bind(null, node.title));
+  }
+  return copy;
+};
+
 /**
  * Static method to get the column width of a node's textContent.
  *
@@ -19171,10 +20251,11 @@ hterm.VT = function(terminal) {
   this.codingSystemUtf8_ = false;
   this.codingSystemLocked_ = false;
 
-  // Construct a regular expression to match the known one-byte control chars.
-  // This is used in parseUnknown_ to quickly scan a string for the next
-  // control character.
-  this.cc1Pattern_ = null;
+  // Lookup table over the 8-bit code units marking the known one-byte control
+  // chars.  This is used in parseUnknown_ to quickly scan a string for the
+  // next control character, and in parseCSI_ to classify embedded controls.
+  // Code units above 0xff are never control characters.
+  this.cc1Table_ = new Uint8Array(0x100);
   this.updateEncodingState_();
 };
 
@@ -19219,6 +20300,56 @@ hterm.VT.prototype.MOUSE_COORDINATES_UTF8 = 1;
  */
 hterm.VT.prototype.MOUSE_COORDINATES_SGR = 2;
 
+/**
+ * Character classes for the bytes that may appear inside a CSI sequence.
+ *
+ * This mirrors the "CSI param", "CSI intermediate" and "CSI dispatch" states
+ * of the classic VT500 parser state table.  See hterm.VT.CSI_CLASS_TABLE.
+ *
+ * @enum {number}
+ */
+hterm.VT.CsiClass = {
+  // Not valid in a CSI sequence: abort the sequence.
+  INVALID: 0,
+  // A C0 control; executed if it's a known one-byte control.
+  CONTROL: 1,
+  // '0' to '9'.
+  DIGIT: 2,
+  // ':' introduces a subargument.
+  COLON: 3,
+  // ';' separates arguments.
+  SEMICOLON: 4,
+  // ' ' to '/' and '<' to '?': leading or trailing modifiers.
+  MODIFIER: 5,
+  // '@' to '~' terminates the sequence.
+  FINAL: 6,
+};
+
+/**
+ * Precomputed CSI class of each 7-bit code unit.
+ *
+ * @const {!Uint8Array}
+ */
+hterm.VT.CSI_CLASS_TABLE = (() => {
+  const table = new Uint8Array(0x80);
+  for (let i = 0; i < 0x80; ++i) {
+    if (i < 0x20 || i == 0x7f) {
+      table[i] = hterm.VT.CsiClass.CONTROL;
+    } else if (i >= 0x40 && i <= 0x7e) {
+      table[i] = hterm.VT.CsiClass.FINAL;
+    } else if (i >= 0x30 && i <= 0x39) {
+      table[i] = hterm.VT.CsiClass.DIGIT;
+    } else if (i == 0x3a) {
+      table[i] = hterm.VT.CsiClass.COLON;
+    } else if (i == 0x3b) {
+      table[i] = hterm.VT.CsiClass.SEMICOLON;
+    } else {
+      table[i] = hterm.VT.CsiClass.MODIFIER;
+    }
+  }
+  return table;
+})();
+
 /**
  * ParseState constructor.
  *
@@ -19306,7 +20437,20 @@ hterm.VT.ParseState.prototype.parseInt = function(argstr, defaultValue) {
   }
 
   if (argstr) {
-    const ret = parseInt(argstr, 10);
+    // Accumulate the leading decimal digits by hand; this is hot for SGR
+    // heavy output.  Anything unusual goes through the builtin.
+    let ret = 0;
+    let i = 0;
+    for (; i < argstr.length; ++i) {
+      const digit = argstr.charCodeAt(i) - 0x30;
+      if (digit < 0 || digit > 9) {
+        break;
+      }
+      ret = ret * 10 + digit;
+    }
+    if (i == 0) {
+      ret = parseInt(argstr, 10);
+    }
     // An argument of zero is treated as the default value.
     return ret == 0 ? defaultValue : ret;
   }
@@ -19372,7 +20516,7 @@ hterm.VT.ParseState.prototype.peekRemainingBuf = function() {
  * @return {string} The next character in the buffer.
  */
 hterm.VT.ParseState.prototype.peekChar = function() {
-  return this.buf.substr(this.pos, 1);
+  return this.buf.charAt(this.pos);
 };
 
 /**
@@ -19382,7 +20526,7 @@ hterm.VT.ParseState.prototype.peekChar = function() {
  * @return {string} The next character in the buffer.
  */
 hterm.VT.ParseState.prototype.consumeChar = function() {
-  return this.buf.substr(this.pos++, 1);
+  return this.buf.charAt(this.pos++);
 };
 
 /**
@@ -19584,17 +20728,21 @@ hterm.VT.prototype.onTerminalMouse_ = function(e) {
  * @param {string} buf The buffer to interpret.
  */
 hterm.VT.prototype.interpret = function(buf) {
-  this.parseState_.resetBuf(buf);
+  const parseState = this.parseState_;
+  parseState.resetBuf(buf);
 
-  while (!this.parseState_.isComplete()) {
-    const func = this.parseState_.func;
-    const pos = this.parseState_.pos;
-    const buf = this.parseState_.buf;
+  // Each parse function consumes as much of the buffer as it can in one call
+  // (a whole printable run, a whole CSI sequence), so this loop only turns
+  // over once per state transition rather than once per character.
+  while (!parseState.isComplete()) {
+    const func = parseState.func;
+    const pos = parseState.pos;
+    const buf = parseState.buf;
 
-    this.parseState_.func.call(this, this.parseState_);
+    func.call(this, parseState);
 
-    if (this.parseState_.func == func && this.parseState_.pos == pos &&
-        this.parseState_.buf == buf) {
+    if (parseState.func == func && parseState.pos == pos &&
+        parseState.buf == buf) {
       throw new Error('Parser did not alter the state!');
     }
   }
@@ -19633,11 +20781,34 @@ hterm.VT.prototype.setEncoding = function(encoding) {
 hterm.VT.prototype.updateEncodingState_ = function() {
   // If we're in UTF8 mode, don't suport 8-bit escape sequences as we'll never
   // see those -- everything should be UTF8!
-  const cc1 = Object.keys(hterm.VT.CC1)
-      .filter((e) => !this.codingSystemUtf8_ || e.charCodeAt() < 0x80)
-      .map((e) => '\\x' + lib.f.zpad(e.charCodeAt().toString(16), 2))
-      .join('');
-  this.cc1Pattern_ = new RegExp(`[${cc1}]`);
+  this.cc1Table_.fill(0);
+  Object.keys(hterm.VT.CC1)
+      .map((e) => e.charCodeAt(0))
+      .filter((cc) => !this.codingSystemUtf8_ || cc < 0x80)
+      .forEach((cc) => this.cc1Table_[cc] = 1);
+};
+
+/**
+ * Whether a code unit is one of the known one-byte control characters.
+ *
+ * @param {number} cc The code unit to check.
+ * @return {boolean}
+ */
+hterm.VT.prototype.isControlCode_ = function(cc) {
+  return cc < 0x100 && this.cc1Table_[cc] == 1;
+};
+
+/**
+ * Print a run of plain text, mapping it through the GL character set first.
+ *
+ * @param {string} str The text to print.
+ */
+hterm.VT.prototype.printText_ = function(str) {
+  if (!this.codingSystemUtf8_ && this[this.GL].GL) {
+    str = this[this.GL].GL(str);
+  }
+
+  this.terminal.print(str);
 };
 
 /**
@@ -19650,35 +20821,33 @@ hterm.VT.prototype.updateEncodingState_ = function() {
  * @param {!hterm.VT.ParseState} parseState The current parse state.
  */
 hterm.VT.prototype.parseUnknown_ = function(parseState) {
-  const print = (str) => {
-    if (!this.codingSystemUtf8_ && this[this.GL].GL) {
-      str = this[this.GL].GL(str);
+  const buf = parseState.buf;
+  const end = buf.length;
+  const start = parseState.pos;
+  const table = this.cc1Table_;
+
+  // Scan for the end of the contiguous block of plain text.
+  let pos = start;
+  while (pos < end) {
+    const cc = buf.charCodeAt(pos);
+    if (cc < 0x100 && table[cc] == 1) {
+      break;
     }
-
-    this.terminal.print(str);
-  };
-
-  // Search for the next contiguous block of plain text.
-  const buf = parseState.peekRemainingBuf();
-  const nextControl = buf.search(this.cc1Pattern_);
-
-  if (nextControl == 0) {
-    // We've stumbled right into a control character.
-    this.dispatch('CC1', buf.substr(0, 1), parseState);
-    parseState.advance(1);
-    return;
+    ++pos;
   }
 
-  if (nextControl == -1) {
-    // There are no control characters in this string.
-    print(buf);
+  if (pos == end) {
+    // There are no control characters in the rest of this string.
+    this.printText_(start == 0 ? buf : buf.substring(start));
     parseState.reset();
     return;
   }
 
-  print(buf.substr(0, nextControl));
-  this.dispatch('CC1', buf.substr(nextControl, 1), parseState);
-  parseState.advance(nextControl + 1);
+  if (pos > start) {
+    this.printText_(buf.substring(start, pos));
+  }
+  this.dispatch('CC1', buf.charAt(pos), parseState);
+  parseState.advance(pos + 1 - start);
 };
 
 /**
@@ -19689,8 +20858,11 @@ hterm.VT.prototype.parseUnknown_ = function(parseState) {
  * @param {!hterm.VT.ParseState} parseState The current parse state.
  */
 hterm.VT.prototype.parseCSI_ = function(parseState) {
-  const ch = parseState.peekChar();
+  const buf = parseState.buf;
+  const end = buf.length;
   const args = parseState.args;
+  const table = hterm.VT.CSI_CLASS_TABLE;
+  let pos = parseState.pos;
 
   const finishParsing = () => {
     // Resetting the arguments isn't strictly necessary, but it makes debugging
@@ -19702,64 +20874,125 @@ hterm.VT.prototype.parseCSI_ = function(parseState) {
     parseState.resetParseFunction();
   };
 
-  if (ch >= '@' && ch <= '~') {
-    // This is the final character.
-    this.dispatch('CSI', this.leadingModifier_ + this.trailingModifier_ + ch,
-                  parseState);
-    finishParsing();
+  // Consume as much of the sequence as this buffer holds.  If the buffer ends
+  // mid-sequence, we keep this parse function and pick up where we left off.
+  while (pos < end) {
+    const cc = buf.charCodeAt(pos);
+    const cls = cc < 0x80 ? table[cc] : hterm.VT.CsiClass.CONTROL;
+
+    switch (cls) {
+      case hterm.VT.CsiClass.FINAL:
+        // This is the final character.
+        this.dispatch('CSI',
+                      this.leadingModifier_ + this.trailingModifier_ +
+                      String.fromCharCode(cc),
+                      parseState);
+        finishParsing();
+        parseState.pos = pos + 1;
+        return;
+
+      case hterm.VT.CsiClass.SEMICOLON:
+        // Parameter delimiter.
+        if (this.trailingModifier_) {
+          // Parameter delimiter after the trailing modifier.  That's a
+          // paddlin'.
+          finishParsing();
+          parseState.pos = pos + 1;
+          return;
+        }
 
-  } else if (ch == ';') {
-    // Parameter delimiter.
-    if (this.trailingModifier_) {
-      // Parameter delimiter after the trailing modifier.  That's a paddlin'.
-      finishParsing();
+        if (!args.length) {
+          // They omitted the first param, we need to supply it.
+          args.push('');
+        }
 
-    } else {
-      if (!args.length) {
-        // They omitted the first param, we need to supply it.
         args.push('');
-      }
+        ++pos;
+        break;
 
-      args.push('');
-    }
+      case hterm.VT.CsiClass.DIGIT:
+      case hterm.VT.CsiClass.COLON: {
+        // Next bytes in the current parameter.
+        if (this.trailingModifier_) {
+          // Numeric parameter after the trailing modifier.  That's a paddlin'.
+          finishParsing();
+          parseState.pos = pos + 1;
+          return;
+        }
 
-  } else if (ch >= '0' && ch <= '9' || ch == ':') {
-    // Next byte in the current parameter.
+        // Grab the whole run of parameter bytes at once.  '0' to '9' and ':'
+        // are the contiguous range 0x30 to 0x3a.
+        const runStart = pos;
+        let hasSubargs = false;
+        let next = cc;
+        do {
+          if (next == 0x3a) {
+            hasSubargs = true;
+          }
+          next = ++pos < end ? buf.charCodeAt(pos) : -1;
+        } while (next >= 0x30 && next <= 0x3a);
 
-    if (this.trailingModifier_) {
-      // Numeric parameter after the trailing modifier.  That's a paddlin'.
-      finishParsing();
-    } else {
-      if (!args.length) {
-        args[0] = ch;
-      } else {
-        args[args.length - 1] += ch;
-      }
+        const run = buf.substring(runStart, pos);
+        if (!args.length) {
+          args[0] = run;
+        } else {
+          args[args.length - 1] += run;
+        }
 
-      // Possible sub-parameters.
-      if (ch == ':') {
-        parseState.argSetSubargs(args.length - 1);
+        // Possible sub-parameters.
+        if (hasSubargs) {
+          parseState.argSetSubargs(args.length - 1);
+        }
+        break;
       }
-    }
 
-  } else if (ch >= ' ' && ch <= '?') {
-    // Modifier character.
-    if (!args.length) {
-      this.leadingModifier_ += ch;
-    } else {
-      this.trailingModifier_ += ch;
+      case hterm.VT.CsiClass.MODIFIER:
+        // Modifier character.
+        if (!args.length) {
+          this.leadingModifier_ += String.fromCharCode(cc);
+        } else {
+          this.trailingModifier_ += String.fromCharCode(cc);
+        }
+        ++pos;
+        break;
+
+      default:
+        if (this.isControlCode_(cc)) {
+          // Control character.  Its handler may switch parse functions (e.g.
+          // ESC or CAN), so hand control back to the main loop.
+          this.dispatch('CC1', String.fromCharCode(cc), parseState);
+        } else {
+          // Unexpected character in sequence, bail out.
+          finishParsing();
+        }
+        parseState.pos = pos + 1;
+        return;
     }
+  }
 
-  } else if (this.cc1Pattern_.test(ch)) {
-    // Control character.
-    this.dispatch('CC1', ch, parseState);
+  parseState.pos = pos;
+};
 
-  } else {
-    // Unexpected character in sequence, bail out.
-    finishParsing();
+/**
+ * Parse the character following an ESC and dispatch it.
+ *
+ * This is a prototype method (rather than a closure created by the ESC
+ * handler) so that entering the escape state doesn't allocate.
+ *
+ * @param {!hterm.VT.ParseState} parseState The current parse state.
+ */
+hterm.VT.prototype.parseESC_ = function(parseState) {
+  const ch = parseState.consumeChar();
+
+  if (ch == '\x1b') {
+    return;
   }
 
-  parseState.advance(1);
+  this.dispatch('ESC', ch, parseState);
+
+  if (parseState.func == this.parseESC_) {
+    parseState.resetParseFunction();
+  }
 };
 
 /**
@@ -19797,8 +21030,15 @@ hterm.VT.prototype.parseUntilStringTerminator_ = function(parseState) {
     }
   }
 
-  // eslint-disable-next-line no-control-regex
-  const nextTerminator = buf.search(/[\x1b\x07]/);
+  // Scan for the next ESC or BEL.
+  let nextTerminator = -1;
+  for (let i = 0; i < buf.length; ++i) {
+    const cc = buf.charCodeAt(i);
+    if (cc == 0x1b || cc == 0x07) {
+      nextTerminator = i;
+      break;
+    }
+  }
   const terminator = buf[nextTerminator];
   let foundTerminator;
 
@@ -19896,7 +21136,7 @@ hterm.VT.prototype.dispatch = function(type, code, parseState) {
     return;
   }
 
-  handler.apply(this, [parseState, code]);
+  handler.call(this, parseState, code);
 };
 
 /**
@@ -20286,21 +21526,7 @@ hterm.VT.CC1['\x1a'] = hterm.VT.CC1['\x18'];
  * @param {!hterm.VT.ParseState} parseState The current parse state.
  */
 hterm.VT.CC1['\x1b'] = function(parseState) {
-  function parseESC(parseState) {
-    const ch = parseState.consumeChar();
-
-    if (ch == '\x1b') {
-      return;
-    }
-
-    this.dispatch('ESC', ch, parseState);
-
-    if (parseState.func == parseESC) {
-      parseState.resetParseFunction();
-    }
-  }
-
-  parseState.func = parseESC;
+  parseState.func = this.parseESC_;
 };
 
 /**
@@ -0,0 +1,78 @@
+#!/usr/bin/env node
+// Benchmark for the napi-worker sample addon.
+//
+// For each case, reports the wall time and the longest stall of the event loop
+// (measured with a 1 ms interval timer running during the work):
+//
+//   large   SHA-256 of one large buffer: sha256Sync on the main thread, then
+//           sha256 on the thread pool.
+//   many    SHA-256 of many small buffers: crypto on the main thread, one
+//           sha256() per buffer, then a single sha256Batch() for all of them.
+//
+// Usage:
+//   node-gyp rebuild && node bench.js [--size MB] [--count N] [--item KB] [--runs N]
+
+'use strict';
+
+const crypto = require('crypto');
+const {performance} = require('perf_hooks');
+const {sha256, sha256Batch, sha256Sync} = require('./index.js');
+
+function option(name, defaultValue) {
+  const index = process.argv.indexOf('--' + name);
+  return (index >= 0) ? Number(process.argv[index + 1]) : defaultValue;
+}
+
+const size = option('size', 256) * 1024 * 1024;
+const count = option('count', 20000);
+const item = option('item', 4) * 1024;
+const runs = option('runs', 3);
+
+// Longest interval between two ticks while fn runs:
+async function measure(fn) {
+  let last = performance.now();
+  let stall = 0;
+  const timer = setInterval(() => {
+    const now = performance.now();
+    stall = Math.max(stall, now - last);
+    last = now;
+  }, 1);
+  const start = performance.now();
+  await fn();
+  const time = performance.now() - start;
+  stall = Math.max(stall, performance.now() - last);
+  clearInterval(timer);
+  return {time, stall};
+}
+
+async function bench(name, fn) {
+  let best = null;
+  for (let i = 0; i < runs + 1; i++) {
+    const result = await measure(fn);
+    if (i > 0 && (best == null || result.time < best.time)) {
+      best = result;  // first run is a warmup
+    }
+  }
+  console.log(`${name.padEnd(28)} ${best.time.toFixed(1).padStart(9)} ms` +
+              `   longest stall ${best.stall.toFixed(1).padStart(8)} ms`);
+}
+
+(async () => {
+  const large = crypto.randomBytes(size);
+  const small = [];
+  for (let i = 0; i < count; i++) {
+    small.push(crypto.randomBytes(item));
+  }
+  console.log(`large: ${size >> 20} MB`);
+  await bench('crypto (main thread)', () => crypto.createHash('sha256').update(large).digest());
+  await bench('sha256Sync (main thread)', () => sha256Sync(large));
+  await bench('sha256 (thread pool)', () => sha256(large));
+  console.log(`many: ${count} x ${item >> 10} KB`);
+  await bench('crypto (main thread)', () => small.map((b) => crypto.createHash('sha256').update(b).digest()));
+  await bench('sha256 per buffer', () => Promise.all(small.map((b) => sha256(b))));
+  await bench('sha256Batch', () => sha256Batch(small));
+  // Four batches: one crossing each, run in parallel on the pool.
+  const quarter = Math.ceil(count / 4);
+  await bench('sha256Batch x 4', () => Promise.all([0, 1, 2, 3].map(
+      (i) => sha256Batch(small.slice(i * quarter, (i + 1) * quarter)))));
+})();
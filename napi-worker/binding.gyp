@@ -0,0 +1,21 @@
+{
+  "targets": [{
+    "target_name": "napi_worker_hash",
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [ "-O3" ],
+      "xcode_settings": { "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+        "CLANG_CXX_LIBRARY": "libc++",
+        "MACOSX_DEPLOYMENT_TARGET": "10.9",
+      },
+      "msvs_settings": {
+        "VCCLCompilerTool": { "ExceptionHandling": 1 },
+      },
+    "sources": [
+      "src/hash.cc"
+    ],
+    "include_dirs": [
+      "<!@(node -p \"require('../Resources/node_modules/node-addon-api').include\")",
+    ]
+  }]
+}
@@ -0,0 +1,44 @@
+// JavaScript side of the napi-worker sample addon.
+//
+//   const {sha256, sha256Batch} = require('./napi-worker');
+//   const digest = await sha256(buffer, {signal, onProgress: (done, total) => ...});
+//
+// The buffers are read in place by the worker thread: don't modify them before
+// the Promise is settled.
+
+'use strict';
+
+const addon = require('./build/Release/napi_worker_hash.node');
+
+function run(start, input, options = {}) {
+  const {signal, onProgress} = options;
+  if (signal && signal.aborted) {
+    return Promise.reject(signal.reason);
+  }
+  const {promise, cancel} = start(input, onProgress);
+  if (!signal) {
+    return promise;
+  }
+  signal.addEventListener('abort', cancel, {once: true});
+  const cleanup = () => signal.removeEventListener('abort', cancel);
+  promise.then(cleanup, cleanup);
+  return promise;
+}
+
+/**
+ * SHA-256 of an ArrayBuffer, TypedArray, Buffer or DataView, on the thread pool.
+ * @return {!Promise<!ArrayBuffer>}
+ */
+function sha256(data, options) {
+  return run(addon.sha256, data, options);
+}
+
+/**
+ * SHA-256 of each buffer of an array, in a single task.
+ * @return {!Promise<!Array<!Uint8Array>>}
+ */
+function sha256Batch(buffers, options) {
+  return run(addon.sha256Batch, buffers, options);
+}
+
+module.exports = {sha256, sha256Batch, sha256Sync: addon.sha256Sync};
@@ -0,0 +1,229 @@
+// napi-worker.h: CPU-bound work for Node-API addons, off the event loop.
+//
+// A thin layer over Napi::AsyncWorker (node-addon-api, bundled in
+// Resources/node_modules/node-addon-api):
+//
+//  - NapiWorker::Task runs Run() on the libuv thread pool and settles a
+//    Promise with Result(). Start() returns {promise, cancel}.
+//  - Input buffers (ArrayBuffer, TypedArray, Buffer, DataView) are read in
+//    place from the worker thread: NapiWorker::InputBytes keeps a reference to
+//    the JavaScript object and does not copy it. JavaScript must not modify
+//    the buffer until the Promise is settled.
+//  - Results are handed back as external ArrayBuffers (NapiWorker::OutputBytes),
+//    without copying either.
+//  - cancel() removes the task from the queue if it has not started, or sets
+//    a flag that Run() checks with Cancelled(). Either way the Promise is
+//    rejected with an Error whose code is "ABORT_ERR".
+//  - ReportProgress() can be called from Run() as often as needed: calls to the
+//    JavaScript callback are coalesced, it only sees the latest value.
+//
+// Several inputs should go in one task (see sha256Batch in src/hash.cc): one
+// crossing to the thread pool for the whole batch, while independent tasks
+// still run in parallel on the UV_THREADPOOL_SIZE threads.
+//
+// Header-only. Requires C++ exceptions (NAPI_CPP_EXCEPTIONS) and NAPI_VERSION > 3.
+
+#ifndef NAPI_WORKER_H
+#define NAPI_WORKER_H
+
+#include <napi.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+
+#if !defined(NAPI_CPP_EXCEPTIONS) || (NAPI_VERSION <= 3)
+#error "napi-worker.h needs C++ exceptions and NAPI_VERSION > 3 (thread-safe functions)"
+#endif
+
+namespace NapiWorker {
+
+// Bytes of a JavaScript buffer, read from the worker thread without copying.
+class InputBytes {
+ public:
+  InputBytes() = default;
+
+  explicit InputBytes(const Napi::Value& value) {
+    if (value.IsArrayBuffer()) {
+      Napi::ArrayBuffer buffer = value.As<Napi::ArrayBuffer>();
+      data_ = static_cast<const uint8_t*>(buffer.Data());
+      size_ = buffer.ByteLength();
+    } else if (value.IsTypedArray()) {
+      Napi::TypedArray array = value.As<Napi::TypedArray>();
+      data_ = static_cast<const uint8_t*>(array.ArrayBuffer().Data()) + array.ByteOffset();
+      size_ = array.ByteLength();
+    } else if (value.IsDataView()) {
+      Napi::DataView view = value.As<Napi::DataView>();
+      data_ = static_cast<const uint8_t*>(view.ArrayBuffer().Data()) + view.ByteOffset();
+      size_ = view.ByteLength();
+    } else {
+      throw Napi::TypeError::New(value.Env(), "Expected an ArrayBuffer, a TypedArray or a DataView");
+    }
+    // Keeps the buffer alive until the task is done:
+    reference_ = Napi::Persistent(value.As<Napi::Object>());
+  }
+
+  InputBytes(InputBytes&&) = default;
+  InputBytes& operator=(InputBytes&&) = default;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  Napi::ObjectReference reference_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Bytes produced by the worker thread, given to JavaScript without copying.
+class OutputBytes {
+ public:
+  OutputBytes() = default;
+  explicit OutputBytes(size_t size)
+      : data_(static_cast<uint8_t*>(std::malloc(size > 0 ? size : 1))), size_(size) {
+    if (data_ == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+  OutputBytes(OutputBytes&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+  OutputBytes& operator=(OutputBytes&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+  OutputBytes(const OutputBytes&) = delete;
+  OutputBytes& operator=(const OutputBytes&) = delete;
+  ~OutputBytes() { std::free(data_); }
+
+  uint8_t* data() { return data_; }
+  size_t size() const { return size_; }
+
+  // Main thread only. The ArrayBuffer owns the memory afterwards.
+  Napi::ArrayBuffer Release(Napi::Env env) {
+    uint8_t* data = std::exchange(data_, nullptr);
+    size_t size = std::exchange(size_, 0);
+    return Napi::ArrayBuffer::New(env, data, size, [](Napi::Env, void* bytes) { std::free(bytes); });
+  }
+
+ private:
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Error used when a task is cancelled.
+inline Napi::Error AbortError(Napi::Env env) {
+  Napi::Error error = Napi::Error::New(env, "The operation was aborted");
+  error.Set("name", Napi::String::New(env, "AbortError"));
+  error.Set("code", Napi::String::New(env, "ABORT_ERR"));
+  return error;
+}
+
+class Task : public Napi::AsyncWorker {
+ public:
+  // Queues task and returns {promise, cancel}. onProgress, if it is a function,
+  // is called with (done, total) on the main thread.
+  static Napi::Object Start(Task* task, const Napi::Value& onProgress) {
+    Napi::Env env = task->Env();
+    std::shared_ptr<State> state = task->state_;
+    if (onProgress.IsFunction()) {
+      task->progress_ = Napi::ThreadSafeFunction::New(env, onProgress.As<Napi::Function>(), "NapiWorkerProgress", 0, 1);
+      task->hasProgress_ = true;
+    }
+    Napi::Object handle = Napi::Object::New(env);
+    handle.Set("promise", task->deferred_.Promise());
+    handle.Set("cancel", Napi::Function::New(env, [state](const Napi::CallbackInfo& info) {
+      if (state->task == nullptr || state->cancelled.exchange(true)) {
+        return;  // already settled, or already cancelled
+      }
+      Task* task = state->task;
+      // Not started yet: removed from the queue, OnOK/OnError won't be called.
+      if (napi_cancel_async_work(info.Env(), *task) == napi_ok) {
+        task->Finish();
+        task->deferred_.Reject(AbortError(info.Env()).Value());
+      }
+    }, "cancel"));
+    task->Queue();
+    return handle;
+  }
+
+ protected:
+  Task(Napi::Env env, const char* name)
+      : Napi::AsyncWorker(env, name), deferred_(Napi::Promise::Deferred::New(env)), state_(std::make_shared<State>()) {
+    state_->task = this;
+  }
+
+  // Worker thread. Throw (std::exception) or call SetError() to reject the Promise.
+  virtual void Run() = 0;
+  // Main thread: the value of the Promise.
+  virtual Napi::Value Result(Napi::Env env) = 0;
+
+  // Worker thread: true once cancel() has been called.
+  bool Cancelled() const { return state_->cancelled.load(std::memory_order_relaxed); }
+
+  // Worker thread. Coalesced: if the main thread hasn't run the previous call yet,
+  // it will see these values instead.
+  void ReportProgress(double done, double total) {
+    if (!hasProgress_) {
+      return;
+    }
+    state_->done.store(done, std::memory_order_relaxed);
+    state_->total.store(total, std::memory_order_relaxed);
+    if (state_->progressPending.exchange(true)) {
+      return;
+    }
+    std::shared_ptr<State> state = state_;
+    progress_.NonBlockingCall([state](Napi::Env env, Napi::Function callback) {
+      state->progressPending.store(false);
+      callback.Call({Napi::Number::New(env, state->done.load()), Napi::Number::New(env, state->total.load())});
+    });
+  }
+
+ private:
+  struct State {
+    Task* task = nullptr;  // main thread only; nullptr once settled
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> progressPending{false};
+    std::atomic<double> done{0};
+    std::atomic<double> total{0};
+  };
+
+  void Execute() override {
+    if (!Cancelled()) {
+      Run();
+    }
+  }
+
+  void OnOK() override {
+    Finish();
+    if (Cancelled()) {
+      deferred_.Reject(AbortError(Env()).Value());
+    } else {
+      deferred_.Resolve(Result(Env()));
+    }
+  }
+
+  void OnError(const Napi::Error& error) override {
+    Finish();
+    deferred_.Reject(Cancelled() ? AbortError(Env()).Value() : error.Value());
+  }
+
+  void Finish() {
+    state_->task = nullptr;
+    if (hasProgress_) {
+      hasProgress_ = false;
+      progress_.Release();
+    }
+  }
+
+  Napi::Promise::Deferred deferred_;
+  std::shared_ptr<State> state_;
+  Napi::ThreadSafeFunction progress_;
+  bool hasProgress_ = false;
+};
+
+}  // namespace NapiWorker
+
+#endif  // NAPI_WORKER_H
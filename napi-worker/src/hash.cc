@@ -0,0 +1,209 @@
+// Sample addon for napi-worker.h: SHA-256 of large buffers, and of batches of
+// buffers, computed on the libuv thread pool.
+//
+//   sha256(data, onProgress)       -> {promise: Promise<ArrayBuffer>, cancel}
+//   sha256Batch(array, onProgress) -> {promise: Promise<ArrayBuffer[]>, cancel}
+//   sha256Sync(data)               -> ArrayBuffer (on the main thread, for comparison)
+//
+// index.js wraps these with AbortSignal support.
+
+#include "../napi-worker.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// SHA-256 (FIPS 180-4).
+class Sha256 {
+ public:
+  static constexpr size_t kDigestSize = 32;
+
+  void Update(const uint8_t* data, size_t size) {
+    length_ += size;
+    if (buffered_ > 0) {
+      size_t count = std::min(size, sizeof(buffer_) - buffered_);
+      std::memcpy(buffer_ + buffered_, data, count);
+      buffered_ += count;
+      data += count;
+      size -= count;
+      if (buffered_ < sizeof(buffer_)) {
+        return;
+      }
+      Block(buffer_);
+      buffered_ = 0;
+    }
+    for (; size >= 64; data += 64, size -= 64) {
+      Block(data);
+    }
+    std::memcpy(buffer_, data, size);
+    buffered_ = size;
+  }
+
+  void Final(uint8_t* digest) {
+    uint64_t bits = length_ * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padSize = (buffered_ < 56) ? (56 - buffered_) : (120 - buffered_);
+    for (int i = 0; i < 8; i++) {
+      padding[padSize + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    Update(padding, padSize + 8);
+    for (int i = 0; i < 8; i++) {
+      digest[4 * i] = static_cast<uint8_t>(state_[i] >> 24);
+      digest[4 * i + 1] = static_cast<uint8_t>(state_[i] >> 16);
+      digest[4 * i + 2] = static_cast<uint8_t>(state_[i] >> 8);
+      digest[4 * i + 3] = static_cast<uint8_t>(state_[i]);
+    }
+  }
+
+ private:
+  static uint32_t Rotate(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+  void Block(const uint8_t* block) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+      w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+             (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = Rotate(w[i - 15], 7) ^ Rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = Rotate(w[i - 2], 17) ^ Rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+    for (int i = 0; i < 64; i++) {
+      uint32_t t1 = h + (Rotate(e, 6) ^ Rotate(e, 11) ^ Rotate(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+      uint32_t t2 = (Rotate(a, 2) ^ Rotate(a, 13) ^ Rotate(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+  }
+
+  uint32_t state_[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  uint64_t length_ = 0;
+  uint8_t buffer_[64];
+  size_t buffered_ = 0;
+};
+
+// Progress and cancellation are checked between chunks:
+constexpr size_t kChunkSize = 1 << 20;
+
+class HashTask : public NapiWorker::Task {
+ public:
+  HashTask(Napi::Env env, const Napi::Value& data)
+      : Task(env, "sha256"), input_(data), digest_(Sha256::kDigestSize) {}
+
+ protected:
+  void Run() override {
+    Sha256 hash;
+    for (size_t offset = 0; offset < input_.size(); offset += kChunkSize) {
+      if (Cancelled()) {
+        return;
+      }
+      hash.Update(input_.data() + offset, std::min(kChunkSize, input_.size() - offset));
+      ReportProgress(std::min(offset + kChunkSize, input_.size()), input_.size());
+    }
+    hash.Final(digest_.data());
+  }
+
+  Napi::Value Result(Napi::Env env) override { return digest_.Release(env); }
+
+ private:
+  NapiWorker::InputBytes input_;
+  NapiWorker::OutputBytes digest_;
+};
+
+// One task for many buffers: all the digests in a single ArrayBuffer, split into views at the end.
+class BatchTask : public NapiWorker::Task {
+ public:
+  BatchTask(Napi::Env env, const Napi::Array& array) : Task(env, "sha256Batch") {
+    inputs_.reserve(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      inputs_.emplace_back(array.Get(i));
+    }
+    digests_ = NapiWorker::OutputBytes(inputs_.size() * Sha256::kDigestSize);
+  }
+
+ protected:
+  void Run() override {
+    for (size_t i = 0; i < inputs_.size(); i++) {
+      if (Cancelled()) {
+        return;
+      }
+      Sha256 hash;
+      hash.Update(inputs_[i].data(), inputs_[i].size());
+      hash.Final(digests_.data() + i * Sha256::kDigestSize);
+      ReportProgress(i + 1, inputs_.size());
+    }
+  }
+
+  Napi::Value Result(Napi::Env env) override {
+    size_t count = inputs_.size();
+    Napi::ArrayBuffer buffer = digests_.Release(env);
+    Napi::Array result = Napi::Array::New(env, count);
+    for (size_t i = 0; i < count; i++) {
+      result.Set(i, Napi::Uint8Array::New(env, Sha256::kDigestSize, buffer, i * Sha256::kDigestSize));
+    }
+    return result;
+  }
+
+ private:
+  std::vector<NapiWorker::InputBytes> inputs_;
+  NapiWorker::OutputBytes digests_;
+};
+
+Napi::Value Hash(const Napi::CallbackInfo& info) {
+  return NapiWorker::Task::Start(new HashTask(info.Env(), info[0]), info[1]);
+}
+
+Napi::Value HashBatch(const Napi::CallbackInfo& info) {
+  if (!info[0].IsArray()) {
+    throw Napi::TypeError::New(info.Env(), "Expected an array of buffers");
+  }
+  return NapiWorker::Task::Start(new BatchTask(info.Env(), info[0].As<Napi::Array>()), info[1]);
+}
+
+Napi::Value HashSync(const Napi::CallbackInfo& info) {
+  NapiWorker::InputBytes input(info[0]);
+  NapiWorker::OutputBytes digest(Sha256::kDigestSize);
+  Sha256 hash;
+  hash.Update(input.data(), input.size());
+  hash.Final(digest.data());
+  return digest.Release(info.Env());
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("sha256", Napi::Function::New(env, Hash, "sha256"));
+  exports.Set("sha256Batch", Napi::Function::New(env, HashBatch, "sha256Batch"));
+  exports.Set("sha256Sync", Napi::Function::New(env, HashSync, "sha256Sync"));
+  return exports;
+}
+
+}  // namespace
+
+NODE_API_MODULE(napi_worker_hash, Init)
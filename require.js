@@ -117,6 +117,60 @@
     return cached;
   }
 
+  // NOTE iOS: create the cache item for a module whose source we already have.
+  function store(path, source) {
+    var href = (new URL(path, config.root)).href, cached;
+    cached = cache[href] = cache[href] || {
+      e: undefined, // error
+      m: undefined, // module
+      p: undefined, // promise
+      r: undefined, // request
+      s: undefined, // source
+      t: undefined, // type
+      u: href, // url
+    };
+    if (cached.s === undefined) {
+      cached.s = source;
+      cached.t = /\.json$/.test(href) ? "application/json" : "application/javascript";
+    }
+    return cached;
+  }
+
+  // NOTE iOS: the modules loaded at each start (buffer, process, @wasmer...) are in
+  //      node_modules/tarp_bundle.js, with the result of each of their require() calls
+  //      (see createRequireBundle.js). No request at all for these.
+  function loadBundled(id, pwd) {
+    var bundle = self.Tarp.bundle, path;
+    if (!bundle)
+      return null;
+    path = bundle.resolved[(new URL(".", pwd)).pathname + "\n" + id];
+    if (path === undefined)
+      return null;
+    return store(path, bundle.modules[path]);
+  }
+
+  // NOTE iOS: the local server tries the same candidates as below, in the same order, and
+  //      sends the path of the first one that exists, then its content. One request instead
+  //      of one per candidate. Returns undefined if the server didn't answer.
+  function loadResolved(id, pwd) {
+    var request = new XMLHttpRequest(), text, newline;
+    try {
+      request.open("GET", (new URL("/__resolve?pwd=" + encodeURIComponent((new URL(".", pwd)).pathname) +
+        "&id=" + encodeURIComponent(id), config.root)).href, false);
+      request.send();
+    }
+    catch (e) {
+      return undefined;
+    }
+    text = request.responseText;
+    newline = text.indexOf("\n");
+    if (newline < 0)
+      return undefined;
+    if (newline == 0)
+      return null; // no such module
+    return store(text.slice(0, newline), text.slice(newline + 1));
+  }
+
   function evaluate(cached, parent) {
     var module;
     if (!cached.m) {
@@ -164,9 +218,13 @@
 					  return evaluate(cached, parent).exports;
 				  }
 
-		  var cachedModule = null; 
+		  var pwd = (new URL(id[0] == "." ? (parent ? parent.uri : config.root) : config.paths[0], config.root)).href;
+		  var cachedModule = loadBundled(id, pwd);
 		  if (cachedModule == null) {
-			  var pwd = (new URL(id[0] == "." ? (parent ? parent.uri : config.root) : config.paths[0], config.root)).href;
+			  cachedModule = loadResolved(id, pwd);
+		  }
+		  if (cachedModule === undefined) {
+			  // The server didn't answer: try each candidate.
 			  cachedModule = load(id, pwd, ""); // no suffix at all
 			  // "browser" modules must take priority over package.json 
 			  // This might be a larger issue: package.json contains (often) index.js
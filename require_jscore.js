@@ -48,9 +48,18 @@
 			u: href, // url
 		};
 		var tmp, done, source, pattern, match, loading = 0, pwd2;
+		// iOS: each file is read once, and each file missing is only tried once:
+		if (cached.s !== undefined) {
+			return cached;
+		}
+		if (missing[href]) {
+			return null;
+		}
 		var responseText = jsc.readFile(href);
 		if (responseText == "") {
 			cached.e = new Error("Empty file " + href);
+			missing[href] = true;
+			delete cache[href];
 			return null;
 		}
 		cached.s = source = responseText;
@@ -112,7 +121,12 @@
       }
 
       var pwd = (new URL(id[0] == "." ? (parent ? parent.uri : config.root) : config.paths[0], config.root)).href;
-      var cachedModule = load(id, pwd, "", false); // no suffix at all
+      // iOS: the suffix that worked the last time for this id in this directory:
+      var key = (new URL(".", pwd)).href + "\n" + id;
+      var cachedModule = (key in resolved) ? load(id, pwd, resolved[key], false) : null;
+      if (cachedModule == null) {
+		 cachedModule = load(id, pwd, "", false); // no suffix at all
+	  }
       	// "browser" modules must take priority over package.json 
       	// This might be a larger issue: package.json contains (often) index.js
       	// Could be: "replace index.js with browser.js" (if it exists)
@@ -139,6 +153,10 @@
       if (cachedModule == null) {
       	  throw Error("Could not find module " + id)
 	  }
+      var base = (new URL(id, pwd)).href;
+      if (cachedModule.u.indexOf(base) == 0) {
+		 resolved[key] = cachedModule.u.slice(base.length);
+	  }
       return afterLoad(cachedModule); 
       /* return asyn ?
         new Promise(function(res, rej) { load(id, pwd, "/index.js", asyn).p.then(afterLoad).then(res, rej); }):
@@ -151,10 +169,12 @@
     return require;
   }
 
-  var cache, require;
+  var cache, missing, resolved, require;
 
   // NOTE Web-worker will use the origin, since location.href is not available.
   cache = Object.create(null);
+  missing = Object.create(null); // files that don't exist
+  resolved = Object.create(null); // directory + "\n" + id: suffix of the file found
   config = config || new Object();
   config.paths = config.paths || ["./node_modules/"];
   config.resolve = config.resolve || resolve;
@@ -46,7 +46,7 @@ function isInteractive(commandString) {
 	// (vim, ipython, ptpython, jupyter-console...) (see hterm.VT.CSI['n'])
 	// ssh and ssh-keygen (new version) are both interactive. So is scp. sftp is interactive until connected.
 	// vim is back on the list because it can be called by the Files app, and we have initialization issues.
-	let interactiveRegexp = /^less|^more|^vim|^ssh|^scp|^sftp|\|&? *less|\|&? *more|^man|^pico/;
+	let interactiveRegexp = /^less|^more|^vim|^ssh|^scp|^sftp|\|&? *less|\|&? *more|^man|^pico|^watch/;
 	return interactiveRegexp.test(commandString) 
 	// It's easier to match a regexp, then take the negation than to test a regexp that does not contain a pattern:
 	// This is disabled for now, but kept in case it can become useful again.
@@ -62,6 +62,354 @@ var currentCommandCursorPosition;
 var autocompleteList = []; 
 var autocompleteOn = false;
 var autocompleteIndex = 0;
+// Sorted list of commands (builtins + executables in $PATH), set by the app with setCommandList.
+var commandList = [];
+
+// Called by the app (at startup and by rehash) with the newline-separated list of commands.
+// It is sorted once here, so finding the commands starting with a prefix is a binary search.
+function setCommandList(commands) {
+	var list = commands.split("\n").sort();
+	commandList = list.filter((v, i) => (v.length > 0) && ((i == 0) || (v != list[i - 1])));
+}
+
+// First index in the sorted commandList for which isBefore(command) is false:
+function commandListSearch(isBefore) {
+	var low = 0; 
+	var high = commandList.length;
+	while (low < high) {
+		var mid = (low + high) >>> 1;
+		if (isBefore(commandList[mid])) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+// Range [start, end) of the commands starting with prefix in commandList:
+function commandListRange(prefix) {
+	var start = commandListSearch((command) => command < prefix);
+	var end = commandListSearch((command) => (command < prefix) || command.startsWith(prefix));
+	return [start, end];
+}
+
+// Longest common prefix of a list of strings. It is the common prefix of the
+// smallest and the largest of them, so there is no need to compare them all.
+function longestCommonPrefix(list) {
+	var min = list[0];
+	var max = list[0];
+	for (var i = 1, len = list.length; i < len; i++) {
+		if (list[i] < min) {
+			min = list[i];
+		} else if (list[i] > max) {
+			max = list[i];
+		}
+	}
+	var l = 0;
+	while ((l < min.length) && (min[l] == max[l])) {
+		l++;
+	}
+	return min.substr(0, l);
+}
+
+// Keyboard input for the running command is sent in batches: keys typed while the page is busy
+// (e.g. printing a flood of output) go to the app in a single message for each kind of input.
+var pendingInput = {'inputTTY:': '', 'input:': '', 'inputInteractive:': ''};
+var inputFlushScheduled = false;
+
+function postInput(kind, string) {
+	pendingInput[kind] += string;
+	if (!inputFlushScheduled) {
+		inputFlushScheduled = true;
+		setTimeout(flushInput, 0);
+	}
+}
+
+function flushInput() {
+	inputFlushScheduled = false;
+	for (const kind in pendingInput) {
+		if (pendingInput[kind] != '') {
+			window.webkit.messageHandlers.aShell.postMessage(kind + pendingInput[kind]);
+			pendingInput[kind] = '';
+		}
+	}
+}
+
+// History for the arrow keys and autocomplete. Restoring a window doesn't send it: the app
+// sends it with setCommandHistory the first time it is needed, so the prompt is there first.
+var commandHistoryLoaded = false;
+var commandHistoryRequested = false;
+var commandHistoryPendingKey = null; // key that needed the history, replayed once it is here
+
+function requestCommandHistory(key) {
+	if (key != null) {
+		commandHistoryPendingKey = key;
+	}
+	if (!commandHistoryRequested) {
+		commandHistoryRequested = true;
+		window.webkit.messageHandlers.aShell.postMessage('loadHistory:');
+		requestHistoryEntries(); // and the entries for Ctrl-R, while we're at it
+	}
+}
+
+// Called by the app with the history of this window, oldest first. It already contains the
+// commands typed since the window was restored.
+function setCommandHistory(commands) {
+	window.commandArray = commands;
+	window.commandIndex = commands.length;
+	window.maxCommandIndex = commands.length;
+	commandHistoryLoaded = true;
+	if (commandHistoryPendingKey != null) {
+		var key = commandHistoryPendingKey;
+		commandHistoryPendingKey = null;
+		if ((window.commandRunning == '') && !historySearchOn) {
+			window.term_.io.onVTKeystroke(key);
+		}
+	}
+}
+
+// Ctrl-R: fuzzy search in the history of all windows, ranked by frecency.
+// The app keeps the history in a database; addHistoryEntries receives the entries added since
+// the last request (historyLastId), aggregated by command, so each request is incremental.
+var historyLimit = 1000; // commands kept for the arrow keys. The database keeps them all.
+var historyEntries = new Map(); // command -> {command, lower, id, time, count, failures, rank}
+var historyLastId = 0;
+var historyRequestPending = false;
+var historySearchOn = false;
+var historySearchQuery = '';
+var historySearchSaved = ''; // command line before the search
+var historySearchStack = []; // {query, matches} for the successive queries, to narrow the search as the query grows
+var historySearchResults = []; // best matches, best first
+var historySearchIndex = 0;
+var historySearchMaxResults = 100;
+
+function requestHistoryEntries() {
+	if (!historyRequestPending) {
+		historyRequestPending = true;
+		window.webkit.messageHandlers.aShell.postMessage('historySearch:' + historyLastId);
+	}
+}
+
+// Called by the app. One line per command: last id, last use (seconds), uses, failures, command.
+function addHistoryEntries(entries) {
+	historyRequestPending = false;
+	if (entries.length > 0) {
+		for (const line of entries.split("\n")) {
+			var fields = [];
+			var start = 0;
+			while (fields.length < 4) {
+				var tab = line.indexOf("\t", start);
+				if (tab < 0) {
+					break;
+				}
+				fields.push(Number(line.substring(start, tab)));
+				start = tab + 1;
+			}
+			if (fields.length < 4) {
+				continue;
+			}
+			var command = line.substring(start);
+			var entry = historyEntries.get(command);
+			if (entry === undefined) {
+				historyEntries.set(command, {command: command, lower: command.toLowerCase(), 
+					id: fields[0], time: fields[1], count: fields[2], failures: fields[3], rank: 0.5}); // rank is a float
+			} else {
+				entry.id = Math.max(entry.id, fields[0]);
+				entry.time = Math.max(entry.time, fields[1]);
+				entry.count += fields[2];
+				entry.failures += fields[3];
+			}
+			historyLastId = Math.max(historyLastId, fields[0]);
+		}
+	}
+	if (historySearchOn) {
+		rankHistoryEntries();
+		historySearchStack = [];
+		updateHistorySearch();
+	}
+}
+
+// frecency: number of uses (failed commands count less), weighted by the time since the last use.
+function rankHistoryEntries() {
+	var now = Date.now() / 1000;
+	for (const entry of historyEntries.values()) {
+		var age = now - entry.time;
+		var weight = (age < 3600) ? 4 : (age < 86400) ? 2 : (age < 604800) ? 1 : (age < 2592000) ? 0.5 : 0.25;
+		entry.rank = Math.log2(1 + Math.max(entry.count - 0.75 * entry.failures, 0.25) * weight);
+	}
+}
+
+function isWordStart(string, position) {
+	return (position == 0) || (" /-_.=:'\"".indexOf(string[position - 1]) >= 0);
+}
+
+// Fuzzy match: the characters of query must appear in command, in that order.
+// Returns -1 if they don't. Contiguous matches and matches at the start of a word score higher.
+function historyMatchScore(command, query) {
+	if (query.length == 0) {
+		return 0;
+	}
+	var position = command.indexOf(query);
+	if (position >= 0) {
+		return 3 * query.length + 2 + (isWordStart(command, position) ? 2 : 0);
+	}
+	var score = 0;
+	var previous = -2;
+	for (var i = 0; i < query.length; i++) {
+		position = command.indexOf(query[i], previous + 1);
+		if (position < 0) {
+			return -1;
+		}
+		score += 1;
+		if (position == previous + 1) {
+			score += 1;
+		}
+		if (isWordStart(command, position)) {
+			score += 1;
+		}
+		previous = position;
+	}
+	return score;
+}
+
+function updateHistorySearch() {
+	var query = historySearchQuery;
+	// Only the entries matching the previous query can match a longer one:
+	var candidates = null;
+	while (historySearchStack.length > 0) {
+		var top = historySearchStack[historySearchStack.length - 1];
+		if (query.startsWith(top.query)) {
+			candidates = top.matches;
+			if (top.query == query) {
+				historySearchStack.pop();
+			}
+			break;
+		}
+		historySearchStack.pop();
+	}
+	if (candidates == null) {
+		candidates = Array.from(historyEntries.values());
+	}
+	// smart case: case-sensitive only if the query has upper case characters
+	var ignoreCase = (query == query.toLowerCase());
+	var matches = [];
+	var best = []; // the historySearchMaxResults best matches, sorted
+	for (const entry of candidates) {
+		var score = historyMatchScore(ignoreCase ? entry.lower : entry.command, query);
+		if (score < 0) {
+			continue;
+		}
+		matches.push(entry);
+		score += entry.rank;
+		if ((best.length == historySearchMaxResults) && (score <= best[best.length - 1].score)) {
+			continue;
+		}
+		if (best.length == historySearchMaxResults) {
+			best.pop();
+		}
+		// binary search for the position (higher score first, then most recent first):
+		var low = 0;
+		var high = best.length;
+		while (low < high) {
+			var mid = (low + high) >>> 1;
+			if ((best[mid].score > score) || ((best[mid].score == score) && (best[mid].entry.id > entry.id))) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		best.splice(low, 0, {entry: entry, score: score});
+	}
+	historySearchStack.push({query: query, matches: matches});
+	historySearchResults = best.map((v) => v.entry.command);
+	historySearchIndex = 0;
+	printHistorySearch();
+}
+
+// The search replaces the prompt line: (history)'query': match
+function printHistorySearch() {
+	var io = window.term_.io;
+	var scrolledLines = window.promptScroll - window.term_.scrollPort_.getTopRowIndex();
+	io.print('\x1b[' + (window.promptLine + scrolledLines + 1) + ';1H'); // move cursor to start of prompt line
+	io.print('\x1b[0J'); // delete display after cursor
+	if (historySearchResults.length > 0) {
+		io.print("(history)'" + historySearchQuery + "': " + historySearchResults[historySearchIndex]);
+	} else {
+		io.print("(failing history)'" + historySearchQuery + "': ");
+	}
+}
+
+function startHistorySearch() {
+	disableAutocompleteMenu();
+	historySearchOn = true;
+	historySearchQuery = '';
+	historySearchSaved = window.term_.io.currentCommand;
+	historySearchStack = [];
+	requestHistoryEntries(); // entries from other windows, or since the last search
+	rankHistoryEntries();
+	updateHistorySearch();
+}
+
+// Back to the prompt, with command on the command line.
+function endHistorySearch(command) {
+	var io = window.term_.io;
+	historySearchOn = false;
+	historySearchStack = [];
+	historySearchResults = [];
+	var scrolledLines = window.promptScroll - window.term_.scrollPort_.getTopRowIndex();
+	io.print('\x1b[' + (window.promptLine + scrolledLines + 1) + ';1H'); // move cursor to start of prompt line
+	io.print('\x1b[0J'); // delete display after cursor
+	printPrompt();
+	updatePromptPosition();
+	redrawCommand(command, command.length, null);
+	io.currentCommand = command;
+	cleanupLastLine();
+	currentCommandCursorPosition = command.length;
+	window.commandIndex = window.maxCommandIndex;
+}
+
+// Keys typed during a history search. Returns true if the key was used by the search, false
+// if it must be processed as usual (the search is over and the match is on the command line).
+function historySearchKeystroke(string) {
+	var match = (historySearchResults.length > 0) ? historySearchResults[historySearchIndex] : historySearchSaved;
+	switch (string) {
+		case String.fromCharCode(18):  // Ctrl-R: next match
+			if (historySearchIndex < historySearchResults.length - 1) {
+				historySearchIndex += 1;
+				printHistorySearch();
+			}
+			return true;
+		case String.fromCharCode(127): // delete key from iOS keyboard
+		case String.fromCharCode(8):   // Ctrl+H
+			if (historySearchQuery.length > 0) {
+				historySearchQuery = Array.from(historySearchQuery).slice(0, -1).join('');
+				updateHistorySearch();
+			}
+			return true;
+		case String.fromCharCode(7):   // Ctrl-G: cancel search
+		case String.fromCharCode(27):  // Escape: cancel search
+			endHistorySearch(historySearchSaved);
+			return true;
+		case String.fromCharCode(3):   // Ctrl-C: cancel search, then cancel command as usual
+			endHistorySearch(historySearchSaved);
+			return false;
+		case '\r':
+		case '\n':
+			endHistorySearch(match);
+			return false;
+		default:
+			if ((string.charCodeAt(0) >= 32) && !string.includes(String.fromCharCode(27))) {
+				// add to the query (several characters if pasting):
+				historySearchQuery += string.replaceAll('\r', '').replaceAll('\n', '');
+				updateHistorySearch();
+				return true;
+			}
+			// arrows and other control keys: accept the match and edit it.
+			endHistorySearch(match);
+			return false;
+	}
+}
 
 function disableAutocompleteMenu() {
 	printString('');
@@ -141,11 +489,13 @@ function printPrompt() {
 		window.interactiveCommandRunning = false;
 		window.term_.reportFocus = false; // That was causing ^[[I sometimes
 	} else {
-		window.webkit.messageHandlers.aShell.postMessage('input:' + '\n');
+		postInput('input:', '\n');
 	}
 }
 
 function updatePromptPosition() {
+	// output may still be queued if the command was flooding the terminal:
+	window.term_.flushOutput();
 	window.promptEnd = window.term_.screen_.cursorPosition.column;
 	var lastNewline = window.printedContent.lastIndexOf("\r");
 	var lastLine = window.printedContent.substr(lastNewline +1 ); // skip past last \n
@@ -162,6 +512,7 @@ function updatePromptPosition() {
 	window.promptLine = window.term_.screen_.cursorPosition.row;
 	window.promptScroll = window.term_.scrollPort_.getTopRowIndex();
 	currentCommandCursorPosition = 0; 
+	autocompleteDisplayed = '';
 }
 
 // returns the actual width, on screen, of a string, including with emojis.
@@ -191,92 +542,252 @@ function screenWidth(str) {
   return rv;
 }
 
-// prints a string and move the rest of the command around, even if it is over multiple lines
-// we use lib.wc.strWidth instead of length because of multiple-width characters (CJK, mostly).
-// TODO: get correct character width for emojis.
-function printString(string) {
-	var l = lib.wc.strWidth(string);
+// Line editor. The command is drawn after the prompt, from column window.promptEnd of the
+// prompt line, wrapping at the width of the terminal. commandLayout() gives the position on
+// screen of each character, so editing only prints the characters that changed, and moves
+// the cursor with a single escape sequence instead of one '\b' per column.
+var commandLayoutCache = {command: '', promptEnd: -1, width: -1, positions: new Uint32Array(256)};
+var autocompleteDisplayed = ''; // suggestion displayed at the cursor, not in io.currentCommand yet
 
-	var currentCommand = window.term_.io.currentCommand;
-	// clear the rest of the line, then reprint. 
-	window.term_.io.print('\x1b[0J'); // delete display after cursor
-	window.term_.io.print(string);
+function isHighSurrogate(c) {
+	return (c >= 0xd800) && (c <= 0xdbff);
+}
 
-	// print remainder of command line
-	window.term_.io.print(currentCommand.slice(currentCommandCursorPosition, currentCommand.length));
-	// move cursor back to where it was (don't use term.screen_.cursorPosition):
-	var endOfCommand = currentCommand.slice(currentCommandCursorPosition, currentCommand.length);
-	var endOfCommandWidth = lib.wc.strWidth(endOfCommand);
-	if ((lib.wc.strWidth(currentCommand) + lib.wc.strWidth(window.promptMessage) + 1 >= window.term_.screenSize.width) && (endOfCommandWidth == 0)) {
-		window.term_.io.print(' ');
-		endOfCommandWidth = 1;
-	} 
-	// window.term_.io.print has issues (known) when a wide char crosses the end of line. Annoying.
-	for (var i = 0; i < endOfCommandWidth; i++) {
-		window.term_.io.print('\b'); 
+function isLowSurrogate(c) {
+	return (c >= 0xdc00) && (c <= 0xdfff);
+}
+
+// Screen positions (row * width + column, row 0 being the prompt line) of each character of
+// command, and of its end in positions[command.length]. A wide character that doesn't fit at
+// the end of a row starts the next one, leaving an empty column, as hterm does.
+// Only the part after the first difference with the previous call is computed again.
+function commandLayout(command) {
+	var width = window.term_.screenSize.width;
+	var cache = commandLayoutCache;
+	var i = 0;
+	var position = window.promptEnd;
+	if ((cache.promptEnd == window.promptEnd) && (cache.width == width)) {
+		var max = Math.min(command.length, cache.command.length);
+		var common = 0;
+		while ((common < max) && (command.charCodeAt(common) == cache.command.charCodeAt(common))) {
+			common++;
+		}
+		if (common > 0) {
+			// start again from the last character that didn't change:
+			i = common - 1;
+			if ((i > 0) && isLowSurrogate(command.charCodeAt(i)) && isHighSurrogate(command.charCodeAt(i - 1))) {
+				i--;
+			}
+			position = cache.positions[i];
+		}
+	}
+	if (cache.positions.length <= command.length) {
+		var positions = new Uint32Array(Math.max(2 * cache.positions.length, command.length + 1));
+		positions.set(cache.positions.subarray(0, i + 1));
+		cache.positions = positions;
+	}
+	var positions = cache.positions;
+	while (i < command.length) {
+		var codePoint = command.codePointAt(i);
+		var charWidth = lib.wc.charWidth(codePoint);
+		if ((charWidth == 2) && (position % width == width - 1)) {
+			position++;
+		}
+		positions[i] = position;
+		if (codePoint > 0xffff) {
+			positions[i + 1] = position;
+			i++;
+		}
+		i++;
+		position += charWidth;
 	}
+	positions[command.length] = position;
+	cache.command = command;
+	cache.promptEnd = window.promptEnd;
+	cache.width = width;
+	return positions;
 }
 
-// prints a string for autocomplete and move the rest of the command around, even if it is over multiple lines.
-// keep the command as it is until autocomplete has been accepted.
-function printAutocompleteString(string) {
-	var currentCommand = window.term_.io.currentCommand;
-	// clear entire buffer, then reprint
-	window.term_.io.print('\x1b[0J'); // delete display after cursor
-	if (luminance(window.term_.getBackgroundColor()) < luminance(window.term_.getForegroundColor())) {
-		// We are in dark mode. Use yellow font for higher contrast
-		window.term_.io.print('\x1b[33m'); // yellow
+// Escape sequence moving the cursor from screen position "from" (where it is now) to "to".
+function commandCursorMove(from, to) {
+	var width = window.term_.screenSize.width;
+	var cursor = window.term_.screen_.cursorPosition;
+	if ((from == to) && !cursor.overflow) {
+		return '';
+	}
+	// screen row of the prompt line. At the end of a row, the cursor stays in the last column
+	// (overflow) until the next character is printed.
+	var promptRow = cursor.row + (cursor.overflow ? 1 : 0) - Math.floor(from / width);
+	return '\x1b[' + (promptRow + Math.floor(to / width) + 1) + ';' + (to % width + 1) + 'H';
+}
 
-	} else {
-		window.term_.io.print('\x1b[32m'); // green
-	}
-	window.term_.io.print(string); 
-	window.term_.io.print('\x1b[39m'); // back to normal foreground color
-	// print remainder of command line
-	window.term_.io.print(currentCommand.slice(currentCommandCursorPosition, currentCommand.length))
-	// move cursor back to where it was (don't use term.screen_.cursorPosition):
-	// don't use length because of multiple-byte chars.
-	var endOfCommand = currentCommand.slice(currentCommandCursorPosition, currentCommand.length);
-	var wcwidth = lib.wc.strWidth(endOfCommand) + lib.wc.strWidth(string);
-	for (var i = 0; i < wcwidth; i++) {
-		window.term_.io.print('\b'); 
+// index of the code point before string[i]
+function previousCodePoint(string, i) {
+	if ((i > 1) && isLowSurrogate(string.charCodeAt(i - 1)) && isHighSurrogate(string.charCodeAt(i - 2))) {
+		return i - 2;
 	}
+	return i - 1;
 }
 
-// behaves as if delete key is pressed.
-function deleteBackward() {
-	if (currentCommandCursorPosition <= 0) {
-		return;
+// true if string[i] belongs with the character before it on screen: combining marks, emoji
+// modifiers (skin color) and characters joined by a zero-width joiner.
+// hterm erases the whole cluster if we print over part of it.
+function continuesCluster(string, i) {
+	if ((i <= 0) || (i >= string.length)) {
+		return false;
 	}
+	var codePoint = string.codePointAt(i);
+	return (lib.wc.charWidth(codePoint) == 0) || ((codePoint >= 0x1f3fb) && (codePoint <= 0x1f3ff)) ||
+		(string.charCodeAt(i - 1) == 0x200d);
+}
 
-	var previousCursorPosition = 0;
-	var currentChar;
-	for (const v of window.term_.io.currentCommand) {
-		if (previousCursorPosition + v.length >= currentCommandCursorPosition) {
-			currentChar = v;
-			break;
+// The command line shows io.currentCommand, with the autocomplete suggestion (if any) at
+// currentCommandCursorPosition, and the cursor before the suggestion. Redraw it to show text,
+// with the cursor before text[cursor] and text[highlight[0]..highlight[1]] in color
+// (the new suggestion). Only the characters between the common beginning and the common end
+// of the old and new text are printed, and the end only if it has moved.
+function redrawCommand(text, cursor, highlight) {
+	var term = window.term_;
+	var width = term.screenSize.width;
+	var command = term.io.currentCommand;
+	var oldCursor = currentCommandCursorPosition;
+	var oldText = command.slice(0, oldCursor) + autocompleteDisplayed + command.slice(oldCursor);
+	term.flushOutput();
+	// common beginning and end:
+	var max = Math.min(oldText.length, text.length);
+	var start = 0;
+	while ((start < max) && (oldText.charCodeAt(start) == text.charCodeAt(start))) {
+		start++;
+	}
+	var suffix = 0;
+	while ((suffix < max - start) && (oldText.charCodeAt(oldText.length - 1 - suffix) == text.charCodeAt(text.length - 1 - suffix))) {
+		suffix++;
+	}
+	// the suggestions are redrawn, for their color:
+	if (autocompleteDisplayed.length > 0) {
+		start = Math.min(start, oldCursor);
+		suffix = Math.min(suffix, oldText.length - oldCursor - autocompleteDisplayed.length);
+	}
+	if (highlight) {
+		start = Math.min(start, highlight[0]);
+		suffix = Math.min(suffix, text.length - highlight[1]);
+	}
+	// don't cut inside a surrogate pair, or between a character and its combining marks:
+	while ((start > 0) && (isLowSurrogate(text.charCodeAt(start)) || isLowSurrogate(oldText.charCodeAt(start)) ||
+		continuesCluster(text, start) || continuesCluster(oldText, start))) {
+		start--;
+	}
+	while ((suffix > 0) && (isLowSurrogate(text.charCodeAt(text.length - suffix)) || continuesCluster(text, text.length - suffix) ||
+		continuesCluster(oldText, oldText.length - suffix))) {
+		suffix--;
+	}
+	var oldLayout = commandLayout(oldText);
+	var from = oldLayout[oldCursor];
+	var oldSuffixStart = oldLayout[oldText.length - suffix];
+	var oldEnd = oldLayout[oldText.length];
+	var layout = commandLayout(text);
+	var stop = text.length - suffix;
+	if (layout[stop] != oldSuffixStart) {
+		// the end has moved, print it too:
+		stop = text.length;
+	}
+	var end = layout[text.length];
+	var position = layout[start];
+	var colored = false;
+	if ((start > 0) && (position % width == 0)) {
+		// clear the empty column left by a wide character at the start of the row:
+		var previous = previousCodePoint(text, start);
+		position = Math.min(position, layout[previous] + lib.wc.charWidth(text.codePointAt(previous)));
+	}
+	var output = commandCursorMove(from, position);
+	for (var i = start; i < stop; ) {
+		if (highlight && (i == highlight[0]) && (i < highlight[1])) {
+			colored = true;
+			if (luminance(term.getBackgroundColor()) < luminance(term.getForegroundColor())) {
+				// We are in dark mode. Use yellow font for higher contrast
+				output += '\x1b[33m'; // yellow
+			} else {
+				output += '\x1b[32m'; // green
+			}
+		}
+		if (colored && (i >= highlight[1]) && !continuesCluster(text, i)) {
+			// (a combining mark after the suggestion would be lost after an escape sequence)
+			output += '\x1b[39m'; // back to normal foreground color
+			colored = false;
+		}
+		while (position < layout[i]) {
+			// empty column before a wide character, clear what was there
+			output += ' ';
+			position++;
 		}
-		previousCursorPosition += v.length;
+		var codePoint = text.codePointAt(i);
+		var next = i + ((codePoint > 0xffff) ? 2 : 1);
+		output += text.slice(i, next);
+		position = layout[i] + lib.wc.charWidth(codePoint);
+		i = next;
 	}
-	const currentCharWidth = lib.wc.strWidth(currentChar);
-	for (let i = 0; i < currentCharWidth; i++) {
-		window.term_.io.print('\b'); // move cursor back n chars, across lines
+	while (position < layout[stop]) {
+		// empty column before a wide character we don't print again
+		output += ' ';
+		position++;
 	}
+	if (colored) {
+		output += '\x1b[39m'; // back to normal foreground color
+	}
+	if (stop == text.length) {
+		if ((stop > start) && (end % width == 0)) {
+			// move the cursor to the start of the next row, so it is not stuck at the end of this one
+			output += ' \b';
+		}
+		if (oldEnd > end) {
+			output += '\x1b[0J'; // delete display after cursor
+		}
+	}
+	if (output.length > 0) {
+		term.io.print(output);
+		term.flushOutput();
+	}
+	output = commandCursorMove(position, layout[cursor]);
+	if (output.length > 0) {
+		term.io.print(output);
+	}
+	autocompleteDisplayed = highlight ? text.slice(highlight[0], highlight[1]) : '';
+}
 
-	window.term_.io.print('\x1b[0J'); // delete display after cursor
+// Move the cursor to io.currentCommand[index].
+function moveCommandCursor(index) {
+	redrawCommand(window.term_.io.currentCommand, index, null);
+	currentCommandCursorPosition = index;
+}
 
-	// print remainder of command line
-	const endOfCommand = window.term_.io.currentCommand.slice(currentCommandCursorPosition);
-	window.term_.io.print(endOfCommand);
+// print string at the cursor and move the rest of the command around, even if it is over multiple lines.
+// (the caller adds the string to io.currentCommand)
+function printString(string) {
+	var currentCommand = window.term_.io.currentCommand;
+	redrawCommand(currentCommand.slice(0, currentCommandCursorPosition) + string + currentCommand.slice(currentCommandCursorPosition),
+		currentCommandCursorPosition + string.length, null);
+}
 
-	// move cursor back to where it was (don't use term.screen_.cursorPosition):
-	const wcwidth = lib.wc.strWidth(endOfCommand);
-	for (let i = 0; i < wcwidth; i++) {
-		window.term_.io.print('\b');
+// prints a string for autocomplete and move the rest of the command around, even if it is over multiple lines.
+// keep the command as it is until autocomplete has been accepted.
+function printAutocompleteString(string) {
+	var currentCommand = window.term_.io.currentCommand;
+	redrawCommand(currentCommand.slice(0, currentCommandCursorPosition) + string + currentCommand.slice(currentCommandCursorPosition),
+		currentCommandCursorPosition, [currentCommandCursorPosition, currentCommandCursorPosition + string.length]);
+}
+
+// behaves as if delete key is pressed.
+function deleteBackward() {
+	if (currentCommandCursorPosition <= 0) {
+		return;
 	}
 
+	var currentCommand = window.term_.io.currentCommand;
+	var previousCursorPosition = previousCodePoint(currentCommand, currentCommandCursorPosition);
 	// remove character from command at current position:
-	window.term_.io.currentCommand = window.term_.io.currentCommand.slice(0, previousCursorPosition) + endOfCommand;
+	var newCommand = currentCommand.slice(0, previousCursorPosition) + currentCommand.slice(currentCommandCursorPosition);
+	redrawCommand(newCommand, previousCursorPosition, null);
+	window.term_.io.currentCommand = newCommand;
 	currentCommandCursorPosition = previousCursorPosition;
 }
 
@@ -434,30 +945,34 @@ function updateAutocompleteMenu(io, cursorPosition) {
 		}
 	}
 	if (matchToCommands) { 
-		// First, match command with history:
-		for (var i = 0 , len = window.commandArray.length; i < len ; i++) {
+		if (!commandHistoryLoaded) {
+			requestCommandHistory(null); // for the next time
+		}
+		// First, match command with history.
+		// Only keep the last version of the command from history (going backwards, keep the first one seen):
+		var seenInHistory = new Set();
+		for (var i = window.commandArray.length - 1; i >= 0; i--) {
 			if (window.commandArray[i].startsWith(predicate)) {
-				var value = window.commandArray[i].replace(predicate, ""); 
-				autocompleteList[numFound] = value;
-				lastFound = value; 
-				numFound += 1;
+				var value = window.commandArray[i].substr(predicate.length); 
+				if (!seenInHistory.has(value)) {
+					seenInHistory.add(value);
+					autocompleteList.push(value);
+					lastFound = value; 
+				}
 			}
 		}
-		// only keep the last version of the command from history:
-		unique = autocompleteList.filter((v,i,a) => a.lastIndexOf(v) == i);
-		autocompleteList = unique;
+		autocompleteList.reverse();
 		// Stop on latest command matching, up = history, down = commands.
 		numFound = autocompleteList.length;
 		if (numFound > 0) {
 			autocompleteIndex = autocompleteList.length - 1;
 		}
-		for (var i = 0, len = commandList.length; i < len; i++) {
-			if (commandList[i].startsWith(predicate)) {
-				var value = commandList[i].replace(predicate, "") + ' '; // add a space at the end if it's a command; 
-				autocompleteList[numFound] = value;
-				lastFound = value; 
-				numFound += 1;
-			}
+		var range = commandListRange(predicate);
+		for (var i = range[0]; i < range[1]; i++) {
+			var value = commandList[i].substr(predicate.length) + ' '; // add a space at the end if it's a command; 
+			autocompleteList[numFound] = value;
+			lastFound = value; 
+			numFound += 1;
 		}
 	} 
 	// Then add list of files from local directory:
@@ -514,30 +1029,16 @@ function updateAutocompleteMenu(io, cursorPosition) {
 		// Find largest starting substring:
 		if (((directory == lastDirectory) && (lastOnlyDirectories == listDirectories)) 
 				|| ((lastDirectory == '~bookmarkNames') && (predicate[0] == "~") && (lastOnlyDirectories == listDirectories))) {
-			var commonSubstring = ''
-			for (var l = 1; l < autocompleteList[0].length; l++) {
-				substring =  autocompleteList[0].substr(0, l)
-				var contained = true
-				for (var i = 0, len = autocompleteList.length; i < len; i++) {
-					if (!autocompleteList[i].startsWith(substring)) {
-						contained = false;
-						break;
-					}
-				}
-				if (contained) { 
-					commonSubstring = substring;
-				} else {
-					break;
-				}
-			}
+			// (stop before the end of the first element, so that it is not left empty)
+			var commonSubstring = longestCommonPrefix(autocompleteList);
+			commonSubstring = commonSubstring.substr(0, autocompleteList[0].length - 1);
 			if (commonSubstring.length > 0) {
 				printString(commonSubstring);
 				io.currentCommand = io.currentCommand.slice(0, currentCommandCursorPosition) + commonSubstring + 
 					io.currentCommand.slice(currentCommandCursorPosition, io.currentCommand.length);
 				currentCommandCursorPosition += commonSubstring.length;
 				for (var i = 0, len = autocompleteList.length; i < len; i++) {
-					var value = autocompleteList[i].replace(commonSubstring, "")
-					autocompleteList[i] = value; 
+					autocompleteList[i] = autocompleteList[i].substr(commonSubstring.length);
 				}
 			}
 			//
@@ -613,7 +1114,7 @@ function setupHterm() {
 			// endOffset = position of selection from start of endRow (not used)
 			var endOffset = this.scrollPort_.selection.endOffset;
 			var startPosition = this.io.currentCommand.indexOf(text)
-			var xcursor = startOffset;
+			var commandBeforeCut = this.io.currentCommand;
 			if (startPosition != -1) {
 				// check if text is inside currentCommand *once*, if yes, just remove it.
 				if (this.io.currentCommand.lastIndexOf(text) == startPosition) {
@@ -677,21 +1178,12 @@ function setupHterm() {
 						}
 					}
 				}
-				// Move cursor to startLine, startOffset
 				// We redraw the command ourselves because iOS removes extra spaces around the text.
-				// var scrolledLines = window.promptScroll - term.scrollPort_.getTopRowIndex();
-				// io.print('\x1b[' + (window.promptLine + scrolledLines + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor to position at start of line
-				xcursor = window.promptEnd + startPosition;
-				while (xcursor > this.screenSize.width) {
-					xcursor -= this.screenSize.width;
-				}
-				currentCommandCursorPosition = startPosition
-				var ycursor = startRow - this.scrollPort_.getTopRowIndex();
-				this.io.print('\x1b[' + (ycursor + 1) + ';' + (xcursor + 1) + 'H'); // move cursor to new position 
-				this.io.print('\x1b[0J'); // delete display after cursor
-				var endOfCommand = this.io.currentCommand.slice(startPosition, this.io.currentCommand.length); 
-				this.io.print(endOfCommand); 
-				this.io.print('\x1b[' + (ycursor + 1) + ';' + (xcursor + 1) + 'H'); // move cursor back to new position 
+				var cutCommand = this.io.currentCommand;
+				this.io.currentCommand = commandBeforeCut;
+				redrawCommand(cutCommand, startPosition, null);
+				this.io.currentCommand = cutCommand;
+				currentCommandCursorPosition = startPosition;
 				window.webkit.messageHandlers.aShell.postMessage('copy:' + text); // copy the text to clipboard. We can't use JS fonctions because we removed the text.
 				e.preventDefault();
 				return true;
@@ -745,7 +1237,7 @@ function setupHterm() {
 				window.webkit.messageHandlers.aShell.postMessage('controlOff');
 			}
 			// always post keyboard input to TTY:
-			window.webkit.messageHandlers.aShell.postMessage('inputTTY:' + string);
+			postInput('inputTTY:', string);
 			// If help() is running in iPython, then it stops being interactive.
 			// Q: why not necessary with python in v3.13?
 			var helpRunning = false;
@@ -766,22 +1258,27 @@ function setupHterm() {
 			if ((window.commandRunning != '') && (term.vt.mouseReport != term.vt.MOUSE_REPORT_DISABLED)) {
 				// if an application has enabled mouse report, it is likely to be interactive:
 				// (this was added for textual)
-				window.webkit.messageHandlers.aShell.postMessage('inputInteractive:' + string);
+				postInput('inputInteractive:', string);
 			} else if (window.interactiveCommandRunning && (window.commandRunning != '') && !helpRunning) {
 				// specific treatment for interactive commands: forward all keyboard input to them
 				// window.webkit.messageHandlers.aShell.postMessage('sending: ' + string); // for debugging
 				// post keyboard input to stdin
-				window.webkit.messageHandlers.aShell.postMessage('inputInteractive:' + string);
+				postInput('inputInteractive:', string);
 			} else if ((window.commandRunning != '') && ((string.charCodeAt(0) == 3) || (string.charCodeAt(0) == 4))) {
 				// Send control messages back to command:
 				// first, flush existing input:
 				if (io.currentCommand != '') {
-					window.webkit.messageHandlers.aShell.postMessage('input:' + io.currentCommand);
+					postInput('input:', io.currentCommand);
 					io.currentCommand = '';
 				}
+				// control characters are sent alone, after the input already typed:
+				flushInput();
 				window.webkit.messageHandlers.aShell.postMessage('input:' + string);
 			} else {
 				// window.webkit.messageHandlers.aShell.postMessage('Received character: ' + string + ' ' + string.length); // for debugging
+				if (historySearchOn && historySearchKeystroke(string)) {
+					return;
+				}
 				if (io.currentCommand === '') { 
 					// new line, reset things: (required for commands inside commands)
 					updatePromptPosition();
@@ -796,18 +1293,12 @@ function setupHterm() {
 							break;
 						}
 						// Before executing command, move to end of line if not already there, and cleanup the line content:
-						// Compute how many lines should we move downward:
-						var beginCommand = io.currentCommand.slice(0, currentCommandCursorPosition); 
-						var lineCursor = Math.floor((lib.wc.strWidth(beginCommand) + window.promptEnd)/ term.screenSize.width);
-						var lineEndCommand = Math.floor((lib.wc.strWidth(io.currentCommand) + window.promptEnd)/ term.screenSize.width);
-						for (var i = 0; i < lineEndCommand - lineCursor; i++) {
-							io.println('');
-						}
+						moveCommandCursor(io.currentCommand.length);
 						io.println('');
 						cleanupLastLine();
 						if (window.commandRunning != '') {
 							// The command takes care of the prompt. Just send the input data:
-							window.webkit.messageHandlers.aShell.postMessage('input:' + io.currentCommand + '\n');
+							postInput('input:', io.currentCommand + '\n');
 							// remove temporarily stored command -- if any
 							if (window.maxCommandInsideCommandIndex < window.commandInsideCommandArray.length) {
 								window.commandInsideCommandArray.pop();
@@ -840,8 +1331,8 @@ function setupHterm() {
 								if (io.currentCommand != window.commandArray[window.maxCommandIndex - 1]) {
 									// only add command to history if it is different from the last one:
 									window.maxCommandIndex = window.commandArray.push(window.commandRunning); 
-									while (window.maxCommandIndex >= 100) {
-										// We have stored more than 100 commands
+									while (window.maxCommandIndex >= historyLimit) {
+										// We have stored more than historyLimit commands
 										window.commandArray.shift(); // remove first element
 										window.maxCommandIndex = window.commandArray.length;
 									} 
@@ -893,8 +1384,6 @@ function setupHterm() {
 									// Store current command: 
 									window.commandInsideCommandArray[window.commandInsideCommandIndex] = io.currentCommand;
 								}
-								io.print('\x1b[' + (window.promptLine + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor back to initial position
-								io.print('\x1b[0J'); // delete display after cursor
 								if (string != String.fromCharCode(27) + "[1;3A") {
 									window.commandInsideCommandIndex -= 1;
 									if (window.commandInsideCommandIndex < 0) {
@@ -906,20 +1395,22 @@ function setupHterm() {
 										window.commandInsideCommandIndex = 0;
 									}
 								}
+								// redraw only what differs from the current command:
+								redrawCommand(window.commandInsideCommandArray[window.commandInsideCommandIndex], window.commandInsideCommandArray[window.commandInsideCommandIndex].length, null);
 								io.currentCommand = window.commandInsideCommandArray[window.commandInsideCommandIndex]; 
-								io.print(io.currentCommand);
 								cleanupLastLine();
 								currentCommandCursorPosition = io.currentCommand.length;
 							}
 						} else {
+							if (!commandHistoryLoaded) {
+								requestCommandHistory(string); // the up arrow will be replayed when it arrives
+								break;
+							}
 							if (window.commandIndex > 0) {
 								if (window.commandIndex === window.maxCommandIndex) {
 									// Store current command: 
 									window.commandArray[window.commandIndex] = io.currentCommand;
 								}
-								var scrolledLines = window.promptScroll - term.scrollPort_.getTopRowIndex();
-								io.print('\x1b[' + (window.promptLine + scrolledLines + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor to position at start of line
-								io.print('\x1b[0J'); // delete display after cursor
 								if (string != String.fromCharCode(27) + "[1;3A") {
 									window.commandIndex -= 1;
 								} else {
@@ -928,8 +1419,9 @@ function setupHterm() {
 										window.commandIndex = 0;
 									}
 								}
+								// redraw only what differs from the current command:
+								redrawCommand(window.commandArray[window.commandIndex], window.commandArray[window.commandIndex].length, null);
 								io.currentCommand = window.commandArray[window.commandIndex]; 
-								io.print(io.currentCommand);
 								cleanupLastLine();
 								currentCommandCursorPosition = io.currentCommand.length;
 							} 
@@ -948,8 +1440,6 @@ function setupHterm() {
 							break;
 						} else if (window.commandRunning != '') {
 							if (window.commandInsideCommandIndex < window.maxCommandInsideCommandIndex) {
-								io.print('\x1b[' + (window.promptLine + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor to position at start of line
-								io.print('\x1b[0J'); // delete display after cursor
 								if (string != String.fromCharCode(27) + "[1;3B") {
 									window.commandInsideCommandIndex += 1;
 								} else {
@@ -958,16 +1448,14 @@ function setupHterm() {
 										window.commandInsideCommandIndex = window.maxCommandInsideCommandIndex;
 									}
 								}
+								// redraw only what differs from the current command:
+								redrawCommand(window.commandInsideCommandArray[window.commandInsideCommandIndex], window.commandInsideCommandArray[window.commandInsideCommandIndex].length, null);
 								io.currentCommand = window.commandInsideCommandArray[window.commandInsideCommandIndex]; 
-								io.print(io.currentCommand);
 								cleanupLastLine();
 								currentCommandCursorPosition = io.currentCommand.length;
 							} 
 						} else {
 							if (window.commandIndex < window.maxCommandIndex) {
-								var scrolledLines = window.promptScroll - term.scrollPort_.getTopRowIndex();
-								io.print('\x1b[' + (window.promptLine + scrolledLines + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor to position at start of line
-								io.print('\x1b[0J'); // delete display after cursor
 								if (string != String.fromCharCode(27) + "[1;3B") {
 									window.commandIndex += 1;
 								} else {
@@ -976,8 +1464,9 @@ function setupHterm() {
 										window.commandIndex = window.maxCommandIndex;
 									}
 								}
+								// redraw only what differs from the current command:
+								redrawCommand(window.commandArray[window.commandIndex], window.commandArray[window.commandIndex].length, null);
 								io.currentCommand = window.commandArray[window.commandIndex]; 
-								io.print(io.currentCommand);
 								cleanupLastLine();
 								currentCommandCursorPosition = io.currentCommand.length;
 							}
@@ -993,21 +1482,12 @@ function setupHterm() {
 							disableAutocompleteMenu();
 						} else {
 							if (currentCommandCursorPosition > 0) { 
-								var previousCursorPosition = 0;
-								var currentChar;
-								for (const v of window.term_.io.currentCommand) {
-									if (previousCursorPosition + v.length >= currentCommandCursorPosition) {
-										currentChar = v;
-										break;
-									}
-									previousCursorPosition += v.length;
-								}
-								var currentCharWidth = lib.wc.strWidth(currentChar);
+								var previousCursorPosition = previousCodePoint(io.currentCommand, currentCommandCursorPosition);
 								this.document_.getSelection().empty();
-								for (var i = 0; i < currentCharWidth; i++) {
-									io.print('\b'); // move cursor back n chars, across lines
+								if (autocompleteOn) {
+									disableAutocompleteMenu();
 								}
-								currentCommandCursorPosition = previousCursorPosition;
+								moveCommandCursor(previousCursorPosition);
 							}
 						}
 						break;
@@ -1025,8 +1505,6 @@ function setupHterm() {
 						} else {
 							if (currentCommandCursorPosition < io.currentCommand.length) {
 								const codePoint = io.currentCommand.codePointAt(currentCommandCursorPosition);
-								var currentChar = String.fromCodePoint(codePoint);
-								var	currentCharWidth = lib.wc.strWidth(currentChar);
 								var nextCodePointPosition = currentCommandCursorPosition + 1;
 								if (codePoint >= 0x010000) {
 								    nextCodePointPosition += 1;
@@ -1038,7 +1516,6 @@ function setupHterm() {
 									if (isModifier) {
 										// advance over modifier:
 										nextCodePointPosition += 1;
-										currentCharWidth += nextChar.length;
 										if (nextCodePoint >= 0x010000) {
 											nextCodePointPosition += 1;
 										}
@@ -1048,7 +1525,6 @@ function setupHterm() {
 										if (nextCodePoint >= 0x010000) {
 											nextCodePointPosition += 1;
 										}
-										currentCharWidth += nextChar.length;
 										if (nextCodePointPosition < io.currentCommand.length) {
 											// Advance over the next character:
 											const nextCodePoint = io.currentCommand.codePointAt(nextCodePointPosition);
@@ -1056,19 +1532,13 @@ function setupHterm() {
 											if (nextCodePoint >= 0x010000) {
 												nextCodePointPosition += 1;
 											}
-											currentCharWidth += nextChar.length;
 											// Can I have a modifier in the middle of a joined-emoji?
 										}
 									} else {
 										break;
 									}
 								}
-								if (term.screen_.cursorPosition.column < term.screenSize.width - currentCharWidth) {
-									io.print('\x1b[' + currentCharWidth + 'C'); // move cursor forward n chars
-								} else {
-									io.print('\x1b[' + (term.screen_.cursorPosition.row + 2) + ';' + 0 + 'H'); // move cursor to start of next line
-								}
-								currentCommandCursorPosition = nextCodePointPosition;
+								moveCommandCursor(nextCodePointPosition);
 								this.document_.getSelection().empty();
 							}
 						}
@@ -1076,36 +1546,27 @@ function setupHterm() {
 					case String.fromCharCode(27) + "[1;3D":  // Alt-left arrow
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition > 0) { // prompt.length
-							while (currentCommandCursorPosition > 0) {
+							var wordPosition = currentCommandCursorPosition;
+							while (wordPosition > 0) {
 								// get previous char, emoji compatible
-								var previousCursorPosition = 0;
-								var currentChar;
-								for (const v of window.term_.io.currentCommand) {
-									if (previousCursorPosition + v.length >= currentCommandCursorPosition) {
-										currentChar = v;
-										break;
-									}
-									previousCursorPosition += v.length;
-								}
-								var currentCharWidth = lib.wc.strWidth(currentChar);
-								currentCommandCursorPosition = previousCursorPosition;
-								for (var i = 0; i < currentCharWidth; i++) {
-									io.print('\b'); // move cursor back n chars, across lines
-								}
+								var previousCursorPosition = previousCodePoint(io.currentCommand, wordPosition);
+								var currentChar = io.currentCommand.slice(previousCursorPosition, wordPosition);
+								wordPosition = previousCursorPosition;
 								if  (!isLetter(currentChar)) {
 									break;
 								}
 							}
+							moveCommandCursor(wordPosition);
 						}
 						break;
 					case String.fromCharCode(27) + "[1;3C":  // Alt-right arrow
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition < io.currentCommand.length) { // prompt.length
-							while (currentCommandCursorPosition < io.currentCommand.length) {
-								const codePoint = io.currentCommand.codePointAt(currentCommandCursorPosition);
+							var wordPosition = currentCommandCursorPosition;
+							while (wordPosition < io.currentCommand.length) {
+								const codePoint = io.currentCommand.codePointAt(wordPosition);
 								var currentChar = String.fromCodePoint(codePoint);
-								var currentCharWidth = lib.wc.strWidth(currentChar);
-								var nextCodePointPosition = currentCommandCursorPosition + 1;
+								var nextCodePointPosition = wordPosition + 1;
 								if (codePoint >= 0x010000) {
 								    nextCodePointPosition += 1;
 								}
@@ -1117,7 +1578,6 @@ function setupHterm() {
 									if (isModifier) {
 										// advance over modifier:
 										nextCodePointPosition += 1;
-										currentCharWidth += nextChar.length;
 										if (nextCodePoint >= 0x010000) {
 											nextCodePointPosition += 1;
 										}
@@ -1127,7 +1587,6 @@ function setupHterm() {
 										if (nextCodePoint >= 0x010000) {
 											nextCodePointPosition += 1;
 										}
-										currentCharWidth += nextChar.length;
 										if (nextCodePointPosition < io.currentCommand.length) {
 											// Advance over the next character:
 											const nextCodePoint = io.currentCommand.codePointAt(nextCodePointPosition);
@@ -1135,23 +1594,18 @@ function setupHterm() {
 											if (nextCodePoint >= 0x010000) {
 												nextCodePointPosition += 1;
 											}
-											currentCharWidth += nextChar.length;
 											// Can I have a modifier in the middle of a joined-emoji?
 										}
 									} else {
 										break;
 									}
 								}
-								if (term.screen_.cursorPosition.column < term.screenSize.width - currentCharWidth) {
-									io.print('\x1b[' + currentCharWidth + 'C'); // move cursor forward n chars
-								} else {
-									io.print('\x1b[' + (term.screen_.cursorPosition.row + 2) + ';' + 0 + 'H'); // move cursor to start of next line
-								}
-								currentCommandCursorPosition = nextCodePointPosition;
+								wordPosition = nextCodePointPosition;
 								if  (!isLetter(currentChar)) {
 									break;
 								}
 							}
+							moveCommandCursor(wordPosition);
 						}
 						break;
 					case String.fromCharCode(9):  // Tab, so autocomplete
@@ -1173,28 +1627,24 @@ function setupHterm() {
 							currentCommandCursorPosition += 4;
 						}
 						break;
+					case String.fromCharCode(18):  // Ctrl-R: fuzzy search in history
+						if (window.commandRunning == '') {
+							startHistorySearch();
+						}
+						break;
 					case String.fromCharCode(1):  // Ctrl-A: beginnging of line
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition > 0) { // prompt.length
-							var scrolledLines = window.promptScroll - this.scrollPort_.getTopRowIndex();
-							var topRowCommand = window.promptLine + scrolledLines;
-							this.io.print('\x1b[' + (topRowCommand + 1) + ';' + (window.promptEnd + 1) + 'H'); // move cursor to new position 
-							currentCommandCursorPosition = 0; 
+							moveCommandCursor(0);
 						}
 						break;
 					case String.fromCharCode(3):  // Ctrl-C: cancel current command
 						disableAutocompleteMenu();
 						// Before *not*-executing command, move to end of line if not already there:
-						// Compute how many lines should we move downward:
 						if (io.currentCommand == '') {
 							break;
 						}
-						var beginCommand = io.currentCommand.slice(0, currentCommandCursorPosition); 
-						var lineCursor = Math.floor((lib.wc.strWidth(beginCommand) + window.promptEnd)/ term.screenSize.width);
-						var lineEndCommand = Math.floor((lib.wc.strWidth(io.currentCommand) + window.promptEnd)/ term.screenSize.width);
-						for (var i = 0; i < lineEndCommand - lineCursor; i++) {
-							io.println('');
-						}
+						moveCommandCursor(io.currentCommand.length);
 						io.println('');
 						printPrompt();
 						updatePromptPosition(); 
@@ -1210,41 +1660,24 @@ function setupHterm() {
 					case String.fromCharCode(4):  // Ctrl-D: delete character after cursor
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition < io.currentCommand.length) {
-							var currentChar = io.currentCommand[currentCommandCursorPosition];
-							var currentCharWidth = lib.wc.strWidth(currentChar);
-							io.print('\x1b[0J'); // delete display after cursor
-							// print remainder of command line
-							var endOfCommand = io.currentCommand.slice(currentCommandCursorPosition + 1, io.currentCommand.length);
-							io.print(endOfCommand)
-							// move cursor back to where it was (don't use term.screen_.cursorPosition):
-							var wcwidth = lib.wc.strWidth(endOfCommand);
-							for (var i = 0; i < wcwidth; i++) {
-								io.print('\b'); 
-							}
 							// remove character from command at current position:
-							io.currentCommand = io.currentCommand.slice(0, currentCommandCursorPosition) + 
+							var newCommand = io.currentCommand.slice(0, currentCommandCursorPosition) + 
 								io.currentCommand.slice(currentCommandCursorPosition + 1, io.currentCommand.length); 
+							redrawCommand(newCommand, currentCommandCursorPosition, null);
+							io.currentCommand = newCommand;
 						}
 						break;
 					case String.fromCharCode(5):  // Ctrl-E: end of line
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition < io.currentCommand.length) {
-							var scrolledLines = window.promptScroll - this.scrollPort_.getTopRowIndex();
-							var topRowCommand = window.promptLine + scrolledLines;
-							var fullLength = lib.wc.strWidth(io.currentCommand) + window.promptEnd; 
-							var y = Math.floor((fullLength / this.screenSize.width)) ;
-							var x = fullLength - this.screenSize.width * y;
-							y += topRowCommand
-
-							this.io.print('\x1b[' + (y + 1) + ';' + (x + 1) + 'H'); // move cursor to new position 
-							currentCommandCursorPosition = io.currentCommand.length; 
+							moveCommandCursor(io.currentCommand.length);
 						}
 						break;
 					case String.fromCharCode(11):  // Ctrl-K: kill until end of line
 						disableAutocompleteMenu();
 						if (currentCommandCursorPosition < io.currentCommand.length) { 
+							redrawCommand(io.currentCommand.slice(0, currentCommandCursorPosition), currentCommandCursorPosition, null);
 							io.currentCommand = io.currentCommand.slice(0, currentCommandCursorPosition)
-							window.term_.io.print('\x1b[0J'); // delete display after cursor
 						}
 						break;
 					case String.fromCharCode(21):  // Ctrl-U: kill from cursor to beginning of the line
@@ -14,9 +14,35 @@ var process = require('process');
 const sab = new SharedArrayBuffer(8196);
 const sharedArray = new Int32Array(sab)
 const wasmWorker = new Worker("wasm_worker_wasm.js");
-var inputString = ''; // stores keyboard input
+// Keyboard input, as UTF-16 code units in a ring buffer: adding and removing input
+// is linear in its length, even for large pastes. The size is a power of 2.
+var inputBuffer = new Uint16Array(4096);
+var inputStart = 0;  // position of the first character not sent yet
+var inputLength = 0; // number of characters not sent yet
 var commandIsRunning = false;
 
+// called by the app with keyboard input:
+function appendInput(string) {
+	if (inputLength + string.length > inputBuffer.length) {
+		let size = inputBuffer.length;
+		while (size < inputLength + string.length) {
+			size *= 2;
+		}
+		let newBuffer = new Uint16Array(size);
+		for (var i = 0; i < inputLength; i++) {
+			newBuffer[i] = inputBuffer[(inputStart + i) & (inputBuffer.length - 1)];
+		}
+		inputBuffer = newBuffer;
+		inputStart = 0;
+	}
+	const mask = inputBuffer.length - 1;
+	const end = inputStart + inputLength;
+	for (var i = 0; i < string.length; i++) {
+		inputBuffer[(end + i) & mask] = string.charCodeAt(i);
+	}
+	inputLength += string.length;
+}
+
 function wakeUpWorker(chunkSize) {
 	let resultStorage = -1;
 	let resultNotify = -1;
@@ -32,7 +58,8 @@ function wakeUpWorker(chunkSize) {
 }
 
 function executeWebAssembly(bufferString, args, cwd, tty, env) {
-	inputString = '';
+	inputStart = 0;
+	inputLength = 0;
 	commandIsRunning = true;
 	// create a webWorker to run webAssembly code:
 	wasmWorker.postMessage([bufferString, args, cwd, tty, env, sab]);
@@ -61,20 +88,22 @@ function executeWebAssembly(bufferString, args, cwd, tty, env) {
 			result = result.substring(chunkSize);
 			wakeUpWorker(chunkSize);
 		} else if (e.data[0] == "keyboard") { // keyboard input
-			let length = Number(e.data[1]);
-			result = inputString.substring(0, length); // send what was asked
-			let chunkSize = result.length;
+			let length = Number(e.data[1]); // send what was asked
+			let chunkSize = Math.min(length, inputLength);
 			if (chunkSize > 2047) chunkSize = 2047;
-			let chunk = result.substring(0, chunkSize);
+			const mask = inputBuffer.length - 1;
 			for (var i = 0; i < chunkSize; i++) {
-				sharedArray[i+1] = chunk.charCodeAt(i);
+				const c = inputBuffer[(inputStart + i) & mask];
+				sharedArray[i+1] = c;
 				// cut after ^D if present, only send up to ^D
-				if (chunk.charCodeAt(i) == 4)
+				if (c == 4) {
+					chunkSize = i + 1;
 					break;
+				}
 			}
-			chunkSize = chunk.length;
-			result = result.substring(chunkSize);
-			inputString = inputString.substring(chunkSize); // remove what's already been sent
+			// remove what's already been sent:
+			inputStart = (inputStart + chunkSize) & mask;
+			inputLength -= chunkSize;
 			Atomics.store(sharedArray, 0, chunkSize + 1);
 			Atomics.notify(sharedArray, 0);
 		} else if (e.data[0] == "sendNextChunk") {
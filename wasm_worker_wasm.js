@@ -1,5 +1,5 @@
-// Load the "require" function:
-importScripts("require.js");
+// Load the "require" function, and the modules it loads at startup:
+importScripts("node_modules/tarp_bundle.js", "require.js");
 // make the "require" function available to all
 Tarp.require({expose: true});
 // Have a global variable: